@@ -0,0 +1,500 @@
+// Microbenchmarks for handing a command from one thread to the CAN thread.
+//
+// The node's command path is: rclcpp callback -> copy under a mutex ->
+// EpollEvent::set() (eventfd write) -> epoll_wait -> eventfd read -> callback
+// -> copy under the mutex. This measures the cost of each stage on its own
+// and the end-to-end latency and throughput of that path against a lock-free
+// ring with eventfd, futex or spinning wakeup and a condition variable.
+//
+// usage: odrive_handoff_bench [--samples <n>] [--pin <producer_cpu>,<consumer_cpu>]
+
+#include "epoll_event_loop.hpp"
+#include "spsc_ring.hpp"
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Same payload as ControlMessage, plus what the benchmark needs
+struct Message {
+    uint32_t control_mode;
+    uint32_t input_mode;
+    float input_pos;
+    float input_vel;
+    float input_torque;
+    uint64_t stamp_ns;
+    uint64_t seq;
+};
+
+static constexpr uint64_t kStopSeq = UINT64_MAX;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Spins for a while before yielding, so that waiting does not starve the other
+// thread when both run on the same core
+template <typename Pred>
+static void spin_until(Pred&& done) {
+    for (unsigned i = 0; !done(); ++i) {
+        if (i < 4096) {
+            cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+static int producer_cpu = -1;
+static int consumer_cpu = -1;
+
+static void pin_current_thread(int cpu) {
+    if (cpu < 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void print_header(const char* title) {
+    std::printf("\n%s\n", title);
+}
+
+static void print_latency(const char* name, std::vector<uint64_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    auto pct = [&samples](double p) { return samples[std::min(samples.size() - 1, size_t(p * samples.size()))]; };
+    double mean = 0;
+    for (uint64_t s : samples) mean += s;
+    mean /= samples.size();
+    std::printf(
+        "  %-28s mean %8.0f  p50 %7lu  p90 %7lu  p99 %7lu  p99.9 %8lu  max %9lu ns\n",
+        name,
+        mean,
+        pct(0.5),
+        pct(0.9),
+        pct(0.99),
+        pct(0.999),
+        samples.back()
+    );
+}
+
+// ---------------------------------------------------------------------------
+// Stage costs, single-threaded
+
+template <typename Fn>
+static void bench_stage(const char* name, size_t iterations, Fn&& fn) {
+    for (size_t i = 0; i < iterations / 10; ++i) fn(); // warm up
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < iterations; ++i) fn();
+    double per_op = double(now_ns() - start) / iterations;
+    std::printf("  %-28s %8.1f ns/op\n", name, per_op);
+}
+
+static void bench_stages(size_t iterations) {
+    print_header("Stage costs (single thread, uncontended)");
+
+    std::mutex mutex;
+    Message shared = {};
+    Message local = {};
+    bench_stage("mutex + copy", iterations, [&]() {
+        std::lock_guard<std::mutex> guard(mutex);
+        shared = local;
+        local.seq++;
+    });
+
+    int efd = eventfd(0, EFD_NONBLOCK);
+    uint64_t value = 1;
+    bench_stage("eventfd write", iterations, [&]() {
+        if (write(efd, &value, sizeof(value)) != sizeof(value)) std::abort();
+    });
+    bench_stage("eventfd write + read", iterations, [&]() {
+        if (write(efd, &value, sizeof(value)) != sizeof(value)) std::abort();
+        if (read(efd, &value, sizeof(value)) != sizeof(value)) std::abort();
+        value = 1;
+    });
+
+    int epfd = epoll_create1(0);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, efd, &ev);
+    if (write(efd, &value, sizeof(value)) != sizeof(value)) std::abort();
+    struct epoll_event triggered[16];
+    bench_stage("epoll_wait (fd ready)", iterations, [&]() {
+        if (epoll_wait(epfd, triggered, 16, -1) != 1) std::abort();
+    });
+    close(epfd);
+    close(efd);
+
+    Callback callback = [&local](uint32_t events) { local.seq += events; };
+    bench_stage("std::function dispatch", iterations, [&]() { callback(1); });
+
+    auto ring = std::make_unique<SpscRing<Message, 1024>>();
+    bench_stage("SpscRing push + pop", iterations, [&]() {
+        ring->push(local);
+        ring->pop(&shared);
+    });
+
+    std::atomic<uint32_t> word{0};
+    bench_stage("futex wake (no waiter)", iterations, [&]() {
+        syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Cross-thread transports
+
+class Transport {
+public:
+    using Handler = std::function<void(const Message&)>;
+    virtual ~Transport() = default;
+    virtual const char* name() const = 0;
+    // Starts the consumer thread, which calls handler for each message
+    virtual void start(Handler handler) = 0;
+    virtual void send(const Message& msg) = 0;
+    // Sends kStopSeq and joins the consumer
+    virtual void stop() = 0;
+};
+
+// The node's path: latest value under a mutex, woken through EpollEvent
+class EpollEventTransport : public Transport {
+public:
+    const char* name() const override { return "mutex + EpollEvent"; }
+
+    void start(Handler handler) override {
+        handler_ = std::move(handler);
+        evt_.init(&loop_, [this](uint32_t) {
+            Message msg;
+            {
+                std::lock_guard<std::mutex> guard(mutex_);
+                msg = msg_;
+            }
+            if (msg.seq == kStopSeq) {
+                evt_.deinit();
+                return;
+            }
+            handler_(msg);
+        });
+        thread_ = std::thread([this]() {
+            pin_current_thread(consumer_cpu);
+            loop_.run_until_empty();
+        });
+    }
+
+    void send(const Message& msg) override {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            msg_ = msg;
+        }
+        evt_.set();
+    }
+
+    void stop() override {
+        Message msg = {};
+        msg.seq = kStopSeq;
+        send(msg);
+        thread_.join();
+    }
+
+private:
+    EpollEventLoop loop_;
+    EpollEvent evt_;
+    std::mutex mutex_;
+    Message msg_ = {};
+    Handler handler_;
+    std::thread thread_;
+};
+
+// Lock-free ring, woken through EpollEvent
+class RingEventTransport : public Transport {
+public:
+    const char* name() const override { return "SpscRing + EpollEvent"; }
+
+    void start(Handler handler) override {
+        handler_ = std::move(handler);
+        evt_.init(&loop_, [this](uint32_t) {
+            Message msg;
+            while (ring_->pop(&msg)) {
+                if (msg.seq == kStopSeq) {
+                    evt_.deinit();
+                    return;
+                }
+                handler_(msg);
+            }
+        });
+        thread_ = std::thread([this]() {
+            pin_current_thread(consumer_cpu);
+            loop_.run_until_empty();
+        });
+    }
+
+    void send(const Message& msg) override {
+        spin_until([&]() { return ring_->push(msg); });
+        evt_.set();
+    }
+
+    void stop() override {
+        Message msg = {};
+        msg.seq = kStopSeq;
+        send(msg);
+        thread_.join();
+    }
+
+private:
+    EpollEventLoop loop_;
+    EpollEvent evt_;
+    std::unique_ptr<SpscRing<Message, 1024>> ring_ = std::make_unique<SpscRing<Message, 1024>>();
+    Handler handler_;
+    std::thread thread_;
+};
+
+// Lock-free ring, consumer sleeps on a futex and is only woken if it sleeps
+class RingFutexTransport : public Transport {
+public:
+    const char* name() const override { return "SpscRing + futex"; }
+
+    void start(Handler handler) override {
+        handler_ = std::move(handler);
+        thread_ = std::thread([this]() {
+            pin_current_thread(consumer_cpu);
+            Message msg;
+            for (;;) {
+                while (ring_->pop(&msg)) {
+                    if (msg.seq == kStopSeq) return;
+                    handler_(msg);
+                }
+                uint32_t seq = seq_.load();
+                sleeping_.store(true);
+                if (seq_.load() == seq && ring_->empty()) {
+                    syscall(SYS_futex, &seq_, FUTEX_WAIT_PRIVATE, seq, nullptr, nullptr, 0);
+                }
+                sleeping_.store(false);
+            }
+        });
+    }
+
+    void send(const Message& msg) override {
+        spin_until([&]() { return ring_->push(msg); });
+        seq_.fetch_add(1);
+        if (sleeping_.load()) {
+            syscall(SYS_futex, &seq_, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+        }
+    }
+
+    void stop() override {
+        Message msg = {};
+        msg.seq = kStopSeq;
+        send(msg);
+        thread_.join();
+    }
+
+private:
+    std::unique_ptr<SpscRing<Message, 1024>> ring_ = std::make_unique<SpscRing<Message, 1024>>();
+    std::atomic<uint32_t> seq_{0};
+    std::atomic<bool> sleeping_{false};
+    Handler handler_;
+    std::thread thread_;
+};
+
+// Lock-free ring, consumer spins (burns a core)
+class RingSpinTransport : public Transport {
+public:
+    const char* name() const override { return "SpscRing + spinning"; }
+
+    void start(Handler handler) override {
+        handler_ = std::move(handler);
+        thread_ = std::thread([this]() {
+            pin_current_thread(consumer_cpu);
+            Message msg;
+            for (;;) {
+                spin_until([&]() { return ring_->pop(&msg); });
+                if (msg.seq == kStopSeq) return;
+                handler_(msg);
+            }
+        });
+    }
+
+    void send(const Message& msg) override {
+        spin_until([&]() { return ring_->push(msg); });
+    }
+
+    void stop() override {
+        Message msg = {};
+        msg.seq = kStopSeq;
+        send(msg);
+        thread_.join();
+    }
+
+private:
+    std::unique_ptr<SpscRing<Message, 1024>> ring_ = std::make_unique<SpscRing<Message, 1024>>();
+    Handler handler_;
+    std::thread thread_;
+};
+
+// Queue under a mutex with a condition variable
+class CondVarTransport : public Transport {
+public:
+    const char* name() const override { return "mutex + condition_variable"; }
+
+    void start(Handler handler) override {
+        handler_ = std::move(handler);
+        thread_ = std::thread([this]() {
+            pin_current_thread(consumer_cpu);
+            std::vector<Message> batch;
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cv_.wait(lock, [this]() { return !queue_.empty(); });
+                    batch.swap(queue_);
+                }
+                for (const Message& msg : batch) {
+                    if (msg.seq == kStopSeq) return;
+                    handler_(msg);
+                }
+                batch.clear();
+            }
+        });
+    }
+
+    void send(const Message& msg) override {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            queue_.push_back(msg);
+        }
+        cv_.notify_one();
+    }
+
+    void stop() override {
+        Message msg = {};
+        msg.seq = kStopSeq;
+        send(msg);
+        thread_.join();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Message> queue_;
+    Handler handler_;
+    std::thread thread_;
+};
+
+static std::vector<std::unique_ptr<Transport>> make_transports() {
+    std::vector<std::unique_ptr<Transport>> transports;
+    transports.push_back(std::make_unique<EpollEventTransport>());
+    transports.push_back(std::make_unique<RingEventTransport>());
+    transports.push_back(std::make_unique<RingFutexTransport>());
+    if (std::thread::hardware_concurrency() > 1) {
+        transports.push_back(std::make_unique<RingSpinTransport>()); // needs a core of its own
+    }
+    transports.push_back(std::make_unique<CondVarTransport>());
+    return transports;
+}
+
+// One message in flight at a time: the producer waits until the consumer has
+// handled the previous one, then stamps and sends the next after a short
+// pause, so the consumer is idle (and usually asleep) when it arrives.
+static void bench_latency(size_t samples) {
+    print_header("Handoff latency (send -> handler, one message in flight)");
+    for (auto& transport : make_transports()) {
+        std::vector<uint64_t> latencies;
+        latencies.reserve(samples);
+        std::atomic<uint64_t> handled{0};
+        transport->start([&](const Message& msg) {
+            latencies.push_back(now_ns() - msg.stamp_ns);
+            handled.store(msg.seq, std::memory_order_release);
+        });
+
+        pin_current_thread(producer_cpu);
+        for (uint64_t seq = 1; seq <= samples; ++seq) {
+            uint64_t resume = now_ns() + 20000;
+            spin_until([resume]() { return now_ns() >= resume; });
+            Message msg = {};
+            msg.seq = seq;
+            msg.stamp_ns = now_ns();
+            transport->send(msg);
+            spin_until([&]() { return handled.load(std::memory_order_acquire) == seq; });
+        }
+        transport->stop();
+        print_latency(transport->name(), latencies);
+    }
+}
+
+// The producer sends as fast as it can. The latest-value path of the node
+// coalesces messages the consumer has not picked up yet; the queues deliver
+// every message.
+static void bench_throughput(size_t messages) {
+    print_header("Throughput (producer sends back-to-back)");
+    for (auto& transport : make_transports()) {
+        std::atomic<uint64_t> handled{0};
+        std::atomic<uint64_t> last{0};
+        transport->start([&](const Message& msg) {
+            handled.fetch_add(1, std::memory_order_relaxed);
+            last.store(msg.seq, std::memory_order_relaxed);
+        });
+
+        pin_current_thread(producer_cpu);
+        uint64_t start = now_ns();
+        for (uint64_t seq = 1; seq <= messages; ++seq) {
+            Message msg = {};
+            msg.seq = seq;
+            transport->send(msg);
+        }
+        spin_until([&]() { return last.load(std::memory_order_relaxed) == messages; });
+        double seconds = (now_ns() - start) * 1e-9;
+        transport->stop();
+
+        std::printf(
+            "  %-28s %8.2f M sent/s  %8.2f M handled/s  (%5.1f%% delivered)\n",
+            transport->name(),
+            messages / seconds * 1e-6,
+            handled.load() / seconds * 1e-6,
+            100.0 * handled.load() / messages
+        );
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t samples = 100000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc) {
+            samples = std::stoul(argv[++i]);
+        } else if (arg == "--pin" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%d,%d", &producer_cpu, &consumer_cpu) != 2) {
+                std::fprintf(stderr, "--pin expects <producer_cpu>,<consumer_cpu>\n");
+                return -1;
+            }
+        } else {
+            std::fprintf(stderr, "usage: %s [--samples <n>] [--pin <producer_cpu>,<consumer_cpu>]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (!samples) samples = 1;
+
+    bench_stages(samples * 10);
+    bench_latency(samples);
+    bench_throughput(samples * 10);
+    return 0;
+}
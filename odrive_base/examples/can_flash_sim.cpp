@@ -0,0 +1,194 @@
+#include "can_flash.hpp"
+#include "can_mux_client.hpp"
+#include "epoll_event_loop.hpp"
+#include "fault_injection.hpp"
+#include "socket_can.hpp"
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+// Transfers a firmware image to several simulated bootloaders over CAN at
+// once. The ODrive bootloader does not implement the protocol of
+// can_flash.hpp, so this is an example of CanFlashSession and only talks to
+// CanFlashSimBootloader, which a second instance runs on a virtual bus
+// (--simulate-bootloaders).
+static void usage(const char* name) {
+    std::cerr << "usage: " << name << " [--window <blocks>] [--frames-per-ms <n>] [--unicast]"
+              << " <interface> <firmware.bin> <node_id>..." << std::endl
+              << "       " << name << " --simulate-bootloaders [--drop-rate <p>] <interface> <node_id>..." << std::endl;
+}
+
+// Accepts only if the whole argument is a number
+template <typename T>
+static bool parse_arg(const char* str, T* value) {
+    const char* end = str + std::strlen(str);
+    auto [ptr, ec] = std::from_chars(str, end, *value);
+    return ec == std::errc() && ptr == end;
+}
+
+static bool read_file(const char* path, std::vector<uint8_t>* data) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    data->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static int simulate(
+    EpollEventLoop& event_loop,
+    std::vector<std::function<void()>>& on_stop,
+    const char* interface,
+    const std::vector<uint32_t>& node_ids,
+    double drop_rate
+) {
+    std::vector<CanFlashSimBootloader> bootloaders;
+    for (uint32_t node_id : node_ids) {
+        bootloaders.emplace_back(node_id, node_id);
+        bootloaders.back().set_drop_rate(drop_rate);
+    }
+
+    SocketCanIntf can_intf;
+    auto send = [&](const can_frame& frame) { can_intf.send_can_frame(frame); };
+    if (!can_intf.init(interface, &event_loop, [&](const can_frame& frame) {
+            for (auto& bootloader : bootloaders) {
+                bootloader.on_can_frame(frame, send);
+            }
+        })) {
+        std::cerr << "Failed to initialize SocketCAN on " << interface << std::endl;
+        return -1;
+    }
+    on_stop.push_back([&]() { can_intf.deinit(); });
+
+    std::cout << "simulating " << bootloaders.size() << " bootloader(s) on " << interface << std::endl;
+    event_loop.run_until_empty();
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    bool sim_bootloaders = false;
+    bool broadcast = true;
+    double drop_rate = 0.0;
+    size_t window = 4;
+    size_t frames_per_ms = 4;
+
+    int arg = 1;
+    for (; arg < argc && std::strncmp(argv[arg], "--", 2) == 0; ++arg) {
+        std::string opt = argv[arg];
+        if (opt == "--simulate-bootloaders") {
+            sim_bootloaders = true;
+        } else if (opt == "--unicast") {
+            broadcast = false;
+        } else if (opt == "--window" && arg + 1 < argc && parse_arg(argv[arg + 1], &window) && window > 0) {
+            ++arg;
+        } else if (opt == "--frames-per-ms" && arg + 1 < argc && parse_arg(argv[arg + 1], &frames_per_ms)
+                   && frames_per_ms > 0) {
+            ++arg;
+        } else if (opt == "--drop-rate" && arg + 1 < argc && parse_arg(argv[arg + 1], &drop_rate)
+                   && drop_rate >= 0.0 && drop_rate <= 1.0) {
+            ++arg;
+        } else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (argc - arg < (sim_bootloaders ? 2 : 3)) {
+        usage(argv[0]);
+        return -1;
+    }
+    const char* interface = argv[arg++];
+    const char* firmware_path = sim_bootloaders ? nullptr : argv[arg++];
+    std::vector<uint32_t> node_ids;
+    for (; arg < argc; ++arg) {
+        uint32_t node_id;
+        if (!parse_arg(argv[arg], &node_id) || node_id > 0x3f) {
+            std::cerr << "invalid node_id: " << argv[arg] << std::endl;
+            usage(argv[0]);
+            return -1;
+        }
+        node_ids.push_back(node_id);
+    }
+
+    register_mux_can_backend();
+    register_fault_can_backend();
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    // Stopping deregisters everything from the loop, which ends run_until_empty()
+    EpollEventLoop event_loop;
+    std::vector<std::function<void()>> on_stop;
+    EpollEventLoop::EvtId signal_evt;
+    auto stop = [&]() {
+        for (auto& fn : on_stop) fn();
+        on_stop.clear();
+        event_loop.deregister_event(signal_evt);
+    };
+    event_loop.register_event(&signal_evt, signal_fd, EPOLLIN, [&](uint32_t) { stop(); });
+
+    if (sim_bootloaders) {
+        int ret = simulate(event_loop, on_stop, interface, node_ids, drop_rate);
+        close(signal_fd);
+        return ret;
+    }
+
+    std::vector<uint8_t> image;
+    if (!read_file(firmware_path, &image) || image.empty()) {
+        std::cerr << "Failed to read " << firmware_path << std::endl;
+        return -1;
+    }
+
+    CanFlashSession session(std::move(image), node_ids, window, broadcast);
+    SocketCanIntf can_intf;
+    if (!can_intf.init(interface, &event_loop, [&](const can_frame& frame) {
+            session.on_can_frame(frame, CanFlashSession::Clock::now());
+        })) {
+        std::cerr << "Failed to initialize SocketCAN on " << interface << std::endl;
+        return -1;
+    }
+    on_stop.push_back([&]() { can_intf.deinit(); });
+
+    auto start = CanFlashSession::Clock::now();
+    auto next_report = start;
+    EpollTimer timer;
+    auto on_tick = [&](uint32_t) {
+        auto now = CanFlashSession::Clock::now();
+        // Frames the socket cannot take right now are offered again next tick
+        session.poll(now, frames_per_ms, [&](const can_frame& frame) { return can_intf.send_can_frame(frame); });
+
+        if (now >= next_report || session.finished()) {
+            next_report = now + std::chrono::seconds(1);
+            for (const auto& target : session.targets()) {
+                std::cout << "node " << target.node_id << ": " << CanFlashSession::stage_name(target.stage) << " "
+                          << (100 * target.acked / session.image_size()) << "%";
+                if (!target.error.empty()) std::cout << " (" << target.error << ")";
+                std::cout << std::endl;
+            }
+        }
+        if (session.finished()) stop();
+    };
+    if (!timer.init(&event_loop, std::chrono::milliseconds(1), on_tick)) {
+        std::cerr << "Failed to initialize timer" << std::endl;
+        can_intf.deinit();
+        return -1;
+    }
+    on_stop.push_back([&]() { timer.deinit(); });
+
+    std::cout << "flashing " << session.image_size() << " bytes to " << node_ids.size() << " drive(s)" << std::endl;
+    event_loop.run_until_empty();
+    close(signal_fd);
+
+    auto elapsed = std::chrono::duration<double>(CanFlashSession::Clock::now() - start).count();
+    for (const auto& target : session.targets()) {
+        std::cout << "node " << target.node_id << ": " << CanFlashSession::stage_name(target.stage) << ", "
+                  << target.go_backs << " go-backs" << std::endl;
+    }
+    std::cout << (session.succeeded() ? "succeeded" : "failed") << " after " << elapsed << " s" << std::endl;
+    return session.succeeded() ? 0 : -1;
+}
@@ -0,0 +1,53 @@
+#ifndef BATCH_DECODER_HPP
+#define BATCH_DECODER_HPP
+
+#include <linux/can.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A CANSimple message whose signals the batch decoder extracts, using the
+// decode_buf() of the generated message struct.
+struct DecodedMessage {
+    uint8_t cmd_id;
+    uint8_t length;
+    const char* name;
+    std::vector<const char*> signal_names;
+    void (*decode)(const uint8_t* buf, double* signals);
+};
+
+// The cyclic messages, Heartbeat, Get_Error and the setpoints
+const std::vector<DecodedMessage>& decoded_messages();
+
+// Decodes recorded CANSimple frames into one column per node_id, message and
+// signal, for offline analysis. Frames of other protocols, remote requests
+// and messages without decoded signals are skipped.
+class BatchDecoder {
+public:
+    struct Series {
+        uint32_t node_id;
+        const DecodedMessage* message;
+        std::vector<double> timestamps; // [s]
+        std::vector<std::vector<double>> signals; // indexed like message->signal_names
+    };
+
+    BatchDecoder();
+
+    // Can be called repeatedly to append more frames
+    void decode(const double* timestamps, const can_frame* frames, size_t n_frames);
+
+    // Ordered by first appearance
+    std::vector<Series>& series() { return series_; }
+
+    // Frames too short for their message
+    size_t bad_length_frames() const { return bad_length_frames_; }
+
+private:
+    std::array<const DecodedMessage*, 32> messages_{}; // indexed by cmd_id
+    std::array<std::array<int, 32>, 64> series_index_; // [node_id][cmd_id], -1 if none yet
+    std::vector<Series> series_;
+    size_t bad_length_frames_ = 0;
+};
+
+#endif // BATCH_DECODER_HPP
@@ -0,0 +1,97 @@
+#ifndef BRINGUP_HPP
+#define BRINGUP_HPP
+
+#include "epoll_coro.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Brings up many axes at once: full calibration sequence, homing and
+// Set_Absolute_Position, each optional per axis. The axes are sequenced as
+// concurrent coroutines on the CAN thread, so bring-up takes as long as the
+// slowest chain of dependent axes rather than the sum over all axes.
+
+struct BringupAxis {
+    uint32_t node_id = 0;
+    bool calibrate = true; // AXIS_STATE_FULL_CALIBRATION_SEQUENCE
+    bool home = false; // AXIS_STATE_HOMING
+    float absolute_position = NAN; // [rev], sent with Set_Absolute_Position unless NaN
+
+    // Axes of the same group (e.g. the wheels of an axle) start each
+    // procedure together, and a failure of one skips the remaining steps of
+    // all of them. Empty: the axis forms a group of its own.
+    std::string group;
+
+    // node_ids that must have been brought up successfully before this axis
+    // starts. If one of them fails, this axis is skipped.
+    std::vector<uint32_t> after;
+};
+
+struct BringupConfig {
+    std::chrono::nanoseconds calibration_timeout = std::chrono::seconds(60);
+    std::chrono::nanoseconds homing_timeout = std::chrono::seconds(30);
+    // A procedure fails if the axis sends no heartbeat for this long
+    std::chrono::nanoseconds heartbeat_timeout = std::chrono::seconds(1);
+    // Maximum number of procedures running at once (e.g. to limit the
+    // calibration current drawn from the supply). 0: unlimited. A group
+    // larger than this runs on its own.
+    size_t max_parallel = 0;
+};
+
+enum class BringupStep {
+    kCalibration,
+    kHoming,
+    kSetAbsolutePosition,
+};
+
+enum class BringupOutcome {
+    kRunning,
+    kSuccess,
+    kFailed, // procedure_result was not SUCCESS
+    kTimedOut, // no result within the timeout, or heartbeats stopped
+    kSkipped, // an earlier step, a group member or a dependency failed
+};
+
+const char* bringup_step_name(BringupStep step);
+const char* bringup_outcome_name(BringupOutcome outcome);
+
+// Start or end of one step of one axis. Timestamps are CLOCK_MONOTONIC [ns].
+// The heartbeat fields are from the last heartbeat the step saw, if any.
+struct BringupEvent {
+    uint32_t node_id = 0;
+    BringupStep step = BringupStep::kCalibration;
+    BringupOutcome outcome = BringupOutcome::kRunning;
+    uint64_t start_ns = 0;
+    uint64_t end_ns = 0; // 0 while running
+    uint8_t axis_state = 0;
+    uint8_t procedure_result = 0;
+    uint32_t axis_error = 0;
+};
+
+struct BringupReport {
+    bool success = false; // every step of every axis succeeded
+    std::string error; // set if the axes were rejected without starting (e.g. a dependency cycle)
+    uint64_t start_ns = 0;
+    uint64_t end_ns = 0;
+    std::vector<BringupEvent> timeline; // ended steps, in the order they ended
+    std::vector<uint32_t> failed; // node_ids of axes with a step that did not succeed
+};
+
+// Called with every event of the timeline, and with kRunning when a step
+// starts. Runs on the event loop thread.
+using BringupProgress = std::function<void(const BringupEvent& event)>;
+
+// Runs the bring-up of all axes. Each procedure is requested with
+// Clear_Errors and Set_Axis_State, and its result is taken from the
+// heartbeats the same way as ODriveAxis::request_state() does.
+CoTask<BringupReport> run_bringup(
+    CoCanBus& bus,
+    std::vector<BringupAxis> axes,
+    BringupConfig config = BringupConfig(),
+    BringupProgress progress = nullptr
+);
+
+#endif // BRINGUP_HPP
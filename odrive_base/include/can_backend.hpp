@@ -0,0 +1,50 @@
+#ifndef CAN_BACKEND_HPP
+#define CAN_BACKEND_HPP
+
+#include "epoll_event_loop.hpp"
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using FrameProcessor = std::function<void(const can_frame&)>;
+using TxEchoProcessor = std::function<void(const can_frame&, uint64_t timestamp_ns)>;
+
+// Transport behind a SocketCanIntf whose interface name starts with a
+// registered prefix, instead of a raw kernel socket. The methods have the
+// same contract as those of SocketCanIntf. deinit() may be called more than
+// once, and by the backend itself when its transport goes away.
+class CanBackend {
+public:
+    virtual ~CanBackend() = default;
+
+    // name is the interface name without the prefix
+    virtual bool init(const std::string& name, EpollEventLoop* event_loop, FrameProcessor frame_processor) = 0;
+    virtual void deinit() = 0;
+    virtual bool send_can_frame(const can_frame& frame) = 0;
+    virtual size_t send_can_frames(const can_frame* frames, size_t n_frames) = 0;
+    virtual bool enable_tx_echo(TxEchoProcessor tx_echo_processor) = 0;
+    virtual bool enable_rx_timestamps() = 0;
+    virtual bool set_filters(const std::vector<can_filter>& filters) = 0;
+    virtual bool read_nonblocking() = 0;
+    virtual uint64_t rx_timestamp_ns() const { return 0; }
+};
+
+using CanBackendFactory = std::unique_ptr<CanBackend> (*)();
+
+// Makes SocketCanIntf open interface names that start with prefix (e.g.
+// "mux:") through a backend made by factory. A program only links the
+// backends it registers: register_mux_can_backend() (can_mux_client.hpp),
+// register_fault_can_backend() (fault_injection.hpp) and
+// register_sim_can_backend() (sim_can_bus.hpp). Registering a prefix again
+// replaces its factory.
+void register_can_backend(const std::string& prefix, CanBackendFactory factory);
+
+// Returns nullptr if no registered prefix matches interface. Otherwise
+// *name is set to the interface name without the prefix.
+std::unique_ptr<CanBackend> make_can_backend(const std::string& interface, std::string* name);
+
+#endif // CAN_BACKEND_HPP
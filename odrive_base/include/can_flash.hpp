@@ -0,0 +1,189 @@
+#ifndef CAN_FLASH_HPP
+#define CAN_FLASH_HPP
+
+#include <linux/can.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+// Block transfer of a firmware image to drives that were put into DFU mode
+// with Enter_DFU_Mode. All frames of the transfer are extended frames, so
+// they cannot collide with CANSimple traffic:
+//
+//   id = CAN_EFF_FLAG | kIdBase | node_id << 8 | opcode
+//
+//   host => drive
+//     kBegin   u32 image size, u32 CRC-32 of the image. Erases the slot.
+//     kBlock   u32 offset, u32 CRC-32 of the block. Starts a block of
+//              kBlockSize bytes (shorter at the end of the image).
+//     kData    u8 frame index within the block, 7 payload bytes
+//     kVerify  no payload
+//
+//   kBlock and kData may also be sent to kBroadcastNodeId, which every drive
+//   in the bootloader accepts as its own.
+//
+//   drive => host
+//     kReady   u8 status: kStatusBootloader when the bootloader started,
+//              kStatusErased in response to kBegin
+//     kAck     u32 offset, u8 status: kStatusOk when the block was written,
+//              kStatusRetry when it was incomplete or its CRC did not match.
+//              Blocks that were already written are acknowledged again,
+//              blocks beyond the next expected one are dropped silently.
+//     kDone    u8 status, u32 CRC-32 of the flash contents
+namespace can_flash {
+
+constexpr uint32_t kIdBase = 0x1f000000;
+constexpr uint32_t kBroadcastNodeId = 0xff;
+constexpr size_t kBlockSize = 256;
+constexpr size_t kDataPerFrame = 7;
+constexpr size_t kFramesPerBlock = (kBlockSize + kDataPerFrame - 1) / kDataPerFrame;
+
+enum Opcode : uint8_t {
+    kBegin = 0x01,
+    kBlock = 0x02,
+    kData = 0x03,
+    kVerify = 0x04,
+    kReady = 0x10,
+    kAck = 0x11,
+    kDone = 0x12,
+};
+
+enum Status : uint8_t {
+    kStatusOk = 0,
+    kStatusRetry = 1,
+    kStatusBootloader = 2,
+    kStatusErased = 3,
+    kStatusFailed = 4,
+};
+
+inline canid_t make_id(uint32_t node_id, uint8_t opcode) {
+    return CAN_EFF_FLAG | kIdBase | (node_id & 0xff) << 8 | opcode;
+}
+
+// Returns false for frames that do not belong to the transfer protocol
+bool parse_id(canid_t id, uint32_t* node_id, uint8_t* opcode);
+
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0);
+
+} // namespace can_flash
+
+// Host side of the transfer to several drives at once. Each drive has up to
+// `window` blocks in flight; on a NAK or timeout, the transfer goes back to
+// the oldest unacknowledged block (go-back-N).
+//
+// Since all drives receive the same image, the blocks are broadcast by
+// default once every drive is erased: the bus carries the image once plus one
+// acknowledgement per drive and block, and the shared stream goes back to the
+// slowest drive when any of them misses a block. Without broadcast, poll()
+// interleaves the drives' own streams round-robin.
+//
+// The class does no I/O: frames from the bus are fed to on_can_frame() and
+// frames to send are handed to the callback of poll().
+class CanFlashSession {
+public:
+    using Clock = std::chrono::steady_clock;
+    using SendFn = std::function<bool(const can_frame&)>;
+
+    enum class Stage {
+        kEnteringDfu,
+        kErasing,
+        kTransferring,
+        kVerifying,
+        kDone,
+        kFailed,
+    };
+
+    struct Target {
+        uint32_t node_id;
+        Stage stage = Stage::kEnteringDfu;
+        std::string error;
+        size_t acked = 0; // bytes written and acknowledged
+        size_t next_offset = 0; // next block to send
+        size_t next_frame = 0; // next frame of that block, 0 = header
+        size_t retries = 0;
+        size_t go_backs = 0; // times the stream had to go back for this drive
+        bool request_pending = false; // stage request not sent yet
+        Clock::time_point deadline;
+    };
+
+    CanFlashSession(
+        std::vector<uint8_t> image,
+        const std::vector<uint32_t>& node_ids,
+        size_t window = 4,
+        bool broadcast = true
+    );
+
+    void set_timeouts(std::chrono::milliseconds ack_timeout, std::chrono::milliseconds erase_timeout);
+
+    void on_can_frame(const can_frame& frame, Clock::time_point now);
+
+    // Hands out up to max_frames frames. Stops early if send() returns false,
+    // in which case that frame is offered again on the next call.
+    size_t poll(Clock::time_point now, size_t max_frames, const SendFn& send);
+
+    bool finished() const;
+    bool succeeded() const;
+    const std::vector<Target>& targets() const { return targets_; }
+    size_t image_size() const { return image_.size(); }
+
+    static const char* stage_name(Stage stage);
+
+private:
+    Target* find(uint32_t node_id);
+    void update_broadcast_stream();
+    bool next_frame(Target& target, Clock::time_point now, can_frame* frame);
+    void encode_data_frame(const Target& target, can_frame* frame) const;
+    void rewind(Target& stream, Clock::time_point now);
+    void go_back(Target& target, Clock::time_point now);
+    void fail(Target& target, const std::string& error);
+
+    std::vector<uint8_t> image_;
+    uint32_t image_crc_;
+    size_t window_;
+    bool broadcast_;
+    Target broadcast_stream_; // acked = slowest drive, only used if broadcast_
+    size_t rr_ = 0; // round-robin position
+    std::chrono::milliseconds ack_timeout_{200};
+    std::chrono::milliseconds erase_timeout_{15000};
+    std::vector<Target> targets_;
+};
+
+// Bootloader side of the protocol with an in-memory flash, for exercising the
+// host on a virtual CAN bus. Frames can be dropped at random to test the
+// retransmission paths.
+class CanFlashSimBootloader {
+public:
+    using SendFn = std::function<void(const can_frame&)>;
+
+    explicit CanFlashSimBootloader(uint32_t node_id, uint32_t seed = 0) : node_id_(node_id), rng_(seed) {}
+
+    void set_drop_rate(double drop_rate) { drop_rate_ = drop_rate; }
+
+    void on_can_frame(const can_frame& frame, const SendFn& send);
+
+    const std::vector<uint8_t>& flash() const { return flash_; }
+
+private:
+    void send_status(uint8_t opcode, uint8_t status, uint32_t value, const SendFn& send) const;
+    void finish_block(const SendFn& send);
+
+    uint32_t node_id_;
+    std::mt19937 rng_;
+    double drop_rate_ = 0.0;
+    bool in_bootloader_ = false;
+    std::vector<uint8_t> flash_;
+    uint32_t expected_crc_ = 0;
+    size_t next_offset_ = 0;
+
+    // Block being received
+    bool block_open_ = false;
+    size_t block_offset_ = 0;
+    uint32_t block_crc_ = 0;
+    std::vector<uint8_t> block_;
+    std::vector<bool> frames_seen_;
+};
+
+#endif // CAN_FLASH_HPP
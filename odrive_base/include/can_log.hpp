@@ -0,0 +1,25 @@
+#ifndef CAN_LOG_HPP
+#define CAN_LOG_HPP
+
+#include <linux/can.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Frames recorded with `candump -l` (or `candump -L`), one per line:
+//   (1436509052.249713) can0 123#0011223344556677
+// Remote frames (123#R) are kept with an empty payload. CAN FD frames and
+// anything else that does not parse are skipped.
+struct CanLog {
+    std::vector<double> timestamps; // [s]
+    std::vector<can_frame> frames;
+    size_t skipped_lines = 0;
+};
+
+// Appends the frames of the file to *log, optionally only those recorded on
+// the given interface. Returns false if the file cannot be read.
+bool read_candump_log(const std::string& path, CanLog* log, const std::string& interface = "");
+
+bool parse_candump_line(std::string_view line, double* timestamp, std::string_view* interface, can_frame* frame);
+
+#endif // CAN_LOG_HPP
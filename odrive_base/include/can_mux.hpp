@@ -0,0 +1,71 @@
+#ifndef CAN_MUX_HPP
+#define CAN_MUX_HPP
+
+#include "spsc_ring.hpp"
+#include <linux/can.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Wire protocol between the CAN bus multiplexer daemon (odrive_can_mux) and
+// its clients.
+//
+// A client connects to the daemon's control socket (abstract unix socket,
+// SOCK_SEQPACKET) and sends a CanMuxRegister message together with three file
+// descriptors:
+//  - a memfd holding a CanMuxRegion (RX and TX rings)
+//  - an eventfd the client signals after each push to its TX ring
+//  - an eventfd the daemon signals after each push to the RX ring
+// The daemon answers with a CanMuxReply. Only processes of the daemon's user
+// or root are accepted. Closing the control socket unregisters the client. CanMuxRegister messages can be re-sent at any time
+// to update the filters.
+
+static constexpr uint32_t kCanMuxVersion = 2;
+static constexpr uint32_t kCanMuxMaxFilters = 16;
+static constexpr uint32_t kCanMuxRingSize = 1024;
+
+struct CanMuxRegion {
+    SpscRing<can_frame, kCanMuxRingSize> rx; // daemon => client
+    SpscRing<can_frame, kCanMuxRingSize> tx; // client => daemon
+    std::atomic<uint32_t> rx_dropped{0}; // frames dropped because the client did not keep up
+    std::atomic<uint32_t> tx_dropped{0}; // frames the daemon could not send for a reason other than a full TX queue
+};
+
+struct CanMuxRegister {
+    uint32_t version = kCanMuxVersion;
+    uint32_t priority = 0; // TX scheduling priority, lower is served first
+    uint32_t n_filters = 0; // 0 means: receive everything
+    can_filter filters[kCanMuxMaxFilters] = {};
+};
+
+struct CanMuxReply {
+    bool ok = false;
+};
+
+// Address of the control socket serving the given CAN interface
+inline socklen_t can_mux_address(const std::string& interface, sockaddr_un* addr) {
+    std::memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    std::string name = "odrive_can_mux." + interface;
+    size_t len = std::min(name.size(), sizeof(addr->sun_path) - 1);
+    std::memcpy(addr->sun_path + 1, name.data(), len); // leading '\0' selects the abstract namespace
+    return offsetof(sockaddr_un, sun_path) + 1 + len;
+}
+
+// Same matching rules as CAN_RAW_FILTER
+inline bool can_mux_match(const can_filter* filters, uint32_t n_filters, const can_frame& frame) {
+    if (n_filters == 0) return true;
+    for (uint32_t i = 0; i < n_filters; ++i) {
+        canid_t id = filters[i].can_id & ~CAN_INV_FILTER;
+        bool match = (frame.can_id & filters[i].can_mask) == (id & filters[i].can_mask);
+        if (filters[i].can_id & CAN_INV_FILTER) match = !match;
+        if (match) return true;
+    }
+    return false;
+}
+
+#endif // CAN_MUX_HPP
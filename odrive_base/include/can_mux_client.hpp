@@ -0,0 +1,45 @@
+#ifndef CAN_MUX_CLIENT_HPP
+#define CAN_MUX_CLIENT_HPP
+
+#include "can_mux.hpp"
+#include <linux/can.h>
+#include <string>
+#include <vector>
+
+// Client side of the CAN bus multiplexer (see can_mux.hpp). Normally used
+// through SocketCanIntf by passing an interface name of the form
+// "mux:<interface>[:<priority>]", once register_mux_can_backend() was called.
+class CanMuxClient {
+public:
+    bool connect(const std::string& interface, uint32_t priority);
+    void disconnect();
+
+    bool set_filters(const std::vector<can_filter>& filters);
+
+    // Fails with errno ENOBUFS when the TX ring is full
+    bool send(const can_frame& frame);
+    bool receive(can_frame* frame);
+
+    // Becomes readable when a frame was pushed to the RX ring. Call
+    // clear_rx_event() before draining the ring with receive().
+    int rx_event_fd() const { return rx_evt_fd_; }
+    void clear_rx_event();
+
+    // Reports EPOLLHUP when the daemon goes away
+    int control_fd() const { return control_fd_; }
+
+private:
+    bool send_register(bool with_fds);
+
+    int control_fd_ = -1;
+    int memfd_ = -1;
+    int tx_evt_fd_ = -1;
+    int rx_evt_fd_ = -1;
+    CanMuxRegion* region_ = nullptr;
+    CanMuxRegister register_;
+};
+
+// Makes SocketCanIntf open "mux:" interface names (see can_backend.hpp)
+void register_mux_can_backend();
+
+#endif // CAN_MUX_CLIENT_HPP
@@ -0,0 +1,61 @@
+#ifndef CAN_MUX_SERVER_HPP
+#define CAN_MUX_SERVER_HPP
+
+#include "can_mux.hpp"
+#include "epoll_event_loop.hpp"
+#include "socket_can.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Bus owner of the CAN bus multiplexer (see can_mux.hpp). Holds the only raw
+// socket on the interface, fans received frames out to the clients whose
+// filters match, and sends the frames queued by all clients in one batch,
+// ordered by client priority. Each client's frames keep their order.
+//
+// Frames the interface does not accept (full TX queue) stay queued and are
+// retried, and the clients' rings are not drained until they are out. A
+// client that keeps sending then finds its ring full, and its sends fail.
+class CanMuxServer {
+public:
+    bool init(const std::string& interface, EpollEventLoop* event_loop);
+    void deinit();
+
+private:
+    struct Client {
+        int control_fd = -1;
+        int tx_evt_fd = -1;
+        int rx_evt_fd = -1;
+        CanMuxRegion* region = nullptr;
+        CanMuxRegister config;
+        EpollEventLoop::EvtId control_evt = nullptr;
+        EpollEventLoop::EvtId tx_evt = nullptr;
+    };
+
+    struct TxEntry {
+        uint32_t priority;
+        const Client* sender;
+        can_frame frame;
+    };
+
+    void on_accept(uint32_t mask);
+    void on_control(Client* client, uint32_t mask);
+    void on_tx(Client* client);
+    bool flush_tx();
+    void on_can_frame(const can_frame& frame);
+    void deliver(const can_frame& frame, const Client* sender);
+    void remove_client(Client* client);
+
+    std::string interface_;
+    EpollEventLoop* event_loop_ = nullptr;
+    SocketCanIntf can_intf_;
+    int listen_fd_ = -1;
+    EpollEventLoop::EvtId listen_evt_ = nullptr;
+    std::vector<std::unique_ptr<Client>> clients_;
+    std::vector<TxEntry> tx_queue_; // sorted, not yet accepted by the interface
+    std::vector<can_frame> tx_frames_;
+    EpollTimer tx_retry_timer_; // armed while tx_queue_ is not empty
+    bool tx_retry_armed_ = false;
+};
+
+#endif // CAN_MUX_SERVER_HPP
@@ -0,0 +1,17 @@
+#ifndef COMMAND_SCHEDULE_HPP
+#define COMMAND_SCHEDULE_HPP
+
+#include <cstdint>
+#include <vector>
+
+// Divider of the base cycle that comes closest to the requested command rate.
+// A command_rate of 0 (or above the base rate) means every cycle.
+uint32_t command_divider(double base_rate_hz, double command_rate_hz);
+
+// Chooses the cycle within its divider in which each command is sent, so the
+// number of commands per cycle is as even as possible instead of all divided
+// commands coinciding every few cycles. Command i is due in cycle c if
+// c % dividers[i] == phases[i].
+std::vector<uint32_t> plan_command_phases(const std::vector<uint32_t>& dividers);
+
+#endif // COMMAND_SCHEDULE_HPP
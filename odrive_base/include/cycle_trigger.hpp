@@ -0,0 +1,49 @@
+#ifndef CYCLE_TRIGGER_HPP
+#define CYCLE_TRIGGER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Process-wide, named signal that a control cycle can start because fresh
+// sensor data has arrived. Producers (e.g. hardware components, one per group
+// of axes) add themselves as sources and notify whenever their data is fresh;
+// the cycle is ready once every source has notified since the last one. A
+// single consumer waits for that and runs the cycle.
+//
+// Sources notify from their own threads; wait() may run concurrently.
+class CycleTrigger {
+public:
+    static constexpr size_t kMaxSources = 64;
+
+    // Returns the trigger with this name, creating it on first use
+    static std::shared_ptr<CycleTrigger> acquire(const std::string& name);
+
+    // Returns the source index, or -1 if kMaxSources are already in use
+    int add_source();
+    void remove_source(int source);
+
+    void notify(int source);
+
+    // Waits until a cycle has become ready since the previous call returned
+    // true. Returns immediately if one already has. Returns false on timeout.
+    bool wait_for(std::chrono::nanoseconds timeout);
+
+    // Number of cycles that became ready so far
+    uint64_t cycles() const;
+
+private:
+    CycleTrigger() = default;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    uint64_t sources_ = 0; // bit mask of added sources
+    uint64_t pending_ = 0; // sources that notified in the current cycle
+    uint64_t generation_ = 0;
+    uint64_t consumed_ = 0; // generation seen by the last successful wait_for()
+};
+
+#endif // CYCLE_TRIGGER_HPP
@@ -0,0 +1,84 @@
+#ifndef CYCLIC_RATES_HPP
+#define CYCLIC_RATES_HPP
+
+#include "can_helpers.hpp"
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Hand-written counterpart of the generated messages in can_simple_messages.hpp
+// for the RxSdo message, limited to writing 32-bit endpoints.
+struct Rx_Sdo_Write_msg_t final {
+    void encode_buf(uint8_t* buf) const {
+        can_set_signal_raw<uint8_t>(buf, 1, 0, 8, true); // opcode: write
+        can_set_signal_raw<uint16_t>(buf, Endpoint_ID, 8, 16, true);
+        can_set_signal_raw<uint8_t>(buf, 0, 24, 8, true); // reserved
+        can_set_signal_raw<uint32_t>(buf, Value, 32, 32, true);
+    }
+
+    static const uint8_t cmd_id = 0x004;
+    static const uint8_t msg_length = 8;
+
+    uint16_t Endpoint_ID = 0;
+    uint32_t Value = 0;
+};
+
+// The ODrive's cyclic messages, each configured by an
+// axis.config.can.<name>_msg_rate_ms endpoint.
+enum CyclicMessage : size_t {
+    kCyclicHeartbeat,
+    kCyclicEncoder,
+    kCyclicIq,
+    kCyclicTorques,
+    kCyclicError,
+    kCyclicTemperature,
+    kCyclicBusVoltage,
+    kCyclicPowers,
+    kNumCyclicMessages,
+};
+
+// Parameter-friendly names, e.g. "encoder" for encoder_msg_rate_ms
+extern const std::array<const char*, kNumCyclicMessages> kCyclicMessageNames;
+
+struct CyclicRateConfig {
+    uint32_t bus_bitrate = 0; // [bit/s], 0 disables the rate configuration
+    uint32_t num_axes = 1; // axes sharing the bus
+    double bus_budget = 0.7; // fraction of the bus that may be used at all
+    double command_rate_hz = 0.0; // setpoint rate per axis, reserved before the telemetry is planned
+    uint32_t min_period_ms = 1;
+    uint32_t idle_period_ms = 100; // period of the motion related messages while an axis is idle
+
+    // Relative share of the telemetry budget, 0 disables the message
+    std::array<double, kNumCyclicMessages> weights = {1.0, 4.0, 1.0, 2.0, 0.5, 0.25, 0.25, 0.0};
+
+    // Endpoint IDs of axis.config.can.<name>_msg_rate_ms for the firmware in
+    // use (see flat_endpoints.json of the firmware release). -1 leaves the rate
+    // of that message untouched.
+    std::array<int32_t, kNumCyclicMessages> endpoint_ids = {-1, -1, -1, -1, -1, -1, -1, -1};
+};
+
+using CyclicRatePlan = std::array<uint32_t, kNumCyclicMessages>; // periods [ms], 0 = off
+
+// Splits the bus budget that remains after the setpoints among the cyclic
+// messages of all axes in proportion to their weights. Periods are rounded up,
+// so the plan never exceeds the budget unless min_period_ms forces it to.
+// In idle plans, the motion related messages (encoder, Iq, torques, powers)
+// are slowed down to idle_period_ms.
+CyclicRatePlan plan_cyclic_rates(const CyclicRateConfig& config, bool idle);
+
+// Bus load of a plan including the setpoints, as a fraction of the bitrate
+double cyclic_bus_load(const CyclicRateConfig& config, const CyclicRatePlan& plan);
+
+// Emits one Rx_Sdo_Write_msg_t per configurable message of the plan
+template <typename TSend>
+void apply_cyclic_rates(const CyclicRateConfig& config, const CyclicRatePlan& plan, TSend&& send) {
+    for (size_t i = 0; i < kNumCyclicMessages; ++i) {
+        if (config.endpoint_ids[i] < 0) continue;
+        Rx_Sdo_Write_msg_t msg;
+        msg.Endpoint_ID = config.endpoint_ids[i];
+        msg.Value = plan[i];
+        send(msg);
+    }
+}
+
+#endif // CYCLIC_RATES_HPP
@@ -0,0 +1,282 @@
+#ifndef EPOLL_CORO_HPP
+#define EPOLL_CORO_HPP
+
+#include "epoll_event_loop.hpp"
+#include "socket_can.hpp"
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// C++20 coroutines on an EpollEventLoop. Multi-step procedures (clear errors,
+// request a state, wait for the heartbeat to confirm it, ...) can be written
+// as straight-line code and run for many axes concurrently on the CAN thread,
+// without blocking threads, condition variables or locks:
+//
+//   CoTask<bool> enter_closed_loop(CoCanBus& bus, uint32_t node_id) { ... }
+//   co_spawn(enter_closed_loop(bus, 0));
+//   co_spawn(enter_closed_loop(bus, 1));
+//   event_loop.run_until_empty();
+//
+// Everything here must be used from the thread that runs the event loop.
+
+template <typename T>
+class CoTask;
+
+namespace coro_detail {
+
+template <typename T>
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    bool detached = false;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+            PromiseBase& promise = handle.promise();
+            if (promise.detached) {
+                handle.destroy();
+                return std::noop_coroutine();
+            }
+            return promise.continuation ? promise.continuation : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { std::terminate(); }
+};
+
+template <typename T>
+struct Promise : PromiseBase<T> {
+    std::optional<T> value;
+    CoTask<T> get_return_object();
+    void return_value(T v) { value = std::move(v); }
+    T result() { return std::move(*value); }
+};
+
+template <>
+struct Promise<void> : PromiseBase<void> {
+    CoTask<void> get_return_object();
+    void return_void() {}
+    void result() {}
+};
+
+} // namespace coro_detail
+
+// Lazily started coroutine. Runs when it is awaited by another coroutine, or
+// on its own when passed to co_spawn().
+template <typename T = void>
+class CoTask {
+public:
+    using promise_type = coro_detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit CoTask(Handle handle) : handle_(handle) {}
+    CoTask(CoTask&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    CoTask(const CoTask&) = delete;
+    CoTask& operator=(const CoTask&) = delete;
+    ~CoTask() {
+        if (handle_) handle_.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+    T await_resume() { return handle_.promise().result(); }
+
+    Handle release() { return std::exchange(handle_, nullptr); }
+
+private:
+    Handle handle_;
+};
+
+template <typename T>
+CoTask<T> coro_detail::Promise<T>::get_return_object() {
+    return CoTask<T>(CoTask<T>::Handle::from_promise(*this));
+}
+
+inline CoTask<void> coro_detail::Promise<void>::get_return_object() {
+    return CoTask<void>(CoTask<void>::Handle::from_promise(*this));
+}
+
+// Runs the task until its first suspension. It frees itself when done.
+inline void co_spawn(CoTask<void> task) {
+    auto handle = task.release();
+    handle.promise().detached = true;
+    handle.resume();
+}
+
+// One-shot timer on the event loop. Calls the callback once after the delay,
+// unless cancelled before.
+class EpollDeadline {
+public:
+    EpollDeadline() = default;
+    EpollDeadline(const EpollDeadline&) = delete;
+    EpollDeadline& operator=(const EpollDeadline&) = delete;
+    ~EpollDeadline() { cancel(); }
+
+    bool start(EpollEventLoop* event_loop, std::chrono::nanoseconds delay, std::function<void()> callback);
+    void cancel();
+    bool armed() const { return fd_ >= 0; }
+
+private:
+    void on_trigger(uint32_t);
+
+    EpollEventLoop* event_loop_ = nullptr;
+    int fd_ = -1;
+    EpollEventLoop::EvtId evt_ = nullptr;
+    std::function<void()> callback_;
+};
+
+// co_await sleep_for(&event_loop, 10ms);
+class SleepAwaiter {
+public:
+    SleepAwaiter(EpollEventLoop* event_loop, std::chrono::nanoseconds delay) : event_loop_(event_loop), delay_(delay) {}
+
+    bool await_ready() const noexcept { return delay_.count() <= 0; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const noexcept {}
+
+private:
+    EpollEventLoop* event_loop_;
+    std::chrono::nanoseconds delay_;
+    EpollDeadline deadline_;
+};
+
+inline SleepAwaiter sleep_for(EpollEventLoop* event_loop, std::chrono::nanoseconds delay) {
+    return SleepAwaiter(event_loop, delay);
+}
+
+// Lets coroutines wait for a condition that other coroutines change:
+//
+//   while (!ready) co_await signal.wait();  // waiter
+//   ready = true; signal.notify_all();      // other coroutine
+class CoSignal {
+public:
+    class Awaiter {
+    public:
+        explicit Awaiter(CoSignal* signal) : signal_(signal) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { signal_->waiters_.push_back(handle); }
+        void await_resume() const noexcept {}
+
+    private:
+        CoSignal* signal_;
+    };
+
+    Awaiter wait() { return Awaiter(this); }
+
+    // Resumes every coroutine that is waiting at the time of the call.
+    // Coroutines that start waiting meanwhile are left for the next call.
+    void notify_all();
+
+private:
+    std::vector<std::coroutine_handle<>> waiters_;
+};
+
+using FramePredicate = std::function<bool(const can_frame&)>;
+
+// Matches CANSimple frames from node_id with the given cmd_id
+FramePredicate match_frame(uint32_t node_id, uint32_t cmd_id);
+
+// A SocketCanIntf whose traffic can be awaited by coroutines
+class CoCanBus {
+public:
+    class FrameAwaiter {
+    public:
+        FrameAwaiter(CoCanBus* bus, FramePredicate predicate, std::chrono::nanoseconds timeout)
+            : bus_(bus), predicate_(std::move(predicate)), timeout_(timeout) {}
+        FrameAwaiter(const FrameAwaiter&) = delete;
+        FrameAwaiter& operator=(const FrameAwaiter&) = delete;
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        std::optional<can_frame> await_resume() noexcept { return result_; } // nullopt on timeout or deinit()
+
+    private:
+        friend class CoCanBus;
+        void complete(std::optional<can_frame> frame);
+
+        CoCanBus* bus_;
+        FramePredicate predicate_;
+        std::chrono::nanoseconds timeout_;
+        std::coroutine_handle<> handle_;
+        std::optional<can_frame> result_;
+        EpollDeadline deadline_;
+    };
+
+    class DrainAwaiter {
+    public:
+        explicit DrainAwaiter(CoCanBus* bus) : bus_(bus) {}
+
+        bool await_ready() const noexcept { return bus_->tx_queue_.empty(); }
+        void await_suspend(std::coroutine_handle<> handle) { bus_->drain_waiters_.push_back(handle); }
+        void await_resume() const noexcept {}
+
+    private:
+        CoCanBus* bus_;
+    };
+
+    // Frames that no coroutine is waiting for go to frame_processor (optional)
+    bool init(const std::string& interface, EpollEventLoop* event_loop, FrameProcessor frame_processor = nullptr);
+    // Drops unsent frames and resumes all waiting coroutines
+    void deinit();
+
+    // Queued and handed to the socket as soon as it accepts them. When the
+    // kernel queue is full (ENOBUFS or EAGAIN), sending is retried after
+    // kTxRetryInterval instead of dropping the frame. Frames that fail with
+    // any other error are dropped and reported.
+    void send(const can_frame& frame);
+
+    template <typename T>
+    void send(uint32_t node_id, const T& msg) {
+        can_frame frame = {};
+        frame.can_id = node_id << 5 | T::cmd_id;
+        frame.can_dlc = T::msg_length;
+        msg.encode_buf(frame.data);
+        send(frame);
+    }
+
+    // co_await bus.next_frame(match_frame(node_id, Heartbeat_msg_t::cmd_id), 1s)
+    // The frame is only matched against waiters that exist when it arrives.
+    FrameAwaiter next_frame(FramePredicate predicate, std::chrono::nanoseconds timeout) {
+        return FrameAwaiter(this, std::move(predicate), timeout);
+    }
+
+    // Resumes once every frame queued so far has been handed to the kernel or
+    // dropped
+    DrainAwaiter drained() { return DrainAwaiter(this); }
+
+    EpollEventLoop* event_loop() { return event_loop_; }
+    SocketCanIntf* intf() { return &can_intf_; }
+
+    static constexpr std::chrono::milliseconds kTxRetryInterval{1};
+
+private:
+    void on_can_msg(const can_frame& frame);
+    void flush();
+
+    EpollEventLoop* event_loop_ = nullptr;
+    SocketCanIntf can_intf_;
+    bool open_ = false;
+    FrameProcessor frame_processor_;
+    std::vector<FrameAwaiter*> frame_waiters_;
+    std::deque<can_frame> tx_queue_;
+    EpollDeadline tx_retry_;
+    std::vector<std::coroutine_handle<>> drain_waiters_;
+};
+
+#endif // EPOLL_CORO_HPP
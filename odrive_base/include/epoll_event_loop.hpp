@@ -3,6 +3,7 @@
 
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <chrono>
 #include <iostream>
 #include <functional>
 #include <vector>
@@ -26,8 +27,12 @@ public:
 
     bool register_event(EvtId* p_evt, int fd, uint32_t events, const Callback& callback);
 
+    // May be called from a callback, including the event's own. Events that
+    // already triggered in the same iteration are skipped, and the context is
+    // only freed once the iteration's callbacks have returned.
     bool deregister_event(EvtId evt);
 
+    // Returns once the last event was deregistered
     bool run_until_empty();
 
     void drop_event(EvtId evt);
@@ -38,6 +43,8 @@ private:
     size_t n_events_ = 0;
     int n_triggered_events_ = 0;
     struct epoll_event triggered_events_[kMaxEventsPerIteration];
+    bool dispatching_ = false;
+    std::vector<EventContext*> deregistered_; // freed after the current iteration
 };
 
 class EpollEvent {
@@ -56,5 +63,18 @@ private:
     Callback callback_;
 };
 
+class EpollTimer {
+public:
+    bool init(EpollEventLoop* event_loop, std::chrono::nanoseconds period, const Callback& callback);
+    void deinit();
+
+private:
+    void on_trigger(uint32_t event_id);
+
+    EpollEventLoop* event_loop_;
+    int fd_ = -1;
+    EpollEventLoop::EventContext* evt_;
+    Callback callback_;
+};
 
 #endif // EPOLL_EVENT_LOOP_HPP
@@ -0,0 +1,116 @@
+#ifndef FAULT_INJECTION_HPP
+#define FAULT_INJECTION_HPP
+
+#include "epoll_event_loop.hpp"
+#include <linux/can.h>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+// Disturbances applied to the traffic of a SocketCanIntf. Probabilities are
+// per frame. The per-frame faults come from one generator seeded with `seed`,
+// so a run with the same traffic sees the same faults. Bus-off events depend
+// on time rather than traffic and draw from a second generator, also seeded
+// from `seed`, so that they do not shift the per-frame faults.
+struct FaultConfig {
+    uint64_t seed = 1;
+    double rx_drop = 0.0;
+    double tx_drop = 0.0; // send reports success, frame is not sent
+    double duplicate = 0.0; // received frame is delivered twice
+    double reorder = 0.0; // frame is held back by reorder_us, so later frames overtake it
+    uint32_t reorder_us = 1000;
+    uint32_t latency_us = 0; // added to every frame in both directions
+    uint32_t jitter_us = 0; // uniform in [0, jitter_us], on top of latency_us
+    double enobufs = 0.0; // send fails with ENOBUFS
+    double bus_off_rate = 0.0; // bus-off events per second (Poisson)
+    uint32_t bus_off_ms = 100; // no RX, sends fail with ENETDOWN
+};
+
+// Parses comma-separated key=value pairs with the names of the FaultConfig
+// fields, e.g. "seed=3,rx_drop=0.01,latency_us=200". "drop" sets both
+// rx_drop and tx_drop.
+bool parse_fault_config(const std::string& spec, FaultConfig* config);
+
+struct FaultStats {
+    uint64_t rx_frames = 0;
+    uint64_t rx_dropped = 0;
+    uint64_t rx_duplicated = 0;
+    uint64_t tx_frames = 0;
+    uint64_t tx_dropped = 0;
+    uint64_t tx_enobufs = 0;
+    uint64_t tx_failed = 0; // delayed frames the socket rejected
+    uint64_t reordered = 0;
+    uint64_t bus_offs = 0;
+    uint64_t bus_off_frames = 0; // lost or rejected during bus-off
+};
+
+// Sits between a SocketCanIntf and its socket. Delayed frames are released by
+// a timer on the event loop, or by service() for sockets that are polled
+// instead (SharedCanBus).
+class FaultInjector {
+public:
+    using Deliver = std::function<void(const can_frame&)>;
+    using Transmit = std::function<bool(const can_frame&)>;
+
+    FaultInjector(const FaultConfig& config, Deliver deliver, Transmit transmit);
+    ~FaultInjector() { deinit(); }
+
+    bool init(EpollEventLoop* event_loop);
+    void deinit();
+
+    void on_rx(const can_frame& frame);
+
+    // Returns false with errno set for injected send failures
+    bool on_tx(const can_frame& frame);
+
+    // Releases all frames that are due. Returns true if any was delivered.
+    bool service();
+
+    const FaultConfig& config() const { return config_; }
+    const FaultStats& stats() const { return stats_; }
+
+private:
+    struct Delayed {
+        uint64_t due_ns;
+        uint64_t seq; // keeps frames with the same due time in order
+        bool tx;
+        can_frame frame;
+        bool operator>(const Delayed& other) const {
+            return due_ns != other.due_ns ? due_ns > other.due_ns : seq > other.seq;
+        }
+    };
+
+    bool chance(double p) { return p > 0.0 && uniform_(rng_) < p; }
+    uint64_t delay_ns();
+    bool bus_off(uint64_t now_ns);
+    void schedule(uint64_t delay, bool tx, const can_frame& frame);
+    void arm_timer();
+
+    FaultConfig config_;
+    Deliver deliver_;
+    Transmit transmit_;
+    std::mt19937_64 rng_;
+    std::mt19937_64 bus_off_rng_;
+    std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+    FaultStats stats_;
+
+    std::priority_queue<Delayed, std::vector<Delayed>, std::greater<Delayed>> delayed_;
+    uint64_t seq_ = 0;
+    uint64_t next_bus_off_ns_ = 0;
+    uint64_t bus_off_until_ns_ = 0;
+
+    EpollEventLoop* event_loop_ = nullptr;
+    int timer_fd_ = -1;
+    EpollEventLoop::EvtId timer_evt_ = nullptr;
+    uint64_t armed_ns_ = 0; // due time the timer is armed for, 0 if disarmed
+};
+
+// Makes SocketCanIntf open "fault:<options>:<interface>" interface names (see
+// can_backend.hpp). The inner interface is opened through the registered
+// backends as well.
+void register_fault_can_backend();
+
+#endif // FAULT_INJECTION_HPP
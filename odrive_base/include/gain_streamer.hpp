@@ -0,0 +1,74 @@
+#ifndef GAIN_STREAMER_HPP
+#define GAIN_STREAMER_HPP
+
+#include "can_helpers.hpp"
+#include "can_simple_messages.hpp"
+#include <chrono>
+#include <cmath>
+
+// Controller gains in ODrive units. NaN means "not requested yet", in which
+// case the gains configured on the ODrive are left untouched.
+struct ControllerGains {
+    float pos_gain = NAN; // [(rev/s) / rev]
+    float vel_gain = NAN; // [Nm / (rev/s)]
+    float vel_integrator_gain = NAN; // [Nm / rev]
+};
+
+// Decides when Set_Pos_Gain / Set_Vel_Gains need to go out so that gains can be
+// streamed at control rate: a message is only produced if the requested value
+// differs from what was last sent, and at most once per min_interval.
+// Changes that arrive within the interval are not lost, they are sent by the
+// first update() after the interval has elapsed.
+class GainStreamer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void set_min_interval(Clock::duration min_interval) { min_interval_ = min_interval; }
+
+    // Forget what was sent, e.g. after the ODrive rebooted
+    void reset() { sent_ = ControllerGains(); }
+
+    template <typename TSend>
+    void update(const ControllerGains& requested, Clock::time_point now, TSend&& send) {
+        bool pos_changed = changed(requested.pos_gain, sent_.pos_gain);
+        bool vel_changed = changed(requested.vel_gain, sent_.vel_gain)
+                        || changed(requested.vel_integrator_gain, sent_.vel_integrator_gain);
+        if (!pos_changed && !vel_changed) return;
+        if (now - last_sent_ < min_interval_) return;
+
+        bool sent = false;
+        if (pos_changed) {
+            Set_Pos_Gain_msg_t msg;
+            msg.Pos_Gain = requested.pos_gain;
+            send(msg);
+            sent_.pos_gain = requested.pos_gain;
+            sent = true;
+        }
+        // Both velocity gains share one message. A gain that was not requested
+        // keeps the value sent last; the message waits until both are known.
+        float vel_gain = std::isnan(requested.vel_gain) ? sent_.vel_gain : requested.vel_gain;
+        float vel_integrator_gain = std::isnan(requested.vel_integrator_gain) ? sent_.vel_integrator_gain
+                                                                              : requested.vel_integrator_gain;
+        if (vel_changed && !std::isnan(vel_gain) && !std::isnan(vel_integrator_gain)) {
+            Set_Vel_Gains_msg_t msg;
+            msg.Vel_Gain = vel_gain;
+            msg.Vel_Integrator_Gain = vel_integrator_gain;
+            send(msg);
+            sent_.vel_gain = vel_gain;
+            sent_.vel_integrator_gain = vel_integrator_gain;
+            sent = true;
+        }
+        if (sent) last_sent_ = now;
+    }
+
+private:
+    static bool changed(float requested, float sent) {
+        return !std::isnan(requested) && requested != sent;
+    }
+
+    Clock::duration min_interval_{};
+    Clock::time_point last_sent_{};
+    ControllerGains sent_;
+};
+
+#endif // GAIN_STREAMER_HPP
@@ -0,0 +1,63 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+
+// Log-linear histogram of non-negative integers (e.g. durations in ns): eight
+// buckets per power of two, so percentiles are accurate to 12.5% over the
+// whole uint64_t range. Fixed size and constant time per sample, so it can run
+// in every control cycle.
+struct Histogram {
+    void add(uint64_t value) {
+        buckets_[bucket(value)]++;
+        count_++;
+        max_ = std::max(max_, value);
+    }
+
+    void reset() { *this = Histogram(); }
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+
+    // Upper bound of the bucket holding the p-quantile (0 <= p <= 1), at most
+    // max(). 0 if there are no samples.
+    uint64_t percentile(double p) const {
+        if (!count_) return 0;
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p * count_ + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kNumBuckets; ++i) {
+            seen += buckets_[i];
+            if (seen >= rank) {
+                return std::min(upper_bound(i), max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static constexpr unsigned kSubBits = 3;
+    static constexpr uint64_t kSubBuckets = 1 << kSubBits;
+    static constexpr size_t kNumBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+    static size_t bucket(uint64_t value) {
+        if (value < kSubBuckets) return value;
+        unsigned shift = std::bit_width(value) - 1 - kSubBits;
+        return (shift + 1) * kSubBuckets + ((value >> shift) & (kSubBuckets - 1));
+    }
+
+    static uint64_t upper_bound(size_t bucket) {
+        if (bucket < kSubBuckets) return bucket;
+        unsigned shift = bucket / kSubBuckets - 1;
+        uint64_t lower = (kSubBuckets + bucket % kSubBuckets) << shift;
+        return lower + ((uint64_t(1) << shift) - 1);
+    }
+
+    std::array<uint32_t, kNumBuckets> buckets_ = {};
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+};
+
+#endif // HISTOGRAM_HPP
@@ -0,0 +1,64 @@
+#ifndef IMPEDANCE_CONTROLLER_HPP
+#define IMPEDANCE_CONTROLLER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+// Host-side PD/impedance law that is meant to be evaluated directly in the
+// CAN receive path: every time an encoder estimate arrives, update() computes
+// the torque to send back to the ODrive.
+//
+// All quantities are in ODrive (motor) units: turns, turns/s, Nm, Nm/turn and
+// Nm/(turn/s).
+struct ImpedanceTarget {
+    bool active = false; // update() returns false while inactive
+    float pos = 0.0f;
+    float vel = 0.0f;
+    float torque_ff = 0.0f;
+    float stiffness = 0.0f;
+    float damping = 0.0f;
+    float torque_limit = 0.0f; // <= 0 means unlimited
+};
+
+class ImpedanceController {
+public:
+    ImpedanceController() = default;
+    ImpedanceController(const ImpedanceController&) = delete;
+    ImpedanceController& operator=(const ImpedanceController&) = delete;
+
+    // Publishes a new target. Wait-free; must only be called from one thread.
+    void set_target(const ImpedanceTarget& target) {
+        slots_[back_] = target;
+        back_ = state_.exchange(back_ | kDirty, std::memory_order_acq_rel) & kIndexMask;
+    }
+
+    // Evaluates the control law for a fresh estimate. Wait-free; must only be
+    // called from one thread (the one that receives the encoder frames).
+    // Returns false if no torque should be sent.
+    bool update(float pos_estimate, float vel_estimate, float* torque) {
+        if (state_.load(std::memory_order_relaxed) & kDirty) {
+            front_ = state_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+        }
+        const ImpedanceTarget& t = slots_[front_];
+        if (!t.active) return false;
+
+        float out = t.torque_ff + t.stiffness * (t.pos - pos_estimate) + t.damping * (t.vel - vel_estimate);
+        if (t.torque_limit > 0.0f) out = std::clamp(out, -t.torque_limit, t.torque_limit);
+        *torque = out;
+        return true;
+    }
+
+private:
+    // Triple buffer: the writer owns back_, the reader owns front_ and the
+    // third slot index is parked in state_ together with a "new data" flag.
+    static constexpr uint8_t kIndexMask = 0x3;
+    static constexpr uint8_t kDirty = 0x4;
+
+    ImpedanceTarget slots_[3];
+    uint8_t back_ = 0;
+    uint8_t front_ = 1;
+    std::atomic<uint8_t> state_ = 2;
+};
+
+#endif // IMPEDANCE_CONTROLLER_HPP
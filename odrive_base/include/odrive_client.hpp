@@ -0,0 +1,158 @@
+#ifndef ODRIVE_CLIENT_HPP
+#define ODRIVE_CLIENT_HPP
+
+#include "epoll_event_loop.hpp"
+#include "socket_can.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Asynchronous client for ODrives on a CAN bus, for programs that do not use
+// ROS. ODriveBus runs the socket on its own thread; the ODriveAxis handles it
+// hands out can be used from any thread.
+
+// Last received telemetry of an axis, in ODrive units. Timestamps are
+// CLOCK_MONOTONIC [ns] and 0 until the respective message arrived.
+struct AxisSnapshot {
+    uint64_t heartbeat_ns = 0;
+    uint32_t axis_error = 0;
+    uint8_t axis_state = 0;
+    uint8_t procedure_result = 0;
+    bool trajectory_done = false;
+
+    uint64_t error_ns = 0;
+    uint32_t active_errors = 0;
+    uint32_t disarm_reason = 0;
+
+    uint64_t estimates_ns = 0;
+    float pos_estimate = NAN; // [rev]
+    float vel_estimate = NAN; // [rev/s]
+
+    float iq_setpoint = NAN; // [A]
+    float iq_measured = NAN; // [A]
+    float torque_target = NAN; // [Nm]
+    float torque_estimate = NAN; // [Nm]
+    float bus_voltage = NAN; // [V]
+    float bus_current = NAN; // [A]
+    float fet_temperature = NAN; // [deg C]
+    float motor_temperature = NAN; // [deg C]
+    float electrical_power = NAN; // [W]
+    float mechanical_power = NAN; // [W]
+};
+
+struct AxisStateResult {
+    bool success = false; // requested state reached, or procedure finished successfully
+    bool timed_out = false;
+    uint8_t axis_state = 0;
+    uint8_t procedure_result = 0;
+    uint32_t active_errors = 0;
+};
+
+class ODriveBus;
+
+class ODriveAxis {
+public:
+    // Called on the bus thread after a received frame was applied to the
+    // snapshot. Must not block.
+    using TelemetryCallback = std::function<void(uint8_t cmd_id, const AxisSnapshot& snapshot)>;
+
+    uint32_t node_id() const { return node_id_; }
+
+    AxisSnapshot snapshot() const;
+
+    // Only allowed before ODriveBus::init()
+    void set_telemetry_callback(TelemetryCallback callback) { telemetry_callback_ = std::move(callback); }
+
+    // Queued and sent by the bus thread
+    void set_input_pos(float pos, float vel_ff = 0.0f, float torque_ff = 0.0f);
+    void set_input_vel(float vel, float torque_ff = 0.0f);
+    void set_input_torque(float torque);
+    void set_controller_mode(uint32_t control_mode, uint32_t input_mode);
+    void clear_errors();
+
+    // Requests an axis state. The future resolves once a heartbeat shows that
+    // the ODrive handled the request: for CLOSED_LOOP_CONTROL and IDLE when
+    // the state was entered, for calibration and other procedures when the
+    // procedure finished. Heartbeats that may predate the request are ignored.
+    std::future<AxisStateResult> request_state(
+        uint32_t axis_state,
+        std::chrono::milliseconds timeout = std::chrono::seconds(30)
+    );
+
+private:
+    friend class ODriveBus;
+
+    struct StateRequest {
+        uint32_t axis_state;
+        std::chrono::steady_clock::time_point deadline;
+        int heartbeats_to_skip; // heartbeats sent before the request was processed
+        std::promise<AxisStateResult> promise;
+    };
+
+    ODriveAxis(ODriveBus* bus, uint32_t node_id) : bus_(bus), node_id_(node_id) {}
+
+    template <typename T>
+    void send(const T& msg);
+    void on_can_msg(const can_frame& frame, uint64_t timestamp_ns);
+    void check_state_requests(std::chrono::steady_clock::time_point now);
+
+    ODriveBus* bus_;
+    uint32_t node_id_;
+    TelemetryCallback telemetry_callback_;
+
+    mutable std::mutex mutex_; // guards snapshot_ and state_requests_
+    AxisSnapshot snapshot_;
+    std::vector<StateRequest> state_requests_;
+};
+
+class ODriveBus {
+public:
+    ODriveBus() = default;
+    ODriveBus(const ODriveBus&) = delete;
+    ODriveBus& operator=(const ODriveBus&) = delete;
+    ~ODriveBus() { deinit(); }
+
+    // Axes must be added before init(). Returns nullptr if the node_id is
+    // invalid or already added.
+    ODriveAxis* add_axis(uint32_t node_id);
+
+    // Opens the interface (see SocketCanIntf) and starts the bus thread
+    bool init(const std::string& interface);
+    void deinit();
+
+    // Frames that cannot be handed to the socket are dropped
+    uint64_t dropped_frames() const { return dropped_frames_; }
+
+private:
+    friend class ODriveAxis;
+
+    void queue(const can_frame& frame);
+    void on_can_msg(const can_frame& frame);
+    void on_tx();
+    void on_tick();
+
+    EpollEventLoop event_loop_;
+    SocketCanIntf can_intf_;
+    EpollEvent tx_evt_;
+    EpollEvent stop_evt_;
+    EpollTimer tick_timer_; // state request timeouts
+    std::thread thread_;
+
+    std::array<std::unique_ptr<ODriveAxis>, 64> axes_; // indexed by node_id
+
+    std::mutex tx_mutex_;
+    std::vector<can_frame> tx_queue_; // guarded by tx_mutex_
+    std::vector<can_frame> tx_batch_; // bus thread only
+    std::atomic<uint64_t> dropped_frames_{0};
+};
+
+#endif // ODRIVE_CLIENT_HPP
@@ -0,0 +1,108 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+enum PerfEvent {
+    kPerfCycles,
+    kPerfInstructions,
+    kPerfCacheMisses,
+    kPerfTaskClock, // [ns], software
+    kPerfContextSwitches, // software
+    kPerfPageFaults, // software
+    kNumPerfEvents
+};
+
+extern const char* const kPerfEventNames[kNumPerfEvents];
+
+// Totals of one region since the process started
+struct PerfRegionStats {
+    const char* name;
+    uint64_t samples;
+    std::array<uint64_t, kNumPerfEvents> totals;
+};
+
+// Code region whose counter deltas are accumulated over all executions on all
+// threads. Obtained from PerfCounters::region(), never destroyed.
+class PerfRegion {
+public:
+    explicit PerfRegion(const char* name) : name_(name) {}
+
+    const char* name() const { return name_; }
+    void add(const uint64_t* begin, const uint64_t* end);
+    PerfRegionStats stats() const;
+
+private:
+    const char* name_;
+    std::atomic<uint64_t> samples_{0};
+    std::array<std::atomic<uint64_t>, kNumPerfEvents> totals_ = {};
+};
+
+// Process-wide performance counters based on perf_event_open(). Each thread
+// opens its own counter group on first use, counting that thread only.
+// Hardware events (cycles, instructions, cache misses) are not available on
+// all systems (VMs, perf_event_paranoid); the software events then still
+// count. If the kernel does not allow counting kernel code, only user space
+// is counted.
+//
+// A sample costs two read() syscalls, which are included in enclosing
+// regions. While disabled, a scope costs one relaxed load. Defining
+// ODRIVE_DISABLE_PERF_COUNTERS compiles the scopes out entirely.
+class PerfCounters {
+public:
+    static void enable() { enabled_.store(true, std::memory_order_relaxed); }
+    static void disable() { enabled_.store(false, std::memory_order_relaxed); }
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // Returns the region with this name, creating it on first use. The name
+    // must be a string literal (or otherwise outlive the process).
+    static PerfRegion* region(const char* name);
+    static std::vector<PerfRegionStats> snapshot();
+
+    // Bit mask over PerfEvent of the events that could be opened by at least
+    // one thread so far
+    static uint32_t available_events() { return available_events_.load(std::memory_order_relaxed); }
+
+    // Current counter values of the calling thread, opening its counters on
+    // first use. Returns false if none of them can be opened.
+    static bool read(uint64_t* values);
+
+private:
+    static std::atomic<bool> enabled_;
+    static std::atomic<uint32_t> available_events_;
+};
+
+// Adds the counter deltas over the lifetime of the scope to the region
+class PerfScope {
+public:
+    explicit PerfScope(PerfRegion* region)
+        : region_(PerfCounters::enabled() && PerfCounters::read(begin_.data()) ? region : nullptr) {}
+
+    ~PerfScope() {
+        std::array<uint64_t, kNumPerfEvents> end;
+        if (region_ && PerfCounters::read(end.data())) region_->add(begin_.data(), end.data());
+    }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+private:
+    std::array<uint64_t, kNumPerfEvents> begin_;
+    PerfRegion* region_;
+};
+
+#define ODRIVE_PERF_CONCAT_(a, b) a##b
+#define ODRIVE_PERF_CONCAT(a, b) ODRIVE_PERF_CONCAT_(a, b)
+
+#ifndef ODRIVE_DISABLE_PERF_COUNTERS
+#define ODRIVE_PERF_SCOPE(name) \
+    static PerfRegion* const ODRIVE_PERF_CONCAT(perf_region_, __LINE__) = PerfCounters::region(name); \
+    PerfScope ODRIVE_PERF_CONCAT(perf_scope_, __LINE__)(ODRIVE_PERF_CONCAT(perf_region_, __LINE__))
+#else
+#define ODRIVE_PERF_SCOPE(name) ((void)0)
+#endif
+
+#endif // PERF_COUNTERS_HPP
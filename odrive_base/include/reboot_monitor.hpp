@@ -0,0 +1,120 @@
+#ifndef REBOOT_MONITOR_HPP
+#define REBOOT_MONITOR_HPP
+
+#include <linux/can.h>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Detects that an ODrive restarted (brownout, Reboot, firmware update) and
+// thereby lost everything sent to it at runtime, and provides the frames that
+// restore it. One per axis, fed with every frame sent to the axis and with its
+// heartbeats and Get_Version replies. Not thread-safe.
+//
+// A reboot is detected when
+// - an axis in CLOSED_LOOP_CONTROL reports IDLE without errors although the
+//   last Set_Axis_State did not request IDLE (state regression), however
+//   short the gap in the heartbeats. An ODrive that disarms on its own
+//   reports errors, so it is not mistaken for a reboot.
+// - a Get_Version reply differs from the previous one. The owner requests one
+//   on the first heartbeat and whenever heartbeats resume after a silence of
+//   at least min_silence and three heartbeat periods (take_version_probe()).
+//
+// A plain reboot of an IDLE axis keeps the version, so it cannot be told
+// apart from a silence with another cause (rebound interface, stalled
+// receiver, longer heartbeat period). When heartbeats resume in IDLE without
+// errors after a silence, the cached configuration is only sent again
+// (Event::kRefresh), which changes nothing if the axis did not reboot.
+//
+// The axis is then re-provisioned with one burst: the cached configuration,
+// followed by the last Set_Axis_State if re-arming is enabled (off by
+// default), it requested CLOSED_LOOP_CONTROL and the axis was armed before
+// the reboot. It is recovered once a heartbeat confirms the burst.
+//
+// A position reference set with Set_Absolute_Position or by homing does not
+// survive a reboot. Once either was sent, the axis is not re-armed and the
+// recovery fails instead (rearm_refused).
+class RebootMonitor {
+public:
+    enum class Cause {
+        kNone,
+        kStateRegression,
+        kVersionChange,
+    };
+
+    enum class Event {
+        kNone,
+        kReboot, // send reprovision_frames() now
+        kRefresh, // IDLE after a silence, send reprovision_frames() now; not counted as a reboot
+        kRecovered, // see recovery().success
+    };
+
+    // Timestamps are CLOCK_MONOTONIC [ns]
+    struct Recovery {
+        Cause cause = Cause::kNone;
+        uint64_t last_heartbeat_ns = 0; // last heartbeat before the reboot
+        uint64_t detected_ns = 0;
+        uint64_t recovered_ns = 0; // 0 while recovering
+        bool rearm = false;
+        bool rearm_refused = false; // re-arm needed, but the position reference was lost
+        bool success = false; // heartbeat confirmed the burst (CLOSED_LOOP_CONTROL if rearm)
+
+        uint64_t downtime_ns() const { return recovered_ns - last_heartbeat_ns; }
+        uint64_t time_to_recover_ns() const { return recovered_ns - detected_ns; }
+    };
+
+    void set_min_silence(std::chrono::nanoseconds min_silence) { min_silence_ns_ = min_silence.count(); }
+    void set_rearm(bool rearm) { rearm_enabled_ = rearm; }
+
+    // Forgets the axis, e.g. after switching to another node_id. Settings and
+    // the reboot count are kept.
+    void reset();
+
+    // Frames sent to the axis. Configuration messages are cached for replay.
+    void on_send(const can_frame& frame);
+
+    Event on_heartbeat(const can_frame& frame, uint64_t now_ns);
+    Event on_version(const can_frame& frame, uint64_t now_ns);
+
+    // True once after each time a version request is due
+    bool take_version_probe();
+    static can_frame version_request(uint32_t node_id);
+
+    // Valid after Event::kReboot and Event::kRefresh, meant to be sent back to back
+    const std::vector<can_frame>& reprovision_frames() const { return burst_; }
+
+    bool recovering() const { return recovering_; }
+    const Recovery& recovery() const { return recovery_; }
+    uint32_t reboots() const { return reboots_; }
+
+    static const char* cause_name(Cause cause);
+
+private:
+    static constexpr int kMaxRecoveryHeartbeats = 5; // without reaching CLOSED_LOOP_CONTROL
+
+    Event detect(Cause cause, uint64_t now_ns);
+    bool requested(uint8_t state) const;
+
+    uint64_t min_silence_ns_ = 200000000;
+    bool rearm_enabled_ = false;
+
+    std::vector<can_frame> config_; // latest frame per configuration message, in order of first use
+    can_frame state_request_ = {}; // last Set_Axis_State, can_dlc 0 if none
+    bool position_referenced_ = false; // Set_Absolute_Position or homing was requested
+
+    uint64_t last_heartbeat_ns_ = 0;
+    uint64_t period_ns_ = 0; // between the last two heartbeats that were not a silence
+    uint8_t last_state_ = 0;
+    bool probe_due_ = false;
+    bool have_version_ = false;
+    uint8_t version_[8] = {};
+
+    std::vector<can_frame> burst_;
+    bool recovering_ = false;
+    int heartbeats_to_skip_ = 0;
+    int recovery_heartbeats_ = 0;
+    Recovery recovery_;
+    uint32_t reboots_ = 0;
+};
+
+#endif // REBOOT_MONITOR_HPP
@@ -0,0 +1,119 @@
+#ifndef SHARED_CAN_BUS_HPP
+#define SHARED_CAN_BUS_HPP
+
+#include "epoll_event_loop.hpp"
+#include "socket_can.hpp"
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One CAN socket per interface, shared by all users in the process (e.g.
+// several ros2_control hardware components on the same bus).
+//
+// - Receive: poll() drains the socket once and routes each frame by node_id to
+//   the owner that attached it, so no frame is received twice.
+// - Transmit: frames are queued and sent in one batch once every owner has
+//   committed its writes for the cycle (or at the next poll() at the latest).
+//   Frames the socket does not take (full TX queue) stay queued for the next
+//   flush, in order, up to kMaxPendingFrames.
+// - Setpoint schedule: the phases of divided setpoints (see
+//   command_schedule.hpp) are planned over all owners together, so that the
+//   slow setpoints of different owners do not pile up in the same cycle.
+//
+// Thread-safe, so owners may be read and written from different threads. The
+// processors run with the bus locked and may call back into the bus.
+class SharedCanBus {
+public:
+    // Beyond this, the oldest unsent frames are dropped and counted as
+    // tx_failures()
+    static constexpr size_t kMaxPendingFrames = 256;
+
+    // Returns the bus for the interface, opening the socket on first use.
+    // Returns nullptr if the socket cannot be opened.
+    static std::shared_ptr<SharedCanBus> acquire(const std::string& interface);
+
+    SharedCanBus(const SharedCanBus&) = delete;
+    SharedCanBus& operator=(const SharedCanBus&) = delete;
+    ~SharedCanBus();
+
+    // Routes frames from node_id to the processor. Fails if another owner
+    // already attached node_id.
+    bool attach(uint32_t node_id, const void* owner, FrameProcessor processor);
+
+    // Removes all routes, TX echo processors and pending commits of the owner.
+    void detach(const void* owner);
+
+    // Enables TX echoes on the socket and forwards them to the processor.
+    bool add_tx_echo_processor(const void* owner, TxEchoProcessor processor);
+
+    // Returns the number of frames drained from the socket
+    size_t poll();
+
+    void queue(const can_frame& frame);
+
+    // Queues frames that must go out back-to-back (see StagedMove). They are
+    // sent in one batch after all frames queued with queue() for the cycle,
+    // including those queued after this call.
+    void queue_burst(const can_frame* frames, size_t n_frames);
+
+    void flush();
+
+    // Marks the start of the owner's writes for a cycle. Returns the index of
+    // the cycle, which is the same for all owners writing in the same cycle.
+    uint64_t begin_cycle(const void* owner);
+
+    // Marks the end of the owner's writes for this cycle. Flushes once all
+    // owners have committed.
+    void commit(const void* owner);
+
+    // Replaces the command dividers of the owner and re-plans the phases of
+    // all owners.
+    void set_command_dividers(const void* owner, const std::vector<uint32_t>& dividers);
+
+    // Phases of the owner's commands, in the order of its dividers. They
+    // change whenever an owner sets its dividers or detaches.
+    void command_phases(const void* owner, std::vector<uint32_t>* phases) const;
+
+    // Direct access to the socket, for configuration before the bus is used
+    // and from within processors
+    SocketCanIntf* intf() { return &can_intf_; }
+
+    // Frames that were dropped because the socket did not take them
+    uint64_t tx_failures() const;
+
+private:
+    struct Route {
+        const void* owner = nullptr;
+        FrameProcessor processor;
+    };
+
+    struct Schedule {
+        const void* owner = nullptr;
+        std::vector<uint32_t> dividers;
+        std::vector<uint32_t> phases;
+    };
+
+    SharedCanBus() = default;
+    void plan_schedules();
+    void send_pending(std::vector<can_frame>* frames);
+    void on_can_msg(const can_frame& frame);
+    void on_tx_echo(const can_frame& frame, uint64_t timestamp_ns);
+
+    std::string interface_;
+    mutable std::recursive_mutex mutex_; // recursive for calls from processors
+    EpollEventLoop event_loop_; // never run, the socket is drained by poll()
+    SocketCanIntf can_intf_;
+    std::array<Route, 64> routes_; // indexed by node_id
+    std::vector<std::pair<const void*, TxEchoProcessor>> tx_echo_processors_;
+    std::vector<const void*> owners_;
+    std::vector<const void*> committed_;
+    uint64_t cycle_ = 0;
+    std::vector<Schedule> schedules_;
+    std::vector<can_frame> tx_queue_;
+    std::vector<can_frame> tx_burst_;
+    uint64_t tx_failures_ = 0;
+};
+
+#endif // SHARED_CAN_BUS_HPP
@@ -0,0 +1,249 @@
+#ifndef SHM_CHANNEL_HPP
+#define SHM_CHANNEL_HPP
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "spsc_ring.hpp"
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <string>
+
+// POSIX shared-memory channel between the node / ros2_control plugin (server)
+// and non-ROS processes (clients). Header-only so external processes only need
+// this file and spsc_ring.hpp.
+//
+// - Per-axis state slots indexed by node_id, each protected by a seqlock: the
+//   server never waits for readers and readers retry if they raced a write.
+// - One lock-free single-producer/single-consumer ring for setpoints from a
+//   client to the server, with a futex doorbell that push_command() rings so
+//   the server does not have to poll the ring.
+//
+// Usage on the client side:
+//
+//     ShmChannel shm;
+//     if (!shm.open("/odrive_can0")) ...
+//     ShmAxisState state;
+//     if (shm.read_state(node_id, &state)) ...
+//     shm.push_command({.node_id = 3, .kind = ShmCommand::kInputVel, .input_vel = 1.0f});
+
+struct ShmAxisState {
+    uint64_t timestamp_ns = 0; // CLOCK_MONOTONIC of the last update, 0 if never updated
+    float pos_estimate = 0.0f; // [rev]
+    float vel_estimate = 0.0f; // [rev/s]
+    float torque_target = 0.0f; // [Nm]
+    float torque_estimate = 0.0f; // [Nm]
+    float iq_setpoint = 0.0f; // [A]
+    float iq_measured = 0.0f; // [A]
+    float bus_voltage = 0.0f; // [V]
+    float bus_current = 0.0f; // [A]
+    float fet_temperature = 0.0f; // [deg C]
+    float motor_temperature = 0.0f; // [deg C]
+    uint32_t active_errors = 0;
+    uint32_t disarm_reason = 0;
+    uint8_t axis_state = 0;
+    uint8_t procedure_result = 0;
+    uint8_t trajectory_done_flag = 0;
+};
+
+struct ShmCommand {
+    enum Kind : uint32_t {
+        kInputPos, // Set_Input_Pos with input_vel / input_torque as feedforward
+        kInputVel, // Set_Input_Vel with input_torque as feedforward
+        kInputTorque, // Set_Input_Torque
+    };
+
+    uint32_t node_id = 0;
+    Kind kind = kInputPos;
+    float input_pos = 0.0f; // [rev]
+    float input_vel = 0.0f; // [rev/s]
+    float input_torque = 0.0f; // [Nm]
+};
+
+class ShmChannel {
+public:
+    static constexpr uint32_t kMaxAxes = 64; // node_id is 6 bits
+    static constexpr uint32_t kCommandRingSize = 256;
+
+    ShmChannel() = default;
+    ShmChannel(const ShmChannel&) = delete;
+    ShmChannel& operator=(const ShmChannel&) = delete;
+    ~ShmChannel() { close(); }
+
+    // Server side: creates the region and holds a lock on it until close(),
+    // when it is unlinked again. Fails if another server holds the lock. A
+    // region left behind by a server that died is replaced by a new one.
+    bool create(const std::string& name) {
+        for (int attempt = 0; attempt < 4; ++attempt) {
+            int fd = ::shm_open(name.c_str(), O_CREAT | O_RDWR, 0660);
+            if (fd < 0) return false;
+            struct stat st;
+            if (::flock(fd, LOCK_EX | LOCK_NB) != 0 || ::fstat(fd, &st) != 0) {
+                ::close(fd); // in use
+                return false;
+            }
+            if (st.st_nlink == 0) {
+                ::close(fd); // replaced by another server since we opened it
+                continue;
+            }
+            if (st.st_size != 0) {
+                // Stale, its clients keep their mapping of the old one
+                ::shm_unlink(name.c_str());
+                ::close(fd);
+                continue;
+            }
+            if (::ftruncate(fd, sizeof(Layout)) != 0 || !map(fd)) {
+                ::shm_unlink(name.c_str());
+                ::close(fd);
+                return false;
+            }
+
+            new (layout_) Layout();
+            layout_->version = kVersion;
+            layout_->magic.store(kMagic, std::memory_order_release);
+            name_ = name;
+            lock_fd_ = fd;
+            return true;
+        }
+        return false;
+    }
+
+    // Client side: attaches to a region created by the server.
+    bool open(const std::string& name) {
+        int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) return false;
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Layout) || !map(fd)) {
+            ::close(fd);
+            return false;
+        }
+        ::close(fd);
+
+        if (layout_->magic.load(std::memory_order_acquire) != kMagic
+            || layout_->version != kVersion) {
+            close();
+            return false;
+        }
+        name_ = name;
+        return true;
+    }
+
+    void close() {
+        if (!layout_) return;
+        ::munmap(layout_, sizeof(Layout));
+        layout_ = nullptr;
+        if (lock_fd_ >= 0) {
+            ::shm_unlink(name_.c_str()); // before the lock is released
+            ::close(lock_fd_);
+            lock_fd_ = -1;
+        }
+    }
+
+    bool is_open() const { return layout_ != nullptr; }
+
+    // Server: publishes the state of one axis. Wait-free.
+    void write_state(uint32_t node_id, const ShmAxisState& state) {
+        if (node_id >= kMaxAxes) return;
+        StateSlot& slot = layout_->axes[node_id];
+        uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+        slot.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&slot.state, &state, sizeof(state));
+        slot.seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // Client: reads a consistent snapshot of one axis. Returns false if the
+    // axis was never written.
+    bool read_state(uint32_t node_id, ShmAxisState* state) const {
+        if (node_id >= kMaxAxes) return false;
+        const StateSlot& slot = layout_->axes[node_id];
+        uint32_t seq0, seq1;
+        do {
+            seq0 = slot.seq.load(std::memory_order_acquire);
+            std::memcpy(state, &slot.state, sizeof(*state));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            seq1 = slot.seq.load(std::memory_order_relaxed);
+        } while ((seq0 & 1) || seq0 != seq1);
+        return state->timestamp_ns != 0;
+    }
+
+    // Client (single producer): queues a setpoint and rings the doorbell.
+    // Returns false if the ring is full.
+    bool push_command(const ShmCommand& command) {
+        if (!layout_->commands.push(command)) return false;
+        ring_doorbell();
+        return true;
+    }
+
+    // Server (single consumer): dequeues a setpoint. Returns false if the ring is empty.
+    bool pop_command(ShmCommand* command) { return layout_->commands.pop(command); }
+
+    // Server: the doorbell count, to be passed to wait_doorbell() before
+    // draining the ring with pop_command().
+    uint32_t doorbell() const { return layout_->doorbell.load(std::memory_order_acquire); }
+
+    // Server: blocks until the doorbell rang since doorbell() returned seen.
+    // May return early (signals, spurious wakeups).
+    void wait_doorbell(uint32_t seen) {
+        // Paired with ring_doorbell(): either the client sees the waiter or
+        // the waiter sees the new count
+        layout_->doorbell_waiting.store(1, std::memory_order_seq_cst);
+        if (layout_->doorbell.load(std::memory_order_seq_cst) == seen) {
+            ::syscall(SYS_futex, &layout_->doorbell, FUTEX_WAIT, seen, nullptr, nullptr, 0);
+        }
+        layout_->doorbell_waiting.store(0, std::memory_order_relaxed);
+    }
+
+    // Wakes the server. Only costs a syscall while the server is waiting.
+    void ring_doorbell() {
+        layout_->doorbell.fetch_add(1, std::memory_order_seq_cst);
+        if (layout_->doorbell_waiting.load(std::memory_order_seq_cst)) {
+            ::syscall(SYS_futex, &layout_->doorbell, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        }
+    }
+
+    static uint64_t now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+
+private:
+    static constexpr uint32_t kMagic = 0x4f445348; // "ODSH"
+    static constexpr uint32_t kVersion = 2;
+
+    struct alignas(64) StateSlot {
+        std::atomic<uint32_t> seq{0};
+        ShmAxisState state;
+    };
+
+    struct Layout {
+        std::atomic<uint32_t> magic{0}; // written last, marks the region as initialized
+        uint32_t version = 0;
+        SpscRing<ShmCommand, kCommandRingSize> commands;
+        std::atomic<uint32_t> doorbell{0}; // futex word, counts pushes
+        std::atomic<uint32_t> doorbell_waiting{0}; // the server is (about to be) blocked on doorbell
+        StateSlot axes[kMaxAxes];
+    };
+
+    bool map(int fd) {
+        void* addr = ::mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) return false;
+        layout_ = static_cast<Layout*>(addr);
+        return true;
+    }
+
+    Layout* layout_ = nullptr;
+    std::string name_;
+    int lock_fd_ = -1; // server only
+};
+
+#endif // SHM_CHANNEL_HPP
@@ -0,0 +1,32 @@
+#ifndef SIGNAL_STATISTICS_HPP
+#define SIGNAL_STATISTICS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+// Incremental min/max/mean over a window of samples. Constant memory and
+// constant time per sample, so it can run on the CAN thread for every frame.
+struct SignalStatistics {
+    void add(float value) {
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+        sum_ += value;
+        count_++;
+    }
+
+    void reset() { *this = SignalStatistics(); }
+
+    float min() const { return count_ ? min_ : 0.0f; }
+    float max() const { return count_ ? max_ : 0.0f; }
+    float mean() const { return count_ ? static_cast<float>(sum_ / count_) : 0.0f; }
+    uint32_t count() const { return count_; }
+
+private:
+    float min_ = std::numeric_limits<float>::infinity();
+    float max_ = -std::numeric_limits<float>::infinity();
+    double sum_ = 0.0;
+    uint32_t count_ = 0;
+};
+
+#endif // SIGNAL_STATISTICS_HPP
@@ -0,0 +1,114 @@
+#ifndef SIM_CAN_BUS_HPP
+#define SIM_CAN_BUS_HPP
+
+#include "epoll_event_loop.hpp"
+#include "sim_odrive.hpp"
+#include <linux/can.h>
+#include <array>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class SimCanClient;
+
+// Process-wide, named CAN bus that only exists in memory, with simulated
+// ODrives attached to it. Clients see each other's frames as on a real bus
+// (but not their own, unless TX echo is enabled) and the frames of the
+// drives. No kernel CAN interface is involved.
+//
+// The drives are stepped and send their cyclic messages on the bus' own
+// thread, which starts with the first drive and runs until the bus is
+// destroyed.
+class SimCanBus {
+public:
+    // Returns the bus with this name, creating it on first use
+    static std::shared_ptr<SimCanBus> acquire(const std::string& name);
+
+    SimCanBus(const SimCanBus&) = delete;
+    SimCanBus& operator=(const SimCanBus&) = delete;
+    ~SimCanBus();
+
+    // Fails if node_id is out of range or already simulated
+    bool add_drive(uint32_t node_id, const SimODriveConfig& config);
+    void remove_drive(uint32_t node_id);
+
+private:
+    friend class SimCanClient;
+
+    SimCanBus() = default;
+    void attach(SimCanClient* client);
+    void detach(SimCanClient* client);
+    void send(SimCanClient* sender, const can_frame& frame);
+    void deliver(SimCanClient* sender, const std::vector<can_frame>& frames);
+    void on_tick();
+
+    std::mutex mutex_;
+    std::array<std::unique_ptr<SimODrive>, 64> drives_; // indexed by node_id
+    std::vector<SimCanClient*> clients_;
+    std::vector<can_frame> frames_; // scratch buffer, guarded by mutex_
+
+    EpollEventLoop event_loop_;
+    EpollTimer tick_timer_;
+    EpollEvent stop_evt_;
+    std::thread thread_;
+};
+
+// Connection to a SimCanBus. Normally used through SocketCanIntf by passing an
+// interface name of the form "sim:<bus>", once register_sim_can_backend() was
+// called. Same interface as CanMuxClient.
+class SimCanClient {
+public:
+    bool connect(const std::string& bus);
+    void disconnect();
+
+    // Same semantics as CAN_RAW_FILTER, an empty list receives everything
+    bool set_filters(const std::vector<can_filter>& filters);
+
+    // Frames sent by this client are returned by receive() as well, with the
+    // time at which they were put on the bus.
+    void enable_tx_echo() { tx_echo_ = true; }
+
+    bool send(const can_frame& frame);
+
+    // echo_timestamp_ns is set to 0 for received frames and to the send time
+    // for TX echoes.
+    bool receive(can_frame* frame, uint64_t* echo_timestamp_ns);
+
+    // Becomes readable when the RX queue turns non-empty. Call clear_rx_event()
+    // before draining the queue with receive().
+    int rx_event_fd() const { return rx_evt_fd_; }
+    void clear_rx_event();
+
+    // Frames dropped because the RX queue was full
+    uint64_t rx_dropped() const;
+
+private:
+    friend class SimCanBus;
+
+    // Bounded like a socket receive buffer, so an idle client doesn't grow
+    // without limit
+    static constexpr size_t kMaxQueuedFrames = 1024;
+
+    struct Rx {
+        can_frame frame;
+        uint64_t echo_timestamp_ns;
+    };
+
+    void push(const can_frame& frame, uint64_t echo_timestamp_ns);
+
+    std::shared_ptr<SimCanBus> bus_;
+    bool tx_echo_ = false;
+    int rx_evt_fd_ = -1;
+    mutable std::mutex mutex_;
+    std::deque<Rx> rx_queue_;
+    std::vector<can_filter> filters_;
+    uint64_t rx_dropped_ = 0;
+};
+
+// Makes SocketCanIntf open "sim:" interface names (see can_backend.hpp)
+void register_sim_can_backend();
+
+#endif // SIM_CAN_BUS_HPP
@@ -0,0 +1,146 @@
+#ifndef SIM_ODRIVE_HPP
+#define SIM_ODRIVE_HPP
+
+#include "cyclic_rates.hpp"
+#include <linux/can.h>
+#include <cstdint>
+#include <vector>
+
+// Parameters of a simulated ODrive axis and the motor attached to it. Units are
+// the ODrive's (rev, rev/s, Nm). The controller defaults are the firmware's.
+struct SimODriveConfig {
+    // Motor and load
+    double inertia = 1e-3; // [Nm/(rev/s^2)]
+    double viscous_friction = 1e-3; // [Nm/(rev/s)]
+    double coulomb_friction = 0.0; // [Nm]
+    double torque_constant = 0.083; // [Nm/A]
+    double phase_resistance = 0.1; // [Ohm], only used for the electrical power
+    double bus_voltage = 24.0; // [V]
+    double position = 0.0; // [rev] at start
+
+    // Controller
+    double current_limit = 10.0; // [A]
+    double vel_limit = 2.0; // [rev/s]
+    double vel_limit_tolerance = 1.2; // disarms above vel_limit * tolerance, 0 disables the check
+    double pos_gain = 20.0; // [(rev/s) / rev]
+    double vel_gain = 0.16; // [Nm / (rev/s)]
+    double vel_integrator_gain = 0.32; // [Nm / rev]
+    double vel_ramp_rate = 1.0; // [rev/s^2]
+    double torque_ramp_rate = 0.01; // [Nm/s]
+    double input_filter_bandwidth = 2.0; // [1/s]
+    double traj_vel_limit = 2.0; // [rev/s]
+    double traj_accel_limit = 0.5; // [rev/s^2]
+    double traj_decel_limit = 0.5; // [rev/s^2]
+    double traj_inertia = 0.0; // [Nm/(rev/s^2)]
+
+    // Calibration, homing and other procedures succeed after this time
+    double procedure_s = 2.0;
+    // Closed loop control is refused until a calibration ran
+    bool calibrated = true;
+    // No telemetry and no reaction to commands for this long after a Reboot
+    double boot_s = 0.5;
+
+    // axis.config.can.<msg>_msg_rate_ms, 0 = off
+    CyclicRatePlan msg_rate_ms = {100, 10, 0, 10, 0, 0, 0, 0};
+    // RxSdo writes to these endpoints change msg_rate_ms, as on the hardware
+    std::array<int32_t, kNumCyclicMessages> endpoint_ids = {-1, -1, -1, -1, -1, -1, -1, -1};
+};
+
+// Behavioural model of one ODrive axis on CAN: the axis state machine,
+// input modes, cascaded position/velocity controller, a rigid motor with
+// friction and the cyclic messages at their configured rates. Commands take
+// effect at the next step().
+//
+// Not thread-safe, driven by SimCanBus.
+class SimODrive {
+public:
+    SimODrive(uint32_t node_id, const SimODriveConfig& config, uint64_t now_ns);
+
+    // Handles a frame addressed to this node. Replies (to RTR requests) are
+    // appended to out.
+    void on_can_frame(const can_frame& frame, uint64_t now_ns, std::vector<can_frame>* out);
+
+    // Advances the simulation to now_ns and appends the cyclic messages that
+    // became due.
+    void step(uint64_t now_ns, std::vector<can_frame>* out);
+
+    uint32_t node_id() const { return node_id_; }
+    uint32_t axis_state() const { return axis_state_; }
+    double pos() const { return pos_; }
+    double vel() const { return vel_; }
+
+private:
+    // Values that Set_* messages change at runtime and that a reboot resets to
+    // the last saved configuration
+    struct Settings {
+        uint32_t control_mode;
+        uint32_t input_mode;
+        double current_limit;
+        double vel_limit;
+        double pos_gain;
+        double vel_gain;
+        double vel_integrator_gain;
+        double traj_vel_limit;
+        double traj_accel_limit;
+        double traj_decel_limit;
+        double traj_inertia;
+        CyclicRatePlan msg_rate_ms;
+    };
+
+    // Trapezoidal profile from the current setpoint to the goal
+    struct Trajectory {
+        void plan(double goal, double pos, double vel, double v_max, double a_max, double d_max);
+        void eval(double t, double* pos, double* vel, double* accel) const;
+
+        double start_pos = 0, start_vel = 0, goal = 0;
+        double accel = 0, decel = 0, cruise_vel = 0;
+        double t_accel = 0, t_cruise = 0, t_total = 0;
+        double pos_after_accel = 0;
+    };
+
+    void request_state(uint32_t state, uint64_t now_ns);
+    void enter_closed_loop();
+    void disarm(uint32_t error);
+    void reboot(uint64_t now_ns);
+    void update_input(double dt);
+    void simulate(double dt);
+    bool encode_message(uint8_t cmd_id, can_frame* frame) const;
+
+    uint32_t node_id_;
+    SimODriveConfig config_;
+    Settings saved_;
+    Settings settings_;
+
+    uint64_t sim_time_ns_; // time the simulation has advanced to
+    uint64_t booting_until_ns_ = 0;
+    std::array<uint64_t, kNumCyclicMessages> next_msg_ns_ = {};
+
+    uint32_t axis_state_ = 1; // AXIS_STATE_IDLE
+    uint8_t procedure_result_ = 0;
+    uint64_t procedure_end_ns_ = 0;
+    bool calibrated_;
+    uint32_t active_errors_ = 0;
+    uint32_t disarm_reason_ = 0;
+
+    // Inputs as received
+    double input_pos_ = 0.0;
+    double input_vel_ = 0.0;
+    double input_torque_ = 0.0;
+
+    // Setpoints after the input mode
+    double pos_setpoint_ = 0.0;
+    double vel_setpoint_ = 0.0;
+    double torque_setpoint_ = 0.0;
+    Trajectory trajectory_;
+    double trajectory_time_ = 0.0;
+    bool trajectory_done_ = true;
+
+    double vel_integrator_torque_ = 0.0;
+    double torque_target_ = 0.0; // [Nm] controller output after limits
+
+    // Plant
+    double pos_;
+    double vel_ = 0.0;
+};
+
+#endif // SIM_ODRIVE_HPP
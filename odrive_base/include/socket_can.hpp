@@ -1,33 +1,53 @@
 #ifndef SOCKET_CAN_HPP
 #define SOCKET_CAN_HPP
 
+#include "can_backend.hpp"
 #include "epoll_event_loop.hpp"
 #include <linux/can.h>
 #include <linux/can/raw.h>
 #include <string>
 #include <functional>
+#include <memory>
+#include <vector>
 
-using FrameProcessor = std::function<void(const can_frame&)>;
-
+// Raw socket on a kernel CAN interface. Interface names that start with a
+// prefix registered with register_can_backend() open that backend instead,
+// e.g. "mux:<interface>[:<priority>]" for the odrive_can_mux daemon,
+// "sim:<bus>" for an in-process SimCanBus and "fault:<options>:<interface>"
+// for fault injection.
 class SocketCanIntf {
 public:
     bool init(const std::string& interface, EpollEventLoop* event_loop, FrameProcessor frame_processor);
     void deinit();
+    // Returns false with errno set. ENOBUFS and EAGAIN mean that the TX queue
+    // is full and the frame can be sent again later.
     bool send_can_frame(const can_frame& frame);
+    // Returns the number of frames sent. If that is less than n_frames, errno
+    // is set as for send_can_frame().
+    size_t send_can_frames(const can_frame* frames, size_t n_frames);
+    bool enable_tx_echo(TxEchoProcessor tx_echo_processor);
+    bool enable_rx_timestamps();
+    bool set_filters(const std::vector<can_filter>& filters);
 
     bool read_nonblocking();
+
+    // Kernel receive time (CLOCK_REALTIME) of the frame being processed, 0 if
+    // rx timestamps are not enabled or not available on this interface
+    uint64_t rx_timestamp_ns() const { return backend_ ? backend_->rx_timestamp_ns() : rx_timestamp_ns_; }
+
 private:
     std::string interface_;
     int socket_id_ = -1;
     EpollEventLoop* event_loop_ = nullptr;
-    EpollEventLoop::EvtId socket_evt_id_;
+    EpollEventLoop::EvtId socket_evt_id_ = nullptr;
     FrameProcessor frame_processor_;
-    bool broken_ = false;
+    TxEchoProcessor tx_echo_processor_;
+    bool broken_ = true; // not registered with the event loop
+    bool rx_timestamps_ = false;
+    uint64_t rx_timestamp_ns_ = 0;
+    std::unique_ptr<CanBackend> backend_;
 
     void on_socket_event(uint32_t mask);
-    void process_can_frame(const can_frame& frame) {
-        frame_processor_(frame);
-    }
 };
 
 #endif  // SOCKET_CAN_HPP
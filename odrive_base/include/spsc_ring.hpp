@@ -0,0 +1,40 @@
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer ring buffer. It only contains
+// trivially copyable state, so it can be placed in memory shared between
+// processes.
+template <typename T, uint32_t N>
+struct SpscRing {
+    static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring indices must be lock-free");
+
+    // Producer side. Returns false if the ring is full.
+    bool push(const T& item) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) return false;
+        entries[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the ring is empty.
+    bool pop(T* item) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        *item = entries[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+
+    alignas(64) std::atomic<uint32_t> head{0};
+    alignas(64) std::atomic<uint32_t> tail{0};
+    alignas(64) T entries[N];
+};
+
+#endif // SPSC_RING_HPP
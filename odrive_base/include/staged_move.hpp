@@ -0,0 +1,52 @@
+#ifndef STAGED_MOVE_HPP
+#define STAGED_MOVE_HPP
+
+#include "shared_can_bus.hpp"
+#include <linux/can.h>
+#include <cstdint>
+#include <vector>
+
+// Starts a move on several axes at once. Setpoint frames are encoded and held
+// on the host while targets are staged, then released as one back-to-back
+// burst through SharedCanBus::queue_burst(). The achieved start skew is
+// measured from the kernel timestamps of the TX echoes (see
+// SocketCanIntf::enable_tx_echo()).
+class StagedMove {
+public:
+    // Discards staged frames and the previous measurement.
+    void clear();
+
+    template <typename TMsg>
+    void stage(uint32_t node_id, const TMsg& msg) {
+        struct can_frame frame = {};
+        frame.can_id = node_id << 5 | msg.cmd_id;
+        frame.can_dlc = msg.msg_length;
+        msg.encode_buf(frame.data);
+        frames_.push_back(frame);
+    }
+
+    size_t size() const { return frames_.size(); }
+
+    // Queues all staged frames on the bus as one burst. They go out with the
+    // bus' next flush, after the frames queued for the same cycle.
+    void release(SharedCanBus* bus);
+
+    // Feed with TX echoes. Returns true when the echo completed the
+    // measurement of the released burst.
+    bool on_tx_echo(const can_frame& frame, uint64_t timestamp_ns);
+
+    bool complete() const { return n_released_ && n_echoed_ == n_released_; }
+
+    // Time between the first and the last frame of the burst on the bus [ns]
+    uint64_t skew_ns() const { return last_echo_ns_ - first_echo_ns_; }
+
+private:
+    std::vector<can_frame> frames_;
+    std::vector<bool> echoed_;
+    size_t n_released_ = 0;
+    size_t n_echoed_ = 0;
+    uint64_t first_echo_ns_ = 0;
+    uint64_t last_echo_ns_ = 0;
+};
+
+#endif // STAGED_MOVE_HPP
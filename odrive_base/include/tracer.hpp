@@ -0,0 +1,83 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+// In-process tracer. Each thread records into its own ring buffer, so
+// recording takes no lock and never blocks; the oldest events are overwritten
+// when a buffer is full. The buffers of all threads are exported on demand as
+// Chrome trace JSON, which loads in Perfetto (ui.perfetto.dev) and
+// chrome://tracing.
+//
+// Event names must be string literals (or otherwise outlive the export).
+// While disabled, a trace point costs one relaxed load. Defining
+// ODRIVE_DISABLE_TRACING compiles the trace points out entirely.
+class Tracer {
+public:
+    static constexpr size_t kDefaultEventsPerThread = 1 << 16;
+
+    // Buffers of threads that already recorded keep their capacity
+    static void enable(size_t events_per_thread = kDefaultEventsPerThread);
+    static void disable();
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // Shown as the track name of the calling thread
+    static void set_thread_name(const char* name);
+
+    static void record(const char* name, uint64_t start_ns, uint64_t duration_ns, uint64_t arg);
+    static void record_instant(const char* name, uint64_t arg) { record(name, now_ns(), kInstant, arg); }
+
+    // Writes all events recorded so far. Safe while other threads record.
+    static bool write_chrome_json(const std::string& path);
+
+    static uint64_t now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+
+    static constexpr uint64_t kInstant = UINT64_MAX;
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// Records the lifetime of the scope as one complete event
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, uint64_t arg = 0)
+        : name_(name), arg_(arg), start_ns_(Tracer::enabled() ? Tracer::now_ns() : 0) {}
+
+    ~TraceScope() {
+        if (start_ns_) Tracer::record(name_, start_ns_, Tracer::now_ns() - start_ns_, arg_);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    uint64_t arg_;
+    uint64_t start_ns_;
+};
+
+#define ODRIVE_TRACE_CONCAT_(a, b) a##b
+#define ODRIVE_TRACE_CONCAT(a, b) ODRIVE_TRACE_CONCAT_(a, b)
+
+#ifndef ODRIVE_DISABLE_TRACING
+#define ODRIVE_TRACE_SCOPE(name) TraceScope ODRIVE_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define ODRIVE_TRACE_SCOPE_ARG(name, arg) TraceScope ODRIVE_TRACE_CONCAT(trace_scope_, __LINE__)(name, arg)
+#define ODRIVE_TRACE_INSTANT(name, arg) \
+    do { \
+        if (Tracer::enabled()) Tracer::record_instant(name, arg); \
+    } while (0)
+#else
+#define ODRIVE_TRACE_SCOPE(name) ((void)0)
+#define ODRIVE_TRACE_SCOPE_ARG(name, arg) ((void)0)
+#define ODRIVE_TRACE_INSTANT(name, arg) ((void)0)
+#endif
+
+#endif // TRACER_HPP
@@ -0,0 +1,109 @@
+#include "batch_decoder.hpp"
+#include "can_helpers.hpp"
+#include "can_simple_messages.hpp"
+
+template <typename TMsg, auto... Fields>
+static void decode_fields(const uint8_t* buf, double* signals) {
+    TMsg msg;
+    msg.decode_buf(buf);
+    size_t i = 0;
+    ((signals[i++] = static_cast<double>(msg.*Fields)), ...);
+}
+
+#define DECODED_MESSAGE(msg) msg##_msg_t::cmd_id, msg##_msg_t::msg_length, #msg
+
+const std::vector<DecodedMessage>& decoded_messages() {
+    static const std::vector<DecodedMessage> messages = {
+        {DECODED_MESSAGE(Heartbeat),
+         {"Axis_Error", "Axis_State", "Procedure_Result", "Trajectory_Done_Flag"},
+         &decode_fields<
+             Heartbeat_msg_t,
+             &Heartbeat_msg_t::Axis_Error,
+             &Heartbeat_msg_t::Axis_State,
+             &Heartbeat_msg_t::Procedure_Result,
+             &Heartbeat_msg_t::Trajectory_Done_Flag>},
+        {DECODED_MESSAGE(Get_Error),
+         {"Active_Errors", "Disarm_Reason"},
+         &decode_fields<Get_Error_msg_t, &Get_Error_msg_t::Active_Errors, &Get_Error_msg_t::Disarm_Reason>},
+        {DECODED_MESSAGE(Get_Encoder_Estimates),
+         {"Pos_Estimate", "Vel_Estimate"},
+         &decode_fields<
+             Get_Encoder_Estimates_msg_t,
+             &Get_Encoder_Estimates_msg_t::Pos_Estimate,
+             &Get_Encoder_Estimates_msg_t::Vel_Estimate>},
+        {DECODED_MESSAGE(Set_Input_Pos),
+         {"Input_Pos", "Vel_FF", "Torque_FF"},
+         &decode_fields<
+             Set_Input_Pos_msg_t,
+             &Set_Input_Pos_msg_t::Input_Pos,
+             &Set_Input_Pos_msg_t::Vel_FF,
+             &Set_Input_Pos_msg_t::Torque_FF>},
+        {DECODED_MESSAGE(Set_Input_Vel),
+         {"Input_Vel", "Input_Torque_FF"},
+         &decode_fields<Set_Input_Vel_msg_t, &Set_Input_Vel_msg_t::Input_Vel, &Set_Input_Vel_msg_t::Input_Torque_FF>},
+        {DECODED_MESSAGE(Set_Input_Torque),
+         {"Input_Torque"},
+         &decode_fields<Set_Input_Torque_msg_t, &Set_Input_Torque_msg_t::Input_Torque>},
+        {DECODED_MESSAGE(Get_Iq),
+         {"Iq_Setpoint", "Iq_Measured"},
+         &decode_fields<Get_Iq_msg_t, &Get_Iq_msg_t::Iq_Setpoint, &Get_Iq_msg_t::Iq_Measured>},
+        {DECODED_MESSAGE(Get_Temperature),
+         {"FET_Temperature", "Motor_Temperature"},
+         &decode_fields<
+             Get_Temperature_msg_t,
+             &Get_Temperature_msg_t::FET_Temperature,
+             &Get_Temperature_msg_t::Motor_Temperature>},
+        {DECODED_MESSAGE(Get_Bus_Voltage_Current),
+         {"Bus_Voltage", "Bus_Current"},
+         &decode_fields<
+             Get_Bus_Voltage_Current_msg_t,
+             &Get_Bus_Voltage_Current_msg_t::Bus_Voltage,
+             &Get_Bus_Voltage_Current_msg_t::Bus_Current>},
+        {DECODED_MESSAGE(Get_Torques),
+         {"Torque_Target", "Torque_Estimate"},
+         &decode_fields<Get_Torques_msg_t, &Get_Torques_msg_t::Torque_Target, &Get_Torques_msg_t::Torque_Estimate>},
+        {DECODED_MESSAGE(Get_Powers),
+         {"Electrical_Power", "Mechanical_Power"},
+         &decode_fields<Get_Powers_msg_t, &Get_Powers_msg_t::Electrical_Power, &Get_Powers_msg_t::Mechanical_Power>},
+    };
+    return messages;
+}
+
+BatchDecoder::BatchDecoder() {
+    for (const DecodedMessage& message : decoded_messages()) {
+        messages_[message.cmd_id] = &message;
+    }
+    for (auto& node : series_index_) {
+        node.fill(-1);
+    }
+}
+
+void BatchDecoder::decode(const double* timestamps, const can_frame* frames, size_t n_frames) {
+    double signals[8];
+    for (size_t i = 0; i < n_frames; ++i) {
+        const can_frame& frame = frames[i];
+        if (frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG)) continue;
+
+        uint32_t node_id = (frame.can_id >> 5) & 0x3f;
+        uint32_t cmd_id = frame.can_id & 0x1f;
+        const DecodedMessage* message = messages_[cmd_id];
+        if (!message) continue;
+        if (frame.can_dlc < message->length) {
+            bad_length_frames_++;
+            continue;
+        }
+
+        int& index = series_index_[node_id][cmd_id];
+        if (index < 0) {
+            index = static_cast<int>(series_.size());
+            series_.push_back({node_id, message, {}, std::vector<std::vector<double>>(message->signal_names.size())});
+        }
+        Series& series = series_[index];
+
+        message->decode(frame.data, signals);
+        series.timestamps.push_back(timestamps[i]);
+        for (size_t s = 0; s < series.signals.size(); ++s) {
+            series.signals[s].push_back(signals[s]);
+        }
+    }
+}
@@ -0,0 +1,341 @@
+#include "bringup.hpp"
+#include "can_helpers.hpp"
+#include "can_simple_messages.hpp"
+#include "odrive_enums.h"
+#include <algorithm>
+#include <array>
+#include <ctime>
+#include <limits>
+#include <map>
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+namespace {
+
+// Steps that run as a procedure on the ODrive, indexed like BringupStep
+constexpr size_t kNumProcedures = 2;
+constexpr uint32_t kProcedureStates[kNumProcedures] = {
+    AXIS_STATE_FULL_CALIBRATION_SEQUENCE,
+    AXIS_STATE_HOMING,
+};
+
+// Axes that start their procedures together: a group, or a single ungrouped axis
+struct Unit {
+    std::array<size_t, kNumProcedures> members = {}; // axes that run the procedure
+    std::array<size_t, kNumProcedures> arrived = {};
+    std::array<bool, kNumProcedures> released = {};
+    bool failed = false;
+};
+
+struct AxisRun {
+    size_t unit = 0;
+    std::vector<size_t> after; // indices into Bringup::axes
+    bool done = false;
+    bool failed = false;
+};
+
+// State shared by the coroutines of one run_bringup() call. Lives in its frame.
+struct Bringup {
+    CoCanBus* bus;
+    BringupConfig config;
+    BringupProgress progress;
+    std::vector<BringupAxis> axes;
+    std::vector<AxisRun> runs;
+    std::vector<Unit> units;
+    BringupReport report;
+
+    // Notified on every change of the state above; waiters re-check their condition
+    CoSignal signal;
+    size_t running = 0; // axis coroutines that have not finished
+
+    // Procedure slots for max_parallel, handed out to units in FIFO order
+    int64_t free_slots = 0;
+    uint64_t next_ticket = 0;
+    uint64_t serving_ticket = 0;
+};
+
+bool wants(const BringupAxis& axis, size_t procedure) {
+    return procedure == static_cast<size_t>(BringupStep::kCalibration) ? axis.calibrate : axis.home;
+}
+
+} // namespace
+
+const char* bringup_step_name(BringupStep step) {
+    switch (step) {
+        case BringupStep::kCalibration: return "calibration";
+        case BringupStep::kHoming: return "homing";
+        case BringupStep::kSetAbsolutePosition: return "set_absolute_position";
+    }
+    return "unknown";
+}
+
+const char* bringup_outcome_name(BringupOutcome outcome) {
+    switch (outcome) {
+        case BringupOutcome::kRunning: return "running";
+        case BringupOutcome::kSuccess: return "success";
+        case BringupOutcome::kFailed: return "failed";
+        case BringupOutcome::kTimedOut: return "timed out";
+        case BringupOutcome::kSkipped: return "skipped";
+    }
+    return "unknown";
+}
+
+// Resolves groups and dependencies. Returns an error message if the axes
+// cannot be brought up without deadlocking.
+static std::string prepare(Bringup& b) {
+    std::map<uint32_t, size_t> index; // node_id -> axis
+    for (size_t i = 0; i < b.axes.size(); ++i) {
+        uint32_t node_id = b.axes[i].node_id;
+        if (node_id > 0x3f) {
+            return "invalid node_id " + std::to_string(node_id);
+        }
+        if (!index.emplace(node_id, i).second) {
+            return "node_id " + std::to_string(node_id) + " listed twice";
+        }
+    }
+
+    std::map<std::string, size_t> groups;
+    b.runs.resize(b.axes.size());
+    for (size_t i = 0; i < b.axes.size(); ++i) {
+        const BringupAxis& axis = b.axes[i];
+        AxisRun& run = b.runs[i];
+        auto group = axis.group.empty() ? groups.end() : groups.find(axis.group);
+        if (group != groups.end()) {
+            run.unit = group->second;
+        } else {
+            run.unit = b.units.size();
+            b.units.emplace_back();
+            if (!axis.group.empty()) groups.emplace(axis.group, run.unit);
+        }
+        for (size_t p = 0; p < kNumProcedures; ++p) {
+            b.units[run.unit].members[p] += wants(axis, p);
+        }
+    }
+
+    // Dependencies between units must form a DAG, otherwise some unit waits
+    // for itself
+    std::vector<std::vector<size_t>> dependents(b.units.size());
+    std::vector<size_t> n_dependencies(b.units.size(), 0);
+    for (size_t i = 0; i < b.axes.size(); ++i) {
+        AxisRun& run = b.runs[i];
+        for (uint32_t node_id : b.axes[i].after) {
+            auto it = index.find(node_id);
+            if (it == index.end()) {
+                return "node_id " + std::to_string(b.axes[i].node_id) + " depends on unknown node_id "
+                     + std::to_string(node_id);
+            }
+            size_t unit = b.runs[it->second].unit;
+            if (unit == run.unit) {
+                return "node_id " + std::to_string(b.axes[i].node_id) + " depends on node_id "
+                     + std::to_string(node_id) + " of its own group";
+            }
+            run.after.push_back(it->second);
+            dependents[unit].push_back(run.unit);
+            n_dependencies[run.unit]++;
+        }
+    }
+    std::vector<size_t> ready;
+    for (size_t u = 0; u < b.units.size(); ++u) {
+        if (!n_dependencies[u]) ready.push_back(u);
+    }
+    size_t n_sorted = 0;
+    while (!ready.empty()) {
+        size_t u = ready.back();
+        ready.pop_back();
+        n_sorted++;
+        for (size_t dependent : dependents[u]) {
+            if (!--n_dependencies[dependent]) ready.push_back(dependent);
+        }
+    }
+    if (n_sorted != b.units.size()) {
+        return "dependency cycle";
+    }
+
+    b.free_slots = b.config.max_parallel ? static_cast<int64_t>(b.config.max_parallel)
+                                         : std::numeric_limits<int64_t>::max() / 2;
+    return "";
+}
+
+static BringupEvent begin_step(Bringup& b, uint32_t node_id, BringupStep step) {
+    BringupEvent event;
+    event.node_id = node_id;
+    event.step = step;
+    event.start_ns = monotonic_ns();
+    if (b.progress) b.progress(event);
+    return event;
+}
+
+static void end_step(Bringup& b, BringupEvent& event) {
+    event.end_ns = monotonic_ns();
+    b.report.timeline.push_back(event);
+    if (b.progress) b.progress(event);
+}
+
+// Waits until all members of the unit that run the procedure have arrived
+// and slots are free for them. Returns false if the unit failed meanwhile.
+static CoTask<bool> start_procedure(Bringup& b, Unit& unit, size_t procedure) {
+    if (++unit.arrived[procedure] < unit.members[procedure]) {
+        while (!unit.released[procedure] && !unit.failed) co_await b.signal.wait();
+        co_return unit.released[procedure];
+    }
+
+    // Last to arrive: queue for the slots of the whole unit
+    int64_t members = static_cast<int64_t>(unit.members[procedure]);
+    int64_t needed = b.config.max_parallel ? std::min<int64_t>(members, b.config.max_parallel) : members;
+    uint64_t ticket = b.next_ticket++;
+    while (b.serving_ticket != ticket || (!unit.failed && b.free_slots < needed)) co_await b.signal.wait();
+    b.serving_ticket++;
+    if (!unit.failed) {
+        b.free_slots -= members;
+        unit.released[procedure] = true;
+    }
+    b.signal.notify_all();
+    co_return unit.released[procedure];
+}
+
+// Requests the procedure and follows the heartbeats until it ended
+static CoTask<void> run_procedure(Bringup& b, BringupEvent& event, uint32_t axis_state, std::chrono::nanoseconds timeout) {
+    CoCanBus& bus = *b.bus;
+    bus.send(event.node_id, Clear_Errors_msg_t());
+    Set_Axis_State_msg_t request;
+    request.Axis_Requested_State = axis_state;
+    bus.send(event.node_id, request);
+    co_await bus.drained();
+
+    uint64_t deadline_ns = event.start_ns + timeout.count();
+    int heartbeats_to_skip = 1; // may have been sent before the request was processed
+    for (;;) {
+        uint64_t now_ns = monotonic_ns();
+        if (now_ns >= deadline_ns) {
+            event.outcome = BringupOutcome::kTimedOut;
+            co_return;
+        }
+        auto wait = std::min<std::chrono::nanoseconds>(
+            b.config.heartbeat_timeout,
+            std::chrono::nanoseconds(deadline_ns - now_ns)
+        );
+        auto frame = co_await bus.next_frame(match_frame(event.node_id, Heartbeat_msg_t::cmd_id), wait);
+        if (!frame) {
+            event.outcome = BringupOutcome::kTimedOut; // heartbeats stopped, or the deadline passed
+            co_return;
+        }
+
+        Heartbeat_msg_t heartbeat;
+        heartbeat.decode_buf(frame->data);
+        event.axis_state = heartbeat.Axis_State;
+        event.procedure_result = heartbeat.Procedure_Result;
+        event.axis_error = heartbeat.Axis_Error;
+        if (heartbeats_to_skip-- > 0 || heartbeat.Procedure_Result == PROCEDURE_RESULT_BUSY
+            || heartbeat.Axis_State == axis_state) {
+            continue; // still running
+        }
+        event.outcome = heartbeat.Procedure_Result == PROCEDURE_RESULT_SUCCESS ? BringupOutcome::kSuccess
+                                                                                : BringupOutcome::kFailed;
+        co_return;
+    }
+}
+
+static CoTask<void> run_axis(Bringup& b, size_t i) {
+    const BringupAxis& axis = b.axes[i];
+    AxisRun& run = b.runs[i];
+    Unit& unit = b.units[run.unit];
+
+    auto dependencies_done = [&]() {
+        return std::all_of(run.after.begin(), run.after.end(), [&](size_t dep) { return b.runs[dep].done; });
+    };
+    while (!dependencies_done()) co_await b.signal.wait();
+    bool ok = std::none_of(run.after.begin(), run.after.end(), [&](size_t dep) { return b.runs[dep].failed; });
+
+    auto skip = [&](BringupStep step) {
+        BringupEvent event;
+        event.node_id = axis.node_id;
+        event.step = step;
+        event.outcome = BringupOutcome::kSkipped;
+        event.start_ns = monotonic_ns();
+        end_step(b, event);
+    };
+    auto fail = [&]() {
+        ok = false;
+        unit.failed = true;
+        b.signal.notify_all();
+    };
+    if (!ok) fail();
+
+    for (size_t p = 0; p < kNumProcedures; ++p) {
+        BringupStep step = static_cast<BringupStep>(p);
+        if (!wants(axis, p)) continue;
+        if (!ok || unit.failed) {
+            skip(step);
+            ok = false;
+            continue;
+        }
+        if (!co_await start_procedure(b, unit, p)) {
+            skip(step);
+            ok = false;
+            continue;
+        }
+
+        BringupEvent event = begin_step(b, axis.node_id, step);
+        auto timeout = step == BringupStep::kCalibration ? b.config.calibration_timeout : b.config.homing_timeout;
+        co_await run_procedure(b, event, kProcedureStates[p], timeout);
+        b.free_slots++;
+        end_step(b, event);
+        if (event.outcome != BringupOutcome::kSuccess) {
+            fail();
+        } else {
+            b.signal.notify_all(); // slot released
+        }
+    }
+
+    if (!std::isnan(axis.absolute_position)) {
+        if (!ok || unit.failed) {
+            skip(BringupStep::kSetAbsolutePosition);
+            ok = false;
+        } else {
+            BringupEvent event = begin_step(b, axis.node_id, BringupStep::kSetAbsolutePosition);
+            Set_Absolute_Position_msg_t msg;
+            msg.Position = axis.absolute_position;
+            b.bus->send(axis.node_id, msg);
+            co_await b.bus->drained();
+            event.outcome = BringupOutcome::kSuccess;
+            end_step(b, event);
+        }
+    }
+
+    run.done = true;
+    run.failed = !ok;
+    if (!ok) b.report.failed.push_back(axis.node_id);
+    b.running--;
+    b.signal.notify_all(); // may end run_bringup() and free b
+}
+
+CoTask<BringupReport> run_bringup(
+    CoCanBus& bus,
+    std::vector<BringupAxis> axes,
+    BringupConfig config,
+    BringupProgress progress
+) {
+    Bringup b;
+    b.bus = &bus;
+    b.config = config;
+    b.progress = std::move(progress);
+    b.axes = std::move(axes);
+    b.report.start_ns = monotonic_ns();
+    b.report.error = prepare(b);
+
+    if (b.report.error.empty()) {
+        b.running = b.axes.size();
+        for (size_t i = 0; i < b.axes.size(); ++i) {
+            co_spawn(run_axis(b, i));
+        }
+        while (b.running) co_await b.signal.wait();
+        b.report.success = b.report.failed.empty();
+    }
+
+    b.report.end_ns = monotonic_ns();
+    co_return std::move(b.report);
+}
@@ -0,0 +1,30 @@
+#include "can_backend.hpp"
+#include <map>
+#include <mutex>
+
+static std::mutex registry_mutex;
+
+static std::map<std::string, CanBackendFactory>& registry() {
+    static std::map<std::string, CanBackendFactory> backends;
+    return backends;
+}
+
+void register_can_backend(const std::string& prefix, CanBackendFactory factory) {
+    std::lock_guard<std::mutex> guard(registry_mutex);
+    registry()[prefix] = factory;
+}
+
+std::unique_ptr<CanBackend> make_can_backend(const std::string& interface, std::string* name) {
+    CanBackendFactory factory = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(registry_mutex);
+        for (const auto& [prefix, f] : registry()) {
+            if (interface.rfind(prefix, 0) == 0) {
+                *name = interface.substr(prefix.size());
+                factory = f;
+                break;
+            }
+        }
+    }
+    return factory ? factory() : nullptr;
+}
@@ -0,0 +1,390 @@
+#include "can_flash.hpp"
+#include "can_helpers.hpp"
+#include "can_simple_messages.hpp"
+#include <algorithm>
+#include <cstring>
+
+using namespace can_flash;
+
+static constexpr size_t kMaxRetries = 8;
+
+static uint32_t get_u32(const uint8_t* buf, size_t start_byte) {
+    return can_get_signal_raw<uint32_t>(buf, start_byte * 8, 32, true);
+}
+
+static void set_u32(uint8_t* buf, size_t start_byte, uint32_t value) {
+    can_set_signal_raw<uint32_t>(buf, value, start_byte * 8, 32, true);
+}
+
+bool can_flash::parse_id(canid_t id, uint32_t* node_id, uint8_t* opcode) {
+    if (!(id & CAN_EFF_FLAG) || (id & CAN_EFF_MASK & 0x1fff0000) != kIdBase) return false;
+    *node_id = (id >> 8) & 0xff;
+    *opcode = id & 0xff;
+    return true;
+}
+
+uint32_t can_flash::crc32(const uint8_t* data, size_t length, uint32_t crc) {
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static size_t block_length(size_t image_size, size_t offset) {
+    return std::min(kBlockSize, image_size - offset);
+}
+
+CanFlashSession::CanFlashSession(
+    std::vector<uint8_t> image,
+    const std::vector<uint32_t>& node_ids,
+    size_t window,
+    bool broadcast
+)
+    : image_(std::move(image)),
+      image_crc_(crc32(image_.data(), image_.size())),
+      window_(std::max<size_t>(window, 1)),
+      broadcast_(broadcast && node_ids.size() > 1) {
+    broadcast_stream_.node_id = kBroadcastNodeId;
+    broadcast_stream_.stage = Stage::kDone;
+    for (uint32_t node_id : node_ids) {
+        Target target;
+        target.node_id = node_id;
+        target.request_pending = true;
+        targets_.push_back(target);
+    }
+}
+
+void CanFlashSession::set_timeouts(std::chrono::milliseconds ack_timeout, std::chrono::milliseconds erase_timeout) {
+    ack_timeout_ = ack_timeout;
+    erase_timeout_ = erase_timeout;
+}
+
+CanFlashSession::Target* CanFlashSession::find(uint32_t node_id) {
+    for (auto& target : targets_) {
+        if (target.node_id == node_id) return &target;
+    }
+    return nullptr;
+}
+
+void CanFlashSession::on_can_frame(const can_frame& frame, Clock::time_point now) {
+    uint32_t node_id;
+    uint8_t opcode;
+    if (!parse_id(frame.can_id, &node_id, &opcode)) return;
+    Target* target = find(node_id);
+    if (!target || frame.can_dlc < 1) return;
+
+    switch (opcode) {
+        case kReady: {
+            if (target->stage == Stage::kEnteringDfu && frame.data[0] == kStatusBootloader) {
+                target->stage = Stage::kErasing;
+                target->request_pending = true;
+                target->retries = 0;
+            } else if (target->stage == Stage::kErasing && frame.data[0] == kStatusErased) {
+                target->stage = Stage::kTransferring;
+                target->acked = target->next_offset = target->next_frame = 0;
+                if (broadcast_) rewind(broadcast_stream_, now); // drive missed what was sent so far
+                target->retries = 0;
+                target->deadline = now + ack_timeout_;
+            }
+        } break;
+        case kAck: {
+            if (target->stage != Stage::kTransferring || frame.can_dlc < 5) break;
+            size_t offset = get_u32(frame.data, 0);
+            if (offset != target->acked) break; // duplicate or stale
+            if (frame.data[4] == kStatusOk) {
+                target->acked += block_length(image_.size(), offset);
+                target->retries = 0;
+                target->deadline = now + ack_timeout_;
+                if (!broadcast_ && target->next_offset < target->acked) {
+                    target->next_offset = target->acked;
+                    target->next_frame = 0;
+                }
+                if (target->acked >= image_.size()) {
+                    target->stage = Stage::kVerifying;
+                    target->request_pending = true;
+                }
+            } else {
+                go_back(*target, now);
+            }
+        } break;
+        case kDone: {
+            if (target->stage != Stage::kVerifying || frame.can_dlc < 5) break;
+            if (frame.data[0] == kStatusOk && get_u32(frame.data, 1) == image_crc_) {
+                target->stage = Stage::kDone;
+            } else {
+                fail(*target, "verification failed");
+            }
+        } break;
+    }
+}
+
+void CanFlashSession::update_broadcast_stream() {
+    if (!broadcast_) return;
+
+    // The stream starts once no drive is still on its way into the transfer
+    // and always resumes at the block the slowest drive expects next.
+    bool any_transferring = false;
+    size_t acked = image_.size();
+    for (const auto& target : targets_) {
+        if (target.stage == Stage::kEnteringDfu || target.stage == Stage::kErasing) {
+            broadcast_stream_.stage = Stage::kDone;
+            return;
+        }
+        if (target.stage == Stage::kTransferring) {
+            any_transferring = true;
+            acked = std::min(acked, target.acked);
+        }
+    }
+    broadcast_stream_.stage = any_transferring ? Stage::kTransferring : Stage::kDone;
+    broadcast_stream_.acked = acked;
+    if (broadcast_stream_.next_offset < acked) {
+        broadcast_stream_.next_offset = acked;
+        broadcast_stream_.next_frame = 0;
+    }
+}
+
+void CanFlashSession::rewind(Target& stream, Clock::time_point now) {
+    stream.next_offset = stream.acked;
+    stream.next_frame = 0;
+    stream.deadline = now + ack_timeout_;
+}
+
+void CanFlashSession::go_back(Target& target, Clock::time_point now) {
+    Target& stream = broadcast_ ? broadcast_stream_ : target;
+    update_broadcast_stream();
+    if (stream.next_offset > stream.acked || stream.next_frame) {
+        target.go_backs++;
+    }
+    rewind(stream, now);
+}
+
+void CanFlashSession::fail(Target& target, const std::string& error) {
+    target.stage = Stage::kFailed;
+    target.error = error;
+}
+
+void CanFlashSession::encode_data_frame(const Target& target, can_frame* frame) const {
+    size_t index = target.next_frame - 1;
+    size_t begin = target.next_offset + index * kDataPerFrame;
+    size_t end = std::min(begin + kDataPerFrame, target.next_offset + block_length(image_.size(), target.next_offset));
+    frame->can_id = make_id(target.node_id, kData);
+    frame->can_dlc = 1 + end - begin;
+    frame->data[0] = index;
+    std::memcpy(frame->data + 1, image_.data() + begin, end - begin);
+}
+
+bool CanFlashSession::next_frame(Target& target, Clock::time_point now, can_frame* frame) {
+    *frame = {};
+    switch (target.stage) {
+        case Stage::kEnteringDfu: {
+            if (!target.request_pending) return false;
+            frame->can_id = target.node_id << 5 | Enter_DFU_Mode_msg_t::cmd_id;
+            frame->can_dlc = Enter_DFU_Mode_msg_t::msg_length;
+            target.deadline = now + erase_timeout_;
+        } break;
+        case Stage::kErasing: {
+            if (!target.request_pending) return false;
+            frame->can_id = make_id(target.node_id, kBegin);
+            frame->can_dlc = 8;
+            set_u32(frame->data, 0, image_.size());
+            set_u32(frame->data, 4, image_crc_);
+            target.deadline = now + erase_timeout_;
+        } break;
+        case Stage::kTransferring: {
+            if (broadcast_ && target.node_id != kBroadcastNodeId) return false;
+            if (target.next_offset >= image_.size()) return false;
+            size_t length = block_length(image_.size(), target.next_offset);
+            if (target.next_frame == 0) {
+                if (target.next_offset - target.acked >= window_ * kBlockSize) return false;
+                frame->can_id = make_id(target.node_id, kBlock);
+                frame->can_dlc = 8;
+                set_u32(frame->data, 0, target.next_offset);
+                set_u32(frame->data, 4, crc32(image_.data() + target.next_offset, length));
+                target.next_frame = 1;
+            } else {
+                encode_data_frame(target, frame);
+                if (target.next_frame++ * kDataPerFrame >= length) {
+                    target.next_offset += length;
+                    target.next_frame = 0;
+                }
+            }
+            target.deadline = now + ack_timeout_;
+            return true;
+        }
+        case Stage::kVerifying: {
+            if (!target.request_pending) return false;
+            frame->can_id = make_id(target.node_id, kVerify);
+            frame->can_dlc = 0;
+            target.deadline = now + erase_timeout_;
+        } break;
+        default:
+            return false;
+    }
+    target.request_pending = false;
+    return true;
+}
+
+size_t CanFlashSession::poll(Clock::time_point now, size_t max_frames, const SendFn& send) {
+    for (auto& target : targets_) {
+        if (target.stage == Stage::kDone || target.stage == Stage::kFailed) continue;
+        if (target.request_pending || now < target.deadline) continue;
+        if (++target.retries > kMaxRetries) {
+            fail(target, std::string("timeout while ") + stage_name(target.stage));
+        } else if (target.stage == Stage::kTransferring) {
+            go_back(target, now);
+        } else {
+            target.request_pending = true;
+        }
+    }
+
+    update_broadcast_stream();
+
+    // The broadcast stream takes the round-robin slot after the last drive
+    size_t n_streams = targets_.size() + broadcast_;
+    size_t n_sent = 0;
+    size_t idle = 0; // streams in a row that had nothing to send
+    while (n_sent < max_frames && idle < n_streams) {
+        Target& target = rr_ < targets_.size() ? targets_[rr_] : broadcast_stream_;
+        rr_ = (rr_ + 1) % n_streams;
+
+        // Work on a copy so a frame the bus did not take is offered again
+        Target next = target;
+        can_frame frame;
+        if (!next_frame(next, now, &frame)) {
+            idle++;
+            continue;
+        }
+        if (!send(frame)) break;
+        target = next;
+        n_sent++;
+        idle = 0;
+
+        if (&target == &broadcast_stream_) {
+            for (auto& receiver : targets_) {
+                if (receiver.stage == Stage::kTransferring) receiver.deadline = target.deadline;
+            }
+        }
+    }
+    return n_sent;
+}
+
+bool CanFlashSession::finished() const {
+    return std::all_of(targets_.begin(), targets_.end(), [](const Target& target) {
+        return target.stage == Stage::kDone || target.stage == Stage::kFailed;
+    });
+}
+
+bool CanFlashSession::succeeded() const {
+    return std::all_of(targets_.begin(), targets_.end(), [](const Target& target) {
+        return target.stage == Stage::kDone;
+    });
+}
+
+const char* CanFlashSession::stage_name(Stage stage) {
+    switch (stage) {
+        case Stage::kEnteringDfu: return "entering DFU";
+        case Stage::kErasing: return "erasing";
+        case Stage::kTransferring: return "transferring";
+        case Stage::kVerifying: return "verifying";
+        case Stage::kDone: return "done";
+        case Stage::kFailed: return "failed";
+    }
+    return "";
+}
+
+void CanFlashSimBootloader::send_status(uint8_t opcode, uint8_t status, uint32_t value, const SendFn& send) const {
+    can_frame frame = {};
+    frame.can_id = make_id(node_id_, opcode);
+    if (opcode == kAck) {
+        frame.can_dlc = 5;
+        set_u32(frame.data, 0, value);
+        frame.data[4] = status;
+    } else {
+        frame.can_dlc = opcode == kDone ? 5 : 1;
+        frame.data[0] = status;
+        set_u32(frame.data, 1, value);
+    }
+    send(frame);
+}
+
+void CanFlashSimBootloader::finish_block(const SendFn& send) {
+    block_open_ = false;
+    bool complete = std::all_of(frames_seen_.begin(), frames_seen_.end(), [](bool seen) { return seen; });
+    if (!complete || crc32(block_.data(), block_.size()) != block_crc_) {
+        send_status(kAck, kStatusRetry, block_offset_, send);
+        return;
+    }
+    std::copy(block_.begin(), block_.end(), flash_.begin() + block_offset_);
+    next_offset_ += block_.size();
+    send_status(kAck, kStatusOk, block_offset_, send);
+}
+
+void CanFlashSimBootloader::on_can_frame(const can_frame& frame, const SendFn& send) {
+    // Losses are applied in both directions
+    std::uniform_real_distribution<double> dist;
+    if (dist(rng_) < drop_rate_) return;
+    auto lossy_send = [&](const can_frame& response) {
+        if (dist(rng_) >= drop_rate_) send(response);
+    };
+
+    if (!(frame.can_id & CAN_EFF_FLAG)) {
+        if (frame.can_id == (node_id_ << 5 | Enter_DFU_Mode_msg_t::cmd_id)) {
+            in_bootloader_ = true;
+            send_status(kReady, kStatusBootloader, 0, lossy_send);
+        }
+        return;
+    }
+
+    uint32_t node_id;
+    uint8_t opcode;
+    if (!in_bootloader_ || !parse_id(frame.can_id, &node_id, &opcode)) return;
+    if (node_id != node_id_ && !(node_id == kBroadcastNodeId && (opcode == kBlock || opcode == kData))) return;
+
+    switch (opcode) {
+        case kBegin: {
+            if (frame.can_dlc < 8) break;
+            flash_.assign(get_u32(frame.data, 0), 0xff);
+            expected_crc_ = get_u32(frame.data, 4);
+            next_offset_ = 0;
+            block_open_ = false;
+            send_status(kReady, kStatusErased, 0, lossy_send);
+        } break;
+        case kBlock: {
+            if (frame.can_dlc < 8) break;
+            size_t offset = get_u32(frame.data, 0);
+            if (block_open_ && offset != block_offset_) {
+                finish_block(lossy_send); // incomplete, the host has to go back
+            }
+            block_open_ = false;
+            if (offset < next_offset_) {
+                // Already written, the acknowledgement got lost
+                send_status(kAck, kStatusOk, offset, lossy_send);
+            } else if (offset == next_offset_ && offset < flash_.size()) {
+                block_open_ = true;
+                block_offset_ = offset;
+                block_crc_ = get_u32(frame.data, 4);
+                block_.assign(std::min(kBlockSize, flash_.size() - offset), 0);
+                frames_seen_.assign((block_.size() + kDataPerFrame - 1) / kDataPerFrame, false);
+            }
+        } break;
+        case kData: {
+            if (!block_open_ || frame.can_dlc < 1 || frame.data[0] >= frames_seen_.size()) break;
+            size_t begin = frame.data[0] * kDataPerFrame;
+            size_t length = std::min<size_t>(frame.can_dlc - 1, block_.size() - begin);
+            std::memcpy(block_.data() + begin, frame.data + 1, length);
+            frames_seen_[frame.data[0]] = true;
+            if (frame.data[0] + 1u == frames_seen_.size()) {
+                finish_block(lossy_send);
+            }
+        } break;
+        case kVerify: {
+            uint32_t crc = crc32(flash_.data(), flash_.size());
+            uint8_t status = next_offset_ == flash_.size() && crc == expected_crc_ ? kStatusOk : kStatusFailed;
+            send_status(kDone, status, crc, lossy_send);
+        } break;
+    }
+}
@@ -0,0 +1,119 @@
+#include "can_log.hpp"
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool parse_candump_line(std::string_view line, double* timestamp, std::string_view* interface, can_frame* frame) {
+    // (<seconds>.<micros>)
+    if (line.size() < 3 || line[0] != '(') return false;
+    size_t close = line.find(')');
+    if (close == std::string_view::npos) return false;
+    uint64_t seconds = 0;
+    uint64_t fraction = 0;
+    const char* p = line.data() + 1;
+    const char* end = line.data() + close;
+    auto res = std::from_chars(p, end, seconds);
+    if (res.ec != std::errc() || res.ptr == end || *res.ptr != '.') return false;
+    const char* fraction_begin = res.ptr + 1;
+    res = std::from_chars(fraction_begin, end, fraction);
+    if (res.ec != std::errc() || res.ptr != end) return false;
+    double scale = 1.0;
+    for (const char* q = fraction_begin; q < end; ++q) scale *= 0.1;
+    *timestamp = seconds + fraction * scale;
+
+    // <interface>
+    size_t intf_begin = line.find_first_not_of(' ', close + 1);
+    if (intf_begin == std::string_view::npos) return false;
+    size_t intf_end = line.find(' ', intf_begin);
+    if (intf_end == std::string_view::npos) return false;
+    *interface = line.substr(intf_begin, intf_end - intf_begin);
+
+    // <id>#<data>, where the id has 3 (standard) or 8 (extended) digits
+    std::string_view rest = line.substr(intf_end + 1);
+    size_t hash = rest.find('#');
+    if (hash != 3 && hash != 8) return false;
+    uint32_t id = 0;
+    for (size_t i = 0; i < hash; ++i) {
+        int digit = hex_digit(rest[i]);
+        if (digit < 0) return false;
+        id = (id << 4) | digit;
+    }
+    std::memset(frame, 0, sizeof(*frame));
+    frame->can_id = hash == 8 ? (id & CAN_EFF_MASK) | CAN_EFF_FLAG : id & CAN_SFF_MASK;
+
+    std::string_view payload = rest.substr(hash + 1);
+    while (!payload.empty() && (payload.back() == '\r' || payload.back() == ' ')) payload.remove_suffix(1);
+    if (!payload.empty() && payload[0] == '#') return false; // CAN FD
+    if (!payload.empty() && payload[0] == 'R') {
+        frame->can_id |= CAN_RTR_FLAG;
+        return true;
+    }
+    if (payload.size() % 2 || payload.size() > 2 * CAN_MAX_DLEN) return false;
+    for (size_t i = 0; i < payload.size() / 2; ++i) {
+        int hi = hex_digit(payload[2 * i]);
+        int lo = hex_digit(payload[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        frame->data[i] = static_cast<uint8_t>(hi << 4 | lo);
+    }
+    frame->can_dlc = payload.size() / 2;
+    return true;
+}
+
+bool read_candump_log(const std::string& path, CanLog* log, const std::string& interface) {
+    std::unique_ptr<FILE, int (*)(FILE*)> file(std::fopen(path.c_str(), "rb"), &std::fclose);
+    if (!file) return false;
+
+    // Lines are parsed straight out of large chunks; a line that straddles two
+    // chunks is carried over to the next one.
+    constexpr size_t kChunkSize = 1 << 20;
+    std::vector<char> buf(kChunkSize);
+    size_t carry = 0;
+    for (;;) {
+        size_t n = std::fread(buf.data() + carry, 1, buf.size() - carry, file.get());
+        size_t len = carry + n;
+        bool eof = n == 0;
+        if (eof && len == 0) break;
+
+        std::string_view chunk(buf.data(), len);
+        size_t pos = 0;
+        for (;;) {
+            size_t nl = chunk.find('\n', pos);
+            if (nl == std::string_view::npos) {
+                if (!eof) break;
+                nl = len; // last line without newline
+            }
+            std::string_view line = chunk.substr(pos, nl - pos);
+            pos = nl + 1;
+
+            double timestamp;
+            std::string_view intf;
+            can_frame frame;
+            if (parse_candump_line(line, &timestamp, &intf, &frame)) {
+                if (interface.empty() || intf == interface) {
+                    log->timestamps.push_back(timestamp);
+                    log->frames.push_back(frame);
+                }
+            } else if (!line.empty()) {
+                log->skipped_lines++;
+            }
+            if (pos >= len) break;
+        }
+        if (eof) break;
+
+        carry = pos < len ? len - pos : 0;
+        if (carry == buf.size()) {
+            buf.resize(buf.size() * 2); // line longer than a chunk
+        } else {
+            std::memmove(buf.data(), buf.data() + pos, carry);
+        }
+    }
+    return !std::ferror(file.get());
+}
@@ -0,0 +1,250 @@
+#include "can_mux_client.hpp"
+#include "can_backend.hpp"
+#include "tracer.hpp"
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <charconv>
+#include <iostream>
+#include <new>
+
+bool CanMuxClient::connect(const std::string& interface, uint32_t priority) {
+    register_ = CanMuxRegister();
+    register_.priority = priority;
+
+    memfd_ = memfd_create("odrive_can_mux", MFD_CLOEXEC);
+    if (memfd_ < 0 || ftruncate(memfd_, sizeof(CanMuxRegion)) != 0) {
+        std::cerr << "Failed to create CAN mux region" << std::endl;
+        disconnect();
+        return false;
+    }
+    void* addr = mmap(nullptr, sizeof(CanMuxRegion), PROT_READ | PROT_WRITE, MAP_SHARED, memfd_, 0);
+    if (addr == MAP_FAILED) {
+        std::cerr << "Failed to map CAN mux region" << std::endl;
+        disconnect();
+        return false;
+    }
+    region_ = new (addr) CanMuxRegion();
+
+    tx_evt_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    rx_evt_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    control_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (tx_evt_fd_ < 0 || rx_evt_fd_ < 0 || control_fd_ < 0) {
+        std::cerr << "Failed to create CAN mux descriptors" << std::endl;
+        disconnect();
+        return false;
+    }
+
+    sockaddr_un addr_un;
+    socklen_t addr_len = can_mux_address(interface, &addr_un);
+    if (::connect(control_fd_, reinterpret_cast<sockaddr*>(&addr_un), addr_len) != 0) {
+        std::cerr << "Failed to connect to odrive_can_mux for " << interface << std::endl;
+        disconnect();
+        return false;
+    }
+
+    if (!send_register(true)) {
+        disconnect();
+        return false;
+    }
+    return true;
+}
+
+void CanMuxClient::disconnect() {
+    for (int* fd : {&control_fd_, &tx_evt_fd_, &rx_evt_fd_, &memfd_}) {
+        if (*fd >= 0) close(*fd);
+        *fd = -1;
+    }
+    if (region_) {
+        munmap(region_, sizeof(CanMuxRegion));
+        region_ = nullptr;
+    }
+}
+
+bool CanMuxClient::set_filters(const std::vector<can_filter>& filters) {
+    if (filters.size() > kCanMuxMaxFilters) {
+        std::cerr << "Too many CAN mux filters" << std::endl;
+        return false;
+    }
+    register_.n_filters = filters.size();
+    std::copy(filters.begin(), filters.end(), register_.filters);
+    return send_register(false);
+}
+
+bool CanMuxClient::send(const can_frame& frame) {
+    if (!region_->tx.push(frame)) {
+        errno = ENOBUFS; // like a full kernel queue
+        return false;
+    }
+    // Signal after every push: the daemon may drain the ring between a check
+    // for emptiness and the push, which would leave this frame without a wakeup.
+    const uint64_t val = 1;
+    if (write(tx_evt_fd_, &val, sizeof(val)) != sizeof(val)) return false;
+    return true;
+}
+
+bool CanMuxClient::receive(can_frame* frame) {
+    return region_->rx.pop(frame);
+}
+
+void CanMuxClient::clear_rx_event() {
+    uint64_t val;
+    if (read(rx_evt_fd_, &val, sizeof(val)) != sizeof(val)) {
+        // not signaled
+    }
+}
+
+bool CanMuxClient::send_register(bool with_fds) {
+    struct iovec vec = {.iov_base = &register_, .iov_len = sizeof(register_)};
+    alignas(struct cmsghdr) char ctrl[CMSG_SPACE(3 * sizeof(int))];
+    struct msghdr message = {};
+    message.msg_iov = &vec;
+    message.msg_iovlen = 1;
+
+    if (with_fds) {
+        message.msg_control = ctrl;
+        message.msg_controllen = sizeof(ctrl);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+        int fds[3] = {memfd_, tx_evt_fd_, rx_evt_fd_};
+        std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    }
+
+    if (sendmsg(control_fd_, &message, 0) != sizeof(register_)) {
+        std::cerr << "Failed to register with odrive_can_mux" << std::endl;
+        return false;
+    }
+
+    CanMuxReply reply;
+    if (recv(control_fd_, &reply, sizeof(reply), 0) != sizeof(reply) || !reply.ok) {
+        std::cerr << "odrive_can_mux rejected registration" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+// "mux:<interface>[:<priority>]"
+class MuxCanBackend : public CanBackend {
+public:
+    ~MuxCanBackend() override { deinit(); }
+
+    bool init(const std::string& name, EpollEventLoop* event_loop, FrameProcessor frame_processor) override {
+        uint32_t priority = 0;
+        std::string bus = name;
+        size_t sep = name.find(':');
+        if (sep != std::string::npos) {
+            bus = name.substr(0, sep);
+            const char* begin = name.c_str() + sep + 1;
+            const char* end = name.c_str() + name.size();
+            auto [ptr, ec] = std::from_chars(begin, end, priority);
+            if (ec != std::errc() || ptr != end || begin == end) {
+                std::cerr << "Invalid CAN mux priority: " << begin << std::endl;
+                return false;
+            }
+        }
+
+        event_loop_ = event_loop;
+        frame_processor_ = std::move(frame_processor);
+        if (!mux_.connect(bus, priority)) {
+            return false;
+        }
+        connected_ = true;
+
+        if (!event_loop_->register_event(&rx_evt_id_, mux_.rx_event_fd(), EPOLLIN, [this](uint32_t mask) { on_rx_event(mask); })) {
+            std::cerr << "Failed to register CAN mux with event loop" << std::endl;
+            deinit();
+            return false;
+        }
+
+        // EPOLLHUP and EPOLLERR are always reported, no other events are needed
+        if (!event_loop_->register_event(&control_evt_id_, mux_.control_fd(), 0, [this](uint32_t mask) { on_control_event(mask); })) {
+            std::cerr << "Failed to register CAN mux control socket with event loop" << std::endl;
+            deinit();
+            return false;
+        }
+        return true;
+    }
+
+    void deinit() override {
+        for (EpollEventLoop::EvtId* evt : {&rx_evt_id_, &control_evt_id_}) {
+            if (*evt) {
+                event_loop_->deregister_event(*evt);
+                *evt = nullptr;
+            }
+        }
+        if (connected_) {
+            mux_.disconnect();
+            connected_ = false;
+        }
+    }
+
+    bool send_can_frame(const can_frame& frame) override {
+        return connected_ && mux_.send(frame);
+    }
+
+    size_t send_can_frames(const can_frame* frames, size_t n_frames) override {
+        // The daemon batches everything that is in the ring when it wakes up
+        size_t n_sent = 0;
+        while (n_sent < n_frames && send_can_frame(frames[n_sent])) {
+            n_sent++;
+        }
+        return n_sent;
+    }
+
+    bool enable_tx_echo(TxEchoProcessor) override {
+        return false; // the daemon does not forward TX echoes
+    }
+
+    bool enable_rx_timestamps() override {
+        return false; // frames are not timestamped on arrival
+    }
+
+    bool set_filters(const std::vector<can_filter>& filters) override {
+        return connected_ && mux_.set_filters(filters);
+    }
+
+    bool read_nonblocking() override {
+        struct can_frame frame;
+        if (!connected_ || !mux_.receive(&frame)) {
+            return false;
+        }
+        ODRIVE_TRACE_SCOPE_ARG("can_rx", frame.can_id);
+        frame_processor_(frame);
+        return true;
+    }
+
+private:
+    void on_rx_event(uint32_t mask) {
+        if (mask & ~EPOLLIN) {
+            std::cerr << "unexpected event " << mask << std::endl;
+            deinit();
+            return;
+        }
+        mux_.clear_rx_event();
+        while (read_nonblocking());
+    }
+
+    void on_control_event(uint32_t mask) {
+        std::cerr << "CAN mux daemon disconnected (event " << mask << ")" << std::endl;
+        deinit();
+    }
+
+    CanMuxClient mux_;
+    bool connected_ = false;
+    EpollEventLoop* event_loop_ = nullptr;
+    EpollEventLoop::EvtId rx_evt_id_ = nullptr;
+    EpollEventLoop::EvtId control_evt_id_ = nullptr;
+    FrameProcessor frame_processor_;
+};
+
+} // namespace
+
+void register_mux_can_backend() {
+    register_can_backend("mux:", [] { return std::unique_ptr<CanBackend>(new MuxCanBackend()); });
+}
@@ -0,0 +1,258 @@
+#include "can_mux_server.hpp"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+// Retry period for frames the interface did not accept
+static constexpr std::chrono::microseconds kTxRetryPeriod{200};
+
+bool CanMuxServer::init(const std::string& interface, EpollEventLoop* event_loop) {
+    interface_ = interface;
+    event_loop_ = event_loop;
+
+    if (!can_intf_.init(interface, event_loop, std::bind(&CanMuxServer::on_can_frame, this, _1))) {
+        return false;
+    }
+
+    listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        std::cerr << "Failed to create control socket" << std::endl;
+        can_intf_.deinit();
+        return false;
+    }
+
+    sockaddr_un addr;
+    socklen_t addr_len = can_mux_address(interface, &addr);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), addr_len) != 0 || listen(listen_fd_, 16) != 0) {
+        std::cerr << "Failed to bind control socket (is another odrive_can_mux running on " << interface << "?)"
+                  << std::endl;
+        close(listen_fd_);
+        can_intf_.deinit();
+        return false;
+    }
+
+    if (!event_loop_->register_event(&listen_evt_, listen_fd_, EPOLLIN, std::bind(&CanMuxServer::on_accept, this, _1))) {
+        std::cerr << "Failed to register control socket with event loop" << std::endl;
+        close(listen_fd_);
+        can_intf_.deinit();
+        return false;
+    }
+
+    return true;
+}
+
+void CanMuxServer::deinit() {
+    while (!clients_.empty()) {
+        remove_client(clients_.back().get());
+    }
+    tx_queue_.clear();
+    if (tx_retry_armed_) {
+        tx_retry_timer_.deinit();
+        tx_retry_armed_ = false;
+    }
+    event_loop_->deregister_event(listen_evt_);
+    close(listen_fd_);
+    listen_fd_ = -1;
+    can_intf_.deinit();
+}
+
+void CanMuxServer::on_accept(uint32_t) {
+    int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    // The abstract socket has no file permissions, anyone could connect
+    struct ucred cred = {};
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0
+        || (cred.uid != geteuid() && cred.uid != 0)) {
+        std::cerr << "Rejected client (pid " << cred.pid << ", uid " << cred.uid << ")" << std::endl;
+        close(fd);
+        return;
+    }
+
+    auto client = std::make_unique<Client>();
+    client->control_fd = fd;
+    Client* p_client = client.get();
+    if (!event_loop_->register_event(&client->control_evt, fd, EPOLLIN, [this, p_client](uint32_t mask) {
+            on_control(p_client, mask);
+        })) {
+        close(fd);
+        return;
+    }
+    clients_.push_back(std::move(client));
+}
+
+void CanMuxServer::on_control(Client* client, uint32_t mask) {
+    if (mask & (EPOLLHUP | EPOLLERR)) {
+        remove_client(client);
+        return;
+    }
+
+    CanMuxRegister config;
+    struct iovec vec = {.iov_base = &config, .iov_len = sizeof(config)};
+    alignas(struct cmsghdr) char ctrl[CMSG_SPACE(3 * sizeof(int))];
+    struct msghdr message = {};
+    message.msg_iov = &vec;
+    message.msg_iovlen = 1;
+    message.msg_control = ctrl;
+    message.msg_controllen = sizeof(ctrl);
+
+    ssize_t n = recvmsg(client->control_fd, &message, MSG_CMSG_CLOEXEC);
+    if (n <= 0) {
+        remove_client(client); // disconnected
+        return;
+    }
+
+    CanMuxReply reply;
+    reply.ok = n == sizeof(config) && config.version == kCanMuxVersion && config.n_filters <= kCanMuxMaxFilters;
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+        && cmsg->cmsg_len == CMSG_LEN(3 * sizeof(int)) && !client->region) {
+        int fds[3];
+        std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        void* addr = mmap(nullptr, sizeof(CanMuxRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+        close(fds[0]);
+        client->tx_evt_fd = fds[1];
+        client->rx_evt_fd = fds[2];
+        if (addr == MAP_FAILED) {
+            reply.ok = false;
+        } else {
+            client->region = static_cast<CanMuxRegion*>(addr);
+            reply.ok = reply.ok && event_loop_->register_event(&client->tx_evt, client->tx_evt_fd, EPOLLIN, [this, client](uint32_t) {
+                on_tx(client);
+            });
+        }
+    } else if (!client->region) {
+        reply.ok = false; // the first message must carry the descriptors
+    }
+
+    if (reply.ok) {
+        client->config = config;
+    }
+    if (send(client->control_fd, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply) || !reply.ok) {
+        remove_client(client);
+    }
+}
+
+void CanMuxServer::on_tx(Client* client) {
+    uint64_t val;
+    if (client && read(client->tx_evt_fd, &val, sizeof(val)) != sizeof(val)) {
+        // not signaled, other clients' wakeups still get served below
+    }
+
+    // Frames left over from a full TX queue go first. Until they are out, the
+    // rings stay as they are, which is the backpressure on the clients.
+    if (!flush_tx()) return;
+
+    // Drain the rings of all clients, not only the one that woke us up, so
+    // that the batch can be ordered across clients.
+    for (auto& c : clients_) {
+        if (!c->region) continue;
+        can_frame frame;
+        while (c->region->tx.pop(&frame)) {
+            tx_queue_.push_back({c->config.priority, c.get(), frame});
+        }
+    }
+    if (tx_queue_.empty()) return;
+
+    // Lower client priority first. The sort is stable, so the frames of each
+    // client keep the order in which they were queued.
+    std::stable_sort(tx_queue_.begin(), tx_queue_.end(), [](const TxEntry& a, const TxEntry& b) {
+        return a.priority < b.priority;
+    });
+
+    flush_tx();
+}
+
+// Returns true once everything in tx_queue_ was sent
+bool CanMuxServer::flush_tx() {
+    if (!tx_queue_.empty()) {
+        tx_frames_.clear();
+        for (auto& entry : tx_queue_) {
+            tx_frames_.push_back(entry.frame);
+        }
+        errno = 0;
+        size_t n_sent = can_intf_.send_can_frames(tx_frames_.data(), tx_frames_.size());
+        int err = errno;
+
+        // Like the kernel's loopback on raw sockets, other clients see what was sent
+        for (size_t i = 0; i < n_sent; ++i) {
+            deliver(tx_queue_[i].frame, tx_queue_[i].sender);
+        }
+
+        if (n_sent < tx_queue_.size() && err != ENOBUFS && err != EAGAIN) {
+            // Retrying would not help (e.g. the interface is down)
+            std::cerr << "dropped " << tx_queue_.size() - n_sent << " TX frames: " << std::strerror(err) << std::endl;
+            for (size_t i = n_sent; i < tx_queue_.size(); ++i) {
+                if (tx_queue_[i].sender) {
+                    tx_queue_[i].sender->region->tx_dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            n_sent = tx_queue_.size();
+        }
+        tx_queue_.erase(tx_queue_.begin(), tx_queue_.begin() + n_sent);
+    }
+
+    if (tx_queue_.empty()) {
+        if (tx_retry_armed_) {
+            tx_retry_timer_.deinit();
+            tx_retry_armed_ = false;
+        }
+        return true;
+    }
+
+    // A raw CAN socket does not report EPOLLOUT when the device queue drains
+    if (!tx_retry_armed_) {
+        tx_retry_armed_ = tx_retry_timer_.init(event_loop_, kTxRetryPeriod, [this](uint32_t) { on_tx(nullptr); });
+        if (!tx_retry_armed_) {
+            std::cerr << "Failed to arm TX retry timer" << std::endl;
+        }
+    }
+    return false;
+}
+
+void CanMuxServer::on_can_frame(const can_frame& frame) {
+    deliver(frame, nullptr);
+}
+
+void CanMuxServer::deliver(const can_frame& frame, const Client* sender) {
+    for (auto& c : clients_) {
+        if (!c->region || c.get() == sender || !can_mux_match(c->config.filters, c->config.n_filters, frame)) {
+            continue;
+        }
+
+        if (!c->region->rx.push(frame)) {
+            c->region->rx_dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        const uint64_t val = 1;
+        if (write(c->rx_evt_fd, &val, sizeof(val)) != sizeof(val)) {
+            // counter saturated, the client is awake anyway
+        }
+    }
+}
+
+void CanMuxServer::remove_client(Client* client) {
+    // Its frames that are still queued are sent all the same
+    for (auto& entry : tx_queue_) {
+        if (entry.sender == client) entry.sender = nullptr;
+    }
+    if (client->tx_evt) event_loop_->deregister_event(client->tx_evt);
+    if (client->control_evt) event_loop_->deregister_event(client->control_evt);
+    if (client->region) munmap(client->region, sizeof(CanMuxRegion));
+    for (int fd : {client->control_fd, client->tx_evt_fd, client->rx_evt_fd}) {
+        if (fd >= 0) close(fd);
+    }
+
+    clients_.erase(
+        std::remove_if(clients_.begin(), clients_.end(), [client](const auto& c) { return c.get() == client; }),
+        clients_.end()
+    );
+}
@@ -0,0 +1,54 @@
+#include "command_schedule.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// Longest pattern the load is balanced over; beyond that the phases are
+// only balanced approximately.
+static constexpr uint64_t kMaxHyperperiod = 1 << 14;
+
+uint32_t command_divider(double base_rate_hz, double command_rate_hz) {
+    if (command_rate_hz <= 0.0 || base_rate_hz <= command_rate_hz) return 1;
+    return std::max<uint32_t>(1, std::lround(base_rate_hz / command_rate_hz));
+}
+
+std::vector<uint32_t> plan_command_phases(const std::vector<uint32_t>& dividers) {
+    uint64_t hyperperiod = 1;
+    for (uint32_t divider : dividers) {
+        uint64_t next = std::lcm(hyperperiod, std::max<uint32_t>(divider, 1));
+        hyperperiod = next <= kMaxHyperperiod ? next : hyperperiod;
+    }
+
+    // Most frequent commands first: they occupy the most cycles, the rarer
+    // ones then fill the gaps.
+    std::vector<size_t> order(dividers.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return dividers[a] < dividers[b]; });
+
+    std::vector<uint32_t> load(hyperperiod, 0);
+    std::vector<uint32_t> phases(dividers.size(), 0);
+    for (size_t i : order) {
+        uint32_t divider = std::max<uint32_t>(dividers[i], 1);
+        uint32_t best_phase = 0;
+        uint64_t best_peak = UINT64_MAX;
+        uint64_t best_sum = UINT64_MAX;
+        for (uint32_t phase = 0; phase < divider; ++phase) {
+            uint64_t peak = 0;
+            uint64_t sum = 0;
+            for (uint64_t cycle = phase; cycle < hyperperiod; cycle += divider) {
+                peak = std::max<uint64_t>(peak, load[cycle]);
+                sum += load[cycle];
+            }
+            if (peak < best_peak || (peak == best_peak && sum < best_sum)) {
+                best_phase = phase;
+                best_peak = peak;
+                best_sum = sum;
+            }
+        }
+        phases[i] = best_phase;
+        for (uint64_t cycle = best_phase; cycle < hyperperiod; cycle += divider) {
+            load[cycle]++;
+        }
+    }
+    return phases;
+}
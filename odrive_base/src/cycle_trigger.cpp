@@ -0,0 +1,68 @@
+#include "cycle_trigger.hpp"
+#include "tracer.hpp"
+#include <map>
+
+std::shared_ptr<CycleTrigger> CycleTrigger::acquire(const std::string& name) {
+    static std::mutex registry_mutex;
+    static std::map<std::string, std::weak_ptr<CycleTrigger>> registry;
+
+    std::lock_guard<std::mutex> guard(registry_mutex);
+    if (auto trigger = registry[name].lock()) {
+        return trigger;
+    }
+
+    std::shared_ptr<CycleTrigger> trigger(new CycleTrigger());
+    registry[name] = trigger;
+    return trigger;
+}
+
+int CycleTrigger::add_source() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (size_t i = 0; i < kMaxSources; ++i) {
+        if (!(sources_ & (1ull << i))) {
+            sources_ |= 1ull << i;
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+void CycleTrigger::remove_source(int source) {
+    if (source < 0) return;
+    std::lock_guard<std::mutex> guard(mutex_);
+    sources_ &= ~(1ull << source);
+    pending_ &= sources_;
+    // The remaining sources may already be complete
+    if (sources_ && pending_ == sources_) {
+        pending_ = 0;
+        generation_++;
+        cv_.notify_all();
+    }
+}
+
+void CycleTrigger::notify(int source) {
+    if (source < 0) return;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        pending_ |= (1ull << source) & sources_;
+        if (pending_ != sources_) return;
+        pending_ = 0;
+        generation_++;
+    }
+    ODRIVE_TRACE_INSTANT("cycle_ready", source);
+    cv_.notify_all();
+}
+
+bool CycleTrigger::wait_for(std::chrono::nanoseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!cv_.wait_for(lock, timeout, [this]() { return generation_ != consumed_; })) {
+        return false;
+    }
+    consumed_ = generation_;
+    return true;
+}
+
+uint64_t CycleTrigger::cycles() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return generation_;
+}
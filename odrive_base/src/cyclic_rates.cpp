@@ -0,0 +1,54 @@
+#include "cyclic_rates.hpp"
+#include <algorithm>
+#include <cmath>
+
+const std::array<const char*, kNumCyclicMessages> kCyclicMessageNames = {
+    "heartbeat",
+    "encoder",
+    "iq",
+    "torques",
+    "error",
+    "temperature",
+    "bus_voltage",
+    "powers",
+};
+
+// Standard frame with 8 data bytes, worst-case bit stuffing and interframe space
+static constexpr double kBitsPerFrame = 135.0;
+
+static bool is_motion_message(size_t msg) {
+    return msg == kCyclicEncoder || msg == kCyclicIq || msg == kCyclicTorques || msg == kCyclicPowers;
+}
+
+CyclicRatePlan plan_cyclic_rates(const CyclicRateConfig& config, bool idle) {
+    CyclicRatePlan plan = {};
+    if (!config.bus_bitrate || !config.num_axes) return plan;
+
+    double frames_per_s = config.bus_budget * config.bus_bitrate / kBitsPerFrame;
+    double telemetry_per_axis = frames_per_s / config.num_axes - config.command_rate_hz;
+
+    double total_weight = 0.0;
+    for (double w : config.weights) total_weight += std::max(w, 0.0);
+    if (total_weight <= 0.0) return plan;
+
+    for (size_t i = 0; i < kNumCyclicMessages; ++i) {
+        if (config.weights[i] <= 0.0) continue;
+        double rate_hz = telemetry_per_axis * config.weights[i] / total_weight;
+        uint32_t period_ms = rate_hz > 0.0 ? static_cast<uint32_t>(std::ceil(1000.0 / rate_hz)) : config.idle_period_ms;
+        period_ms = std::max(period_ms, config.min_period_ms);
+        if (idle && is_motion_message(i)) {
+            period_ms = std::max(period_ms, config.idle_period_ms);
+        }
+        plan[i] = period_ms;
+    }
+    return plan;
+}
+
+double cyclic_bus_load(const CyclicRateConfig& config, const CyclicRatePlan& plan) {
+    if (!config.bus_bitrate) return 0.0;
+    double frames_per_s = config.command_rate_hz;
+    for (uint32_t period_ms : plan) {
+        if (period_ms) frames_per_s += 1000.0 / period_ms;
+    }
+    return frames_per_s * config.num_axes * kBitsPerFrame / config.bus_bitrate;
+}
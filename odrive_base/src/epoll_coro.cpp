@@ -0,0 +1,158 @@
+#include "epoll_coro.hpp"
+#include <sys/timerfd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+bool EpollDeadline::start(EpollEventLoop* event_loop, std::chrono::nanoseconds delay, std::function<void()> callback) {
+    cancel();
+    event_loop_ = event_loop;
+    callback_ = std::move(callback);
+
+    fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd_ < 0) return false;
+
+    // A zero it_value would disarm the timer
+    auto ns = std::max<int64_t>(delay.count(), 1);
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+    if (timerfd_settime(fd_, 0, &spec, nullptr) != 0
+        || !event_loop_->register_event(&evt_, fd_, EPOLLIN, std::bind(&EpollDeadline::on_trigger, this, _1))) {
+        std::cerr << "Failed to arm deadline" << std::endl;
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+void EpollDeadline::cancel() {
+    if (fd_ < 0) return;
+    event_loop_->deregister_event(evt_);
+    close(fd_);
+    fd_ = -1;
+}
+
+void EpollDeadline::on_trigger(uint32_t) {
+    cancel();
+    // May destroy this object (e.g. by resuming the coroutine that owns it)
+    std::function<void()> callback = std::move(callback_);
+    callback();
+}
+
+bool SleepAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    // If the timer cannot be armed, continue right away rather than hang
+    return deadline_.start(event_loop_, delay_, [handle]() { handle.resume(); });
+}
+
+void CoSignal::notify_all() {
+    std::vector<std::coroutine_handle<>> waiters;
+    waiters.swap(waiters_);
+    for (auto handle : waiters) {
+        handle.resume();
+    }
+}
+
+FramePredicate match_frame(uint32_t node_id, uint32_t cmd_id) {
+    uint32_t can_id = node_id << 5 | cmd_id;
+    return [can_id](const can_frame& frame) { return frame.can_id == can_id; };
+}
+
+bool CoCanBus::init(const std::string& interface, EpollEventLoop* event_loop, FrameProcessor frame_processor) {
+    event_loop_ = event_loop;
+    frame_processor_ = std::move(frame_processor);
+    open_ = can_intf_.init(interface, event_loop_, std::bind(&CoCanBus::on_can_msg, this, _1));
+    return open_;
+}
+
+void CoCanBus::deinit() {
+    if (!open_) return;
+    open_ = false;
+    tx_retry_.cancel();
+    tx_queue_.clear();
+    can_intf_.deinit();
+
+    // Waiting coroutines see a timeout and an empty queue
+    std::vector<FrameAwaiter*> frame_waiters;
+    frame_waiters.swap(frame_waiters_);
+    for (FrameAwaiter* waiter : frame_waiters) {
+        waiter->complete(std::nullopt);
+    }
+    std::vector<std::coroutine_handle<>> drain_waiters;
+    drain_waiters.swap(drain_waiters_);
+    for (auto handle : drain_waiters) {
+        handle.resume();
+    }
+}
+
+void CoCanBus::send(const can_frame& frame) {
+    if (!open_) return;
+    tx_queue_.push_back(frame);
+    if (!tx_retry_.armed()) {
+        flush();
+    }
+}
+
+void CoCanBus::flush() {
+    while (!tx_queue_.empty()) {
+        if (can_intf_.send_can_frame(tx_queue_.front())) {
+            tx_queue_.pop_front();
+        } else if (errno == ENOBUFS || errno == EAGAIN) {
+            tx_retry_.start(event_loop_, kTxRetryInterval, [this]() { flush(); });
+            return;
+        } else {
+            // Retrying would not help, e.g. the interface is down or gone
+            std::cerr << "dropped CAN frame " << std::hex << tx_queue_.front().can_id << std::dec << ": "
+                      << std::strerror(errno) << std::endl;
+            tx_queue_.pop_front();
+        }
+    }
+
+    std::vector<std::coroutine_handle<>> waiters;
+    waiters.swap(drain_waiters_);
+    for (auto handle : waiters) {
+        handle.resume();
+    }
+}
+
+void CoCanBus::on_can_msg(const can_frame& frame) {
+    // Collect first: resumed coroutines may add new waiters, which must not
+    // see this frame, or remove their own.
+    std::vector<FrameAwaiter*> matched;
+    std::erase_if(frame_waiters_, [&](FrameAwaiter* waiter) {
+        if (!waiter->predicate_(frame)) return false;
+        matched.push_back(waiter);
+        return true;
+    });
+
+    if (matched.empty()) {
+        if (frame_processor_) frame_processor_(frame);
+        return;
+    }
+    for (FrameAwaiter* waiter : matched) {
+        waiter->complete(frame);
+    }
+}
+
+bool CoCanBus::FrameAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    if (!bus_->open_) {
+        return false; // resumes right away with nullopt
+    }
+    handle_ = handle;
+    bus_->frame_waiters_.push_back(this);
+    if (timeout_ != std::chrono::nanoseconds::max()) {
+        deadline_.start(bus_->event_loop_, timeout_, [this]() {
+            std::erase(bus_->frame_waiters_, this);
+            complete(std::nullopt);
+        });
+    }
+    return true;
+}
+
+void CoCanBus::FrameAwaiter::complete(std::optional<can_frame> frame) {
+    deadline_.cancel();
+    result_ = frame;
+    handle_.resume();
+}
@@ -1,10 +1,14 @@
 #include "epoll_event_loop.hpp"
+#include <sys/timerfd.h>
 
 EpollEventLoop::EpollEventLoop() {
     epollfd = epoll_create1(0);
 }
 
 EpollEventLoop::~EpollEventLoop() {
+    for (EventContext* ctx : deregistered_) {
+        delete ctx;
+    }
     close(epollfd);
 }
 
@@ -29,7 +33,12 @@ bool EpollEventLoop::deregister_event(EvtId evt) {
     if (evt == nullptr) return false;
     if (epoll_ctl(epollfd, EPOLL_CTL_DEL, evt->fd, nullptr) == -1) return false;
     drop_event(evt);
-    delete evt;
+    if (dispatching_) {
+        deregistered_.push_back(evt); // its callback may be running right now
+    } else {
+        delete evt;
+    }
+    n_events_--;
     return true;
 }
 
@@ -37,10 +46,18 @@ bool EpollEventLoop::run_until_empty() {
     while (n_events_) {
         n_triggered_events_ = epoll_wait(epollfd, triggered_events_, kMaxEventsPerIteration, -1);
         if (n_triggered_events_ == -1) return false;
+        dispatching_ = true;
         for (int i = 0; i < n_triggered_events_; ++i) {
             EventContext* handler = static_cast<EventContext*>(triggered_events_[i].data.ptr);
+            if (!handler) continue; // deregistered by an earlier callback in this iteration
             handler->callback(triggered_events_[i].events);
         }
+        dispatching_ = false;
+        n_triggered_events_ = 0;
+        for (EventContext* ctx : deregistered_) {
+            delete ctx;
+        }
+        deregistered_.clear();
     }
     return true;
 }
@@ -70,6 +87,7 @@ bool EpollEvent::init(EpollEventLoop* event_loop, const Callback& callback) {
 }
 
 void EpollEvent::deinit() {
+    if (fd_ < 0) return;
     event_loop_->deregister_event(evt_);
     close(fd_);
     fd_ = -1;
@@ -90,3 +108,45 @@ void EpollEvent::on_trigger(uint32_t event_id) {
 
     callback_(event_id);
 }
+
+bool EpollTimer::init(EpollEventLoop* event_loop, std::chrono::nanoseconds period, const Callback& callback) {
+    event_loop_ = event_loop;
+    callback_ = callback;
+
+    fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (fd_ < 0) return false;
+
+    struct itimerspec spec = {};
+    spec.it_interval.tv_sec = period.count() / 1000000000;
+    spec.it_interval.tv_nsec = period.count() % 1000000000;
+    spec.it_value = spec.it_interval;
+    if (timerfd_settime(fd_, 0, &spec, nullptr) != 0) {
+        close(fd_);
+        std::cerr << "Failed to arm timer" << std::endl;
+        return false;
+    }
+
+    if (!event_loop->register_event(&evt_, fd_, EPOLLIN, std::bind(&EpollTimer::on_trigger, this, _1))) {
+        close(fd_);
+        std::cerr << "Failed to register timer" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void EpollTimer::deinit() {
+    if (fd_ < 0) return;
+    event_loop_->deregister_event(evt_);
+    close(fd_);
+    fd_ = -1;
+}
+
+void EpollTimer::on_trigger(uint32_t event_id) {
+    uint64_t n_expirations;
+    if (read(fd_, &n_expirations, sizeof(n_expirations)) != sizeof(n_expirations)) {
+        return; // spurious wakeup
+    }
+
+    callback_(event_id);
+}
@@ -0,0 +1,311 @@
+#include "fault_injection.hpp"
+#include "can_backend.hpp"
+#include "socket_can.hpp"
+#include <sys/timerfd.h>
+#include <cerrno>
+#include <cmath>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <sstream>
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+bool parse_fault_config(const std::string& spec, FaultConfig* config) {
+    const std::map<std::string, double*> probabilities = {
+        {"rx_drop", &config->rx_drop},
+        {"tx_drop", &config->tx_drop},
+        {"duplicate", &config->duplicate},
+        {"reorder", &config->reorder},
+        {"enobufs", &config->enobufs},
+        {"bus_off_rate", &config->bus_off_rate},
+    };
+    const std::map<std::string, uint32_t*> durations = {
+        {"reorder_us", &config->reorder_us},
+        {"latency_us", &config->latency_us},
+        {"jitter_us", &config->jitter_us},
+        {"bus_off_ms", &config->bus_off_ms},
+    };
+
+    std::stringstream stream(spec);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item.empty()) continue;
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            std::cerr << "Invalid fault option " << item << std::endl;
+            return false;
+        }
+        std::string key = item.substr(0, eq);
+        std::string value = item.substr(eq + 1);
+        try {
+            if (key == "seed") {
+                config->seed = std::stoull(value);
+            } else if (key == "drop") {
+                config->rx_drop = config->tx_drop = std::stod(value);
+            } else if (probabilities.count(key)) {
+                *probabilities.at(key) = std::stod(value);
+            } else if (durations.count(key)) {
+                *durations.at(key) = std::stoul(value);
+            } else {
+                std::cerr << "Unknown fault option " << key << std::endl;
+                return false;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for fault option " << key << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+FaultInjector::FaultInjector(const FaultConfig& config, Deliver deliver, Transmit transmit)
+    : config_(config), deliver_(std::move(deliver)), transmit_(std::move(transmit)), rng_(config.seed),
+      bus_off_rng_(config.seed ^ 0x9e3779b97f4a7c15ull) {}
+
+bool FaultInjector::init(EpollEventLoop* event_loop) {
+    event_loop_ = event_loop;
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd_ < 0) return false;
+    if (!event_loop_->register_event(&timer_evt_, timer_fd_, EPOLLIN, [this](uint32_t) {
+            uint64_t expirations;
+            if (read(timer_fd_, &expirations, sizeof(expirations)) < 0) {
+                // spurious wakeup, service() re-arms anyway
+            }
+            armed_ns_ = 0;
+            service();
+        })) {
+        std::cerr << "Failed to register fault injection timer" << std::endl;
+        close(timer_fd_);
+        timer_fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+void FaultInjector::deinit() {
+    if (timer_fd_ < 0) return;
+    event_loop_->deregister_event(timer_evt_);
+    close(timer_fd_);
+    timer_fd_ = -1;
+}
+
+uint64_t FaultInjector::delay_ns() {
+    uint64_t delay_us = config_.latency_us;
+    if (config_.jitter_us) {
+        delay_us += static_cast<uint64_t>(uniform_(rng_) * config_.jitter_us);
+    }
+    if (chance(config_.reorder)) {
+        stats_.reordered++;
+        delay_us += config_.reorder_us;
+    }
+    return delay_us * 1000;
+}
+
+bool FaultInjector::bus_off(uint64_t now_ns) {
+    if (config_.bus_off_rate <= 0.0) return false;
+    auto next_interval = [this]() {
+        std::exponential_distribution<double> interval(config_.bus_off_rate);
+        return static_cast<uint64_t>(interval(bus_off_rng_) * 1e9);
+    };
+    if (!next_bus_off_ns_) {
+        next_bus_off_ns_ = now_ns + next_interval();
+    }
+    if (now_ns >= next_bus_off_ns_) {
+        stats_.bus_offs++;
+        bus_off_until_ns_ = now_ns + config_.bus_off_ms * 1000000ull;
+        next_bus_off_ns_ = bus_off_until_ns_ + next_interval();
+        std::cerr << "fault injection: bus off for " << config_.bus_off_ms << " ms" << std::endl;
+    }
+    return now_ns < bus_off_until_ns_;
+}
+
+void FaultInjector::on_rx(const can_frame& frame) {
+    stats_.rx_frames++;
+    if (bus_off(monotonic_ns())) {
+        stats_.bus_off_frames++;
+        return;
+    }
+    if (chance(config_.rx_drop)) {
+        stats_.rx_dropped++;
+        return;
+    }
+
+    int copies = 1;
+    if (chance(config_.duplicate)) {
+        stats_.rx_duplicated++;
+        copies = 2;
+    }
+    for (int i = 0; i < copies; ++i) {
+        uint64_t delay = delay_ns();
+        if (delay) {
+            schedule(delay, false, frame);
+        } else {
+            deliver_(frame);
+        }
+    }
+}
+
+bool FaultInjector::on_tx(const can_frame& frame) {
+    stats_.tx_frames++;
+    if (bus_off(monotonic_ns())) {
+        stats_.bus_off_frames++;
+        errno = ENETDOWN;
+        return false;
+    }
+    if (chance(config_.enobufs)) {
+        stats_.tx_enobufs++;
+        errno = ENOBUFS;
+        return false;
+    }
+    if (chance(config_.tx_drop)) {
+        stats_.tx_dropped++;
+        return true;
+    }
+
+    uint64_t delay = delay_ns();
+    if (!delay) {
+        return transmit_(frame);
+    }
+    schedule(delay, true, frame);
+    return true;
+}
+
+void FaultInjector::schedule(uint64_t delay, bool tx, const can_frame& frame) {
+    delayed_.push({monotonic_ns() + delay, seq_++, tx, frame});
+    arm_timer();
+}
+
+bool FaultInjector::service() {
+    bool delivered = false;
+    uint64_t now = monotonic_ns();
+    while (!delayed_.empty() && delayed_.top().due_ns <= now) {
+        Delayed entry = delayed_.top();
+        delayed_.pop();
+        if (entry.tx) {
+            if (!transmit_(entry.frame)) stats_.tx_failed++;
+        } else {
+            deliver_(entry.frame);
+            delivered = true;
+        }
+    }
+    arm_timer();
+    return delivered;
+}
+
+void FaultInjector::arm_timer() {
+    if (timer_fd_ < 0 || delayed_.empty()) return;
+    uint64_t due = delayed_.top().due_ns;
+    if (armed_ns_ && armed_ns_ <= due) return; // fires early enough already
+
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = due / 1000000000;
+    spec.it_value.tv_nsec = due % 1000000000;
+    if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) == 0) {
+        armed_ns_ = due;
+    }
+}
+
+namespace {
+
+// "fault:<options>:<interface>", where <interface> is opened with another
+// SocketCanIntf and may have a backend prefix itself
+class FaultCanBackend : public CanBackend {
+public:
+    ~FaultCanBackend() override { deinit(); }
+
+    bool init(const std::string& name, EpollEventLoop* event_loop, FrameProcessor frame_processor) override {
+        size_t sep = name.find(':');
+        if (sep == std::string::npos) {
+            std::cerr << "Expected fault:<options>:<interface>" << std::endl;
+            return false;
+        }
+        FaultConfig config;
+        if (!parse_fault_config(name.substr(0, sep), &config)) {
+            return false;
+        }
+        interface_ = name.substr(sep + 1);
+        faults_ = std::make_unique<FaultInjector>(
+            config,
+            std::move(frame_processor),
+            [this](const can_frame& frame) { return inner_.send_can_frame(frame); }
+        );
+
+        if (!inner_.init(interface_, event_loop, [this](const can_frame& frame) { faults_->on_rx(frame); })) {
+            faults_.reset();
+            return false;
+        }
+        active_ = true;
+        if (!faults_->init(event_loop)) {
+            deinit();
+            return false;
+        }
+        return true;
+    }
+
+    void deinit() override {
+        if (!active_) return;
+        active_ = false;
+        const FaultStats& stats = faults_->stats();
+        std::cerr << "fault injection on " << interface_ << ": rx " << stats.rx_frames << " (" << stats.rx_dropped
+                  << " dropped, " << stats.rx_duplicated << " duplicated), tx " << stats.tx_frames << " ("
+                  << stats.tx_dropped << " dropped, " << stats.tx_enobufs << " ENOBUFS), " << stats.reordered
+                  << " reordered, " << stats.bus_offs << " bus-off events" << std::endl;
+        faults_->deinit();
+        inner_.deinit();
+    }
+
+    bool send_can_frame(const can_frame& frame) override {
+        return faults_->on_tx(frame);
+    }
+
+    size_t send_can_frames(const can_frame* frames, size_t n_frames) override {
+        // Faults are decided per frame, which gives up the single syscall
+        size_t n_sent = 0;
+        while (n_sent < n_frames && faults_->on_tx(frames[n_sent])) {
+            n_sent++;
+        }
+        return n_sent;
+    }
+
+    bool enable_tx_echo(TxEchoProcessor tx_echo_processor) override {
+        return inner_.enable_tx_echo(std::move(tx_echo_processor));
+    }
+
+    bool enable_rx_timestamps() override {
+        return inner_.enable_rx_timestamps();
+    }
+
+    bool set_filters(const std::vector<can_filter>& filters) override {
+        return inner_.set_filters(filters);
+    }
+
+    bool read_nonblocking() override {
+        if (!active_) {
+            return false;
+        }
+        // Polled sockets (SharedCanBus) never run the injector's timer
+        if (faults_->service()) {
+            return true;
+        }
+        return inner_.read_nonblocking();
+    }
+
+    uint64_t rx_timestamp_ns() const override { return inner_.rx_timestamp_ns(); }
+
+private:
+    std::string interface_;
+    SocketCanIntf inner_;
+    std::unique_ptr<FaultInjector> faults_; // kept after deinit(), which may come from its callbacks
+    bool active_ = false;
+};
+
+} // namespace
+
+void register_fault_can_backend() {
+    register_can_backend("fault:", [] { return std::unique_ptr<CanBackend>(new FaultCanBackend()); });
+}
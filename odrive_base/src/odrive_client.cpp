@@ -0,0 +1,278 @@
+#include "odrive_client.hpp"
+#include "can_helpers.hpp"
+#include "can_simple_messages.hpp"
+#include "odrive_enums.h"
+#include <ctime>
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// States that persist once entered, as opposed to procedures that end in IDLE
+static bool is_persistent_state(uint32_t axis_state) {
+    return axis_state == AXIS_STATE_IDLE || axis_state == AXIS_STATE_CLOSED_LOOP_CONTROL;
+}
+
+AxisSnapshot ODriveAxis::snapshot() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return snapshot_;
+}
+
+template <typename T>
+void ODriveAxis::send(const T& msg) {
+    can_frame frame = {};
+    frame.can_id = node_id_ << 5 | T::cmd_id;
+    frame.can_dlc = T::msg_length;
+    msg.encode_buf(frame.data);
+    bus_->queue(frame);
+}
+
+void ODriveAxis::set_input_pos(float pos, float vel_ff, float torque_ff) {
+    Set_Input_Pos_msg_t msg;
+    msg.Input_Pos = pos;
+    msg.Vel_FF = vel_ff;
+    msg.Torque_FF = torque_ff;
+    send(msg);
+}
+
+void ODriveAxis::set_input_vel(float vel, float torque_ff) {
+    Set_Input_Vel_msg_t msg;
+    msg.Input_Vel = vel;
+    msg.Input_Torque_FF = torque_ff;
+    send(msg);
+}
+
+void ODriveAxis::set_input_torque(float torque) {
+    Set_Input_Torque_msg_t msg;
+    msg.Input_Torque = torque;
+    send(msg);
+}
+
+void ODriveAxis::set_controller_mode(uint32_t control_mode, uint32_t input_mode) {
+    Set_Controller_Mode_msg_t msg;
+    msg.Control_Mode = control_mode;
+    msg.Input_Mode = input_mode;
+    send(msg);
+}
+
+void ODriveAxis::clear_errors() {
+    Clear_Errors_msg_t msg;
+    msg.Identify = 0;
+    send(msg);
+}
+
+std::future<AxisStateResult> ODriveAxis::request_state(uint32_t axis_state, std::chrono::milliseconds timeout) {
+    std::future<AxisStateResult> future;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        // The heartbeat that is already on its way may not reflect the request
+        state_requests_.push_back({axis_state, std::chrono::steady_clock::now() + timeout, 1, {}});
+        future = state_requests_.back().promise.get_future();
+    }
+
+    Set_Axis_State_msg_t msg;
+    msg.Axis_Requested_State = axis_state;
+    send(msg);
+    return future;
+}
+
+void ODriveAxis::on_can_msg(const can_frame& frame, uint64_t timestamp_ns) {
+    uint8_t cmd_id = frame.can_id & 0x1f;
+    if (frame.can_dlc < 8) {
+        return; // all telemetry messages are 8 bytes
+    }
+
+    AxisSnapshot snapshot;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        switch (cmd_id) {
+            case Heartbeat_msg_t::cmd_id: {
+                Heartbeat_msg_t msg;
+                msg.decode_buf(frame.data);
+                snapshot_.heartbeat_ns = timestamp_ns;
+                snapshot_.axis_error = msg.Axis_Error;
+                snapshot_.axis_state = msg.Axis_State;
+                snapshot_.procedure_result = msg.Procedure_Result;
+                snapshot_.trajectory_done = msg.Trajectory_Done_Flag;
+            } break;
+            case Get_Error_msg_t::cmd_id: {
+                Get_Error_msg_t msg;
+                msg.decode_buf(frame.data);
+                snapshot_.error_ns = timestamp_ns;
+                snapshot_.active_errors = msg.Active_Errors;
+                snapshot_.disarm_reason = msg.Disarm_Reason;
+            } break;
+            case Get_Encoder_Estimates_msg_t::cmd_id: {
+                Get_Encoder_Estimates_msg_t msg;
+                msg.decode_buf(frame.data);
+                snapshot_.estimates_ns = timestamp_ns;
+                snapshot_.pos_estimate = msg.Pos_Estimate;
+                snapshot_.vel_estimate = msg.Vel_Estimate;
+            } break;
+            case Get_Iq_msg_t::cmd_id: {
+                Get_Iq_msg_t msg;
+                msg.decode_buf(frame.data);
+                snapshot_.iq_setpoint = msg.Iq_Setpoint;
+                snapshot_.iq_measured = msg.Iq_Measured;
+            } break;
+            case Get_Torques_msg_t::cmd_id: {
+                Get_Torques_msg_t msg;
+                msg.decode_buf(frame.data);
+                snapshot_.torque_target = msg.Torque_Target;
+                snapshot_.torque_estimate = msg.Torque_Estimate;
+            } break;
+            case Get_Bus_Voltage_Current_msg_t::cmd_id: {
+                Get_Bus_Voltage_Current_msg_t msg;
+                msg.decode_buf(frame.data);
+                snapshot_.bus_voltage = msg.Bus_Voltage;
+                snapshot_.bus_current = msg.Bus_Current;
+            } break;
+            case Get_Temperature_msg_t::cmd_id: {
+                Get_Temperature_msg_t msg;
+                msg.decode_buf(frame.data);
+                snapshot_.fet_temperature = msg.FET_Temperature;
+                snapshot_.motor_temperature = msg.Motor_Temperature;
+            } break;
+            case Get_Powers_msg_t::cmd_id: {
+                Get_Powers_msg_t msg;
+                msg.decode_buf(frame.data);
+                snapshot_.electrical_power = msg.Electrical_Power;
+                snapshot_.mechanical_power = msg.Mechanical_Power;
+            } break;
+            default:
+                return; // not telemetry (e.g. our own setpoints)
+        }
+        snapshot = snapshot_;
+
+        if (cmd_id == Heartbeat_msg_t::cmd_id) {
+            std::erase_if(state_requests_, [&snapshot](StateRequest& request) {
+                if (request.heartbeats_to_skip-- > 0 || snapshot.procedure_result == PROCEDURE_RESULT_BUSY) {
+                    return false;
+                }
+                bool entered = snapshot.axis_state == request.axis_state;
+                if (is_persistent_state(request.axis_state) && !entered
+                    && snapshot.procedure_result == PROCEDURE_RESULT_SUCCESS) {
+                    return false; // not there yet
+                }
+                if (!is_persistent_state(request.axis_state) && entered) {
+                    return false; // procedure still running
+                }
+                AxisStateResult result;
+                result.success = snapshot.procedure_result == PROCEDURE_RESULT_SUCCESS;
+                result.axis_state = snapshot.axis_state;
+                result.procedure_result = snapshot.procedure_result;
+                result.active_errors = snapshot.active_errors;
+                request.promise.set_value(result);
+                return true;
+            });
+        }
+    }
+
+    if (telemetry_callback_) {
+        telemetry_callback_(cmd_id, snapshot);
+    }
+}
+
+void ODriveAxis::check_state_requests(std::chrono::steady_clock::time_point now) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::erase_if(state_requests_, [this, now](StateRequest& request) {
+        if (now < request.deadline) {
+            return false;
+        }
+        AxisStateResult result;
+        result.timed_out = true;
+        result.axis_state = snapshot_.axis_state;
+        result.procedure_result = snapshot_.procedure_result;
+        result.active_errors = snapshot_.active_errors;
+        request.promise.set_value(result);
+        return true;
+    });
+}
+
+ODriveAxis* ODriveBus::add_axis(uint32_t node_id) {
+    if (node_id >= axes_.size() || axes_[node_id] || thread_.joinable()) {
+        return nullptr;
+    }
+    axes_[node_id].reset(new ODriveAxis(this, node_id));
+    return axes_[node_id].get();
+}
+
+bool ODriveBus::init(const std::string& interface) {
+    if (!can_intf_.init(interface, &event_loop_, std::bind(&ODriveBus::on_can_msg, this, _1))) {
+        return false;
+    }
+    if (!tx_evt_.init(&event_loop_, [this](uint32_t) { on_tx(); })) {
+        can_intf_.deinit();
+        return false;
+    }
+    if (!tick_timer_.init(&event_loop_, std::chrono::milliseconds(10), [this](uint32_t) { on_tick(); })) {
+        tx_evt_.deinit();
+        can_intf_.deinit();
+        return false;
+    }
+    // Tearing everything down on the bus thread ends run_until_empty()
+    if (!stop_evt_.init(&event_loop_, [this](uint32_t) {
+            on_tx();
+            tick_timer_.deinit();
+            tx_evt_.deinit();
+            can_intf_.deinit();
+            stop_evt_.deinit();
+        })) {
+        tick_timer_.deinit();
+        tx_evt_.deinit();
+        can_intf_.deinit();
+        return false;
+    }
+
+    thread_ = std::thread([this]() { event_loop_.run_until_empty(); });
+    return true;
+}
+
+void ODriveBus::deinit() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    stop_evt_.set();
+    thread_.join();
+
+    // Nobody is going to answer the remaining requests
+    for (auto& axis : axes_) {
+        if (axis) axis->check_state_requests(std::chrono::steady_clock::time_point::max());
+    }
+}
+
+void ODriveBus::queue(const can_frame& frame) {
+    {
+        std::lock_guard<std::mutex> guard(tx_mutex_);
+        tx_queue_.push_back(frame);
+    }
+    tx_evt_.set();
+}
+
+void ODriveBus::on_tx() {
+    {
+        std::lock_guard<std::mutex> guard(tx_mutex_);
+        tx_batch_.swap(tx_queue_);
+    }
+    if (tx_batch_.empty()) return;
+    size_t n_sent = can_intf_.send_can_frames(tx_batch_.data(), tx_batch_.size());
+    dropped_frames_ += tx_batch_.size() - n_sent;
+    tx_batch_.clear();
+}
+
+void ODriveBus::on_can_msg(const can_frame& frame) {
+    if (frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG)) return; // not CANSimple telemetry
+
+    if (auto& axis = axes_[(frame.can_id >> 5) & 0x3f]) {
+        axis->on_can_msg(frame, monotonic_ns());
+    }
+}
+
+void ODriveBus::on_tick() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto& axis : axes_) {
+        if (axis) axis->check_state_requests(now);
+    }
+}
@@ -0,0 +1,156 @@
+#include "perf_counters.hpp"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+const char* const kPerfEventNames[kNumPerfEvents] = {
+    "cycles",
+    "instructions",
+    "cache_misses",
+    "task_clock",
+    "context_switches",
+    "page_faults",
+};
+
+std::atomic<bool> PerfCounters::enabled_{false};
+std::atomic<uint32_t> PerfCounters::available_events_{0};
+
+namespace {
+
+struct EventConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+// Indexed by PerfEvent
+constexpr EventConfig kEventConfigs[kNumPerfEvents] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+// Counter group of one thread. All events that can be opened are read with a
+// single read() on the group leader.
+struct ThreadCounters {
+    ~ThreadCounters() {
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    void open() {
+        opened = true;
+        bool exclude_kernel = false;
+        for (size_t i = 0; i < kNumPerfEvents; ++i) {
+            struct perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = kEventConfigs[i].type;
+            attr.config = kEventConfigs[i].config;
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_hv = 1;
+            attr.exclude_kernel = exclude_kernel;
+
+            int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC));
+            if (fd < 0 && (errno == EACCES || errno == EPERM) && !exclude_kernel) {
+                // perf_event_paranoid >= 2 only allows counting user space
+                exclude_kernel = true;
+                attr.exclude_kernel = 1;
+                fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC));
+            }
+            if (fd < 0) {
+                continue; // e.g. no PMU in a VM
+            }
+
+            fds[i] = fd;
+            slots[i] = static_cast<int>(n_open++);
+            if (leader < 0) {
+                leader = fd;
+            }
+        }
+    }
+
+    bool opened = false;
+    int leader = -1;
+    size_t n_open = 0;
+    std::array<int, kNumPerfEvents> fds = {-1, -1, -1, -1, -1, -1};
+    std::array<int, kNumPerfEvents> slots = {-1, -1, -1, -1, -1, -1}; // position in the group read
+};
+
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<PerfRegion>> registry;
+thread_local ThreadCounters thread_counters;
+
+} // namespace
+
+void PerfRegion::add(const uint64_t* begin, const uint64_t* end) {
+    samples_.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < kNumPerfEvents; ++i) {
+        totals_[i].fetch_add(end[i] - begin[i], std::memory_order_relaxed);
+    }
+}
+
+PerfRegionStats PerfRegion::stats() const {
+    PerfRegionStats stats;
+    stats.name = name_;
+    stats.samples = samples_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < kNumPerfEvents; ++i) {
+        stats.totals[i] = totals_[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+PerfRegion* PerfCounters::region(const char* name) {
+    std::lock_guard<std::mutex> guard(registry_mutex);
+    for (auto& region : registry) {
+        if (!std::strcmp(region->name(), name)) {
+            return region.get();
+        }
+    }
+    registry.push_back(std::make_unique<PerfRegion>(name));
+    return registry.back().get();
+}
+
+std::vector<PerfRegionStats> PerfCounters::snapshot() {
+    std::lock_guard<std::mutex> guard(registry_mutex);
+    std::vector<PerfRegionStats> stats;
+    for (auto& region : registry) {
+        stats.push_back(region->stats());
+    }
+    return stats;
+}
+
+bool PerfCounters::read(uint64_t* values) {
+    ThreadCounters& counters = thread_counters;
+    if (!counters.opened) {
+        counters.open();
+        if (counters.leader < 0) {
+            std::cerr << "Failed to open performance counters: " << std::strerror(errno) << std::endl;
+        }
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kNumPerfEvents; ++i) {
+            mask |= counters.fds[i] >= 0 ? 1u << i : 0;
+        }
+        available_events_.fetch_or(mask, std::memory_order_relaxed);
+    }
+    if (counters.leader < 0) {
+        return false;
+    }
+
+    uint64_t buf[1 + kNumPerfEvents]; // nr, values
+    if (::read(counters.leader, buf, sizeof(buf)) < static_cast<ssize_t>((1 + counters.n_open) * sizeof(uint64_t))) {
+        return false;
+    }
+    for (size_t i = 0; i < kNumPerfEvents; ++i) {
+        values[i] = counters.slots[i] >= 0 ? buf[1 + counters.slots[i]] : 0;
+    }
+    return true;
+}
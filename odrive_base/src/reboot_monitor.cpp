@@ -0,0 +1,181 @@
+#include "reboot_monitor.hpp"
+#include "can_helpers.hpp"
+#include "can_simple_messages.hpp"
+#include "odrive_enums.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+static constexpr uint8_t kRxSdoCmdId = 0x004;
+
+// Messages whose effect a reboot reverts to the saved configuration
+static bool is_config_message(uint8_t cmd_id) {
+    switch (cmd_id) {
+        case Set_Controller_Mode_msg_t::cmd_id:
+        case Set_Limits_msg_t::cmd_id:
+        case Set_Traj_Vel_Limit_msg_t::cmd_id:
+        case Set_Traj_Accel_Limits_msg_t::cmd_id:
+        case Set_Traj_Inertia_msg_t::cmd_id:
+        case Set_Pos_Gain_msg_t::cmd_id:
+        case Set_Vel_Gains_msg_t::cmd_id:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// RxSdo writes (opcode 1) replace each other only for the same endpoint
+static bool same_config(const can_frame& a, const can_frame& b) {
+    if (a.can_id != b.can_id) return false;
+    if ((a.can_id & 0x1f) != kRxSdoCmdId) return true;
+    return a.data[1] == b.data[1] && a.data[2] == b.data[2];
+}
+
+void RebootMonitor::reset() {
+    config_.clear();
+    state_request_ = {};
+    position_referenced_ = false;
+    last_heartbeat_ns_ = 0;
+    period_ns_ = 0;
+    last_state_ = 0;
+    probe_due_ = false;
+    have_version_ = false;
+    burst_.clear();
+    recovering_ = false;
+}
+
+void RebootMonitor::on_send(const can_frame& frame) {
+    if (frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG)) return;
+
+    uint8_t cmd_id = frame.can_id & 0x1f;
+    if (cmd_id == Set_Axis_State_msg_t::cmd_id) {
+        Set_Axis_State_msg_t request;
+        request.decode_buf(frame.data);
+        if (request.Axis_Requested_State == AXIS_STATE_HOMING) {
+            position_referenced_ = true;
+        }
+        state_request_ = frame;
+        return;
+    }
+    if (cmd_id == Set_Absolute_Position_msg_t::cmd_id) {
+        position_referenced_ = true;
+        return;
+    }
+    if (!is_config_message(cmd_id) && !(cmd_id == kRxSdoCmdId && frame.data[0] == 1)) {
+        return; // setpoints and everything else that is not kept across a reboot either way
+    }
+
+    auto it = std::find_if(config_.begin(), config_.end(), [&](const can_frame& cached) {
+        return same_config(cached, frame);
+    });
+    if (it != config_.end()) {
+        *it = frame;
+    } else {
+        config_.push_back(frame);
+    }
+}
+
+RebootMonitor::Event RebootMonitor::on_heartbeat(const can_frame& frame, uint64_t now_ns) {
+    if (frame.can_dlc < Heartbeat_msg_t::msg_length) return Event::kNone;
+    Heartbeat_msg_t msg;
+    msg.decode_buf(frame.data);
+
+    bool silence = false;
+    if (!last_heartbeat_ns_) {
+        probe_due_ = true; // cache the version to compare against
+    } else {
+        uint64_t gap = now_ns - last_heartbeat_ns_;
+        silence = gap >= std::max(min_silence_ns_, 3 * period_ns_);
+        probe_due_ |= silence;
+        // A raised heartbeat period is only taken for a silence once
+        period_ns_ = gap;
+    }
+
+    Event event = Event::kNone;
+    bool idle = msg.Axis_State == AXIS_STATE_IDLE && !msg.Axis_Error;
+    if (idle && last_state_ == AXIS_STATE_CLOSED_LOOP_CONTROL && !requested(AXIS_STATE_IDLE)) {
+        event = detect(Cause::kStateRegression, now_ns);
+    } else if (idle && silence && !recovering_ && !config_.empty()) {
+        burst_ = config_;
+        event = Event::kRefresh;
+    }
+
+    if (event == Event::kNone && recovering_ && heartbeats_to_skip_-- <= 0
+        && msg.Procedure_Result != PROCEDURE_RESULT_BUSY) {
+        // The heartbeat after the burst may have been sent before it arrived
+        bool armed = msg.Axis_State == AXIS_STATE_CLOSED_LOOP_CONTROL;
+        bool refused = msg.Procedure_Result != PROCEDURE_RESULT_SUCCESS;
+        if (!recovery_.rearm || armed || refused || ++recovery_heartbeats_ >= kMaxRecoveryHeartbeats) {
+            recovery_.recovered_ns = now_ns;
+            recovery_.success = !recovery_.rearm_refused && (!recovery_.rearm || armed);
+            recovering_ = false;
+            event = Event::kRecovered;
+        }
+    }
+
+    last_heartbeat_ns_ = now_ns;
+    last_state_ = msg.Axis_State;
+    return event;
+}
+
+RebootMonitor::Event RebootMonitor::on_version(const can_frame& frame, uint64_t now_ns) {
+    // Requests (RTR) from this or another host carry no version
+    if ((frame.can_id & CAN_RTR_FLAG) || frame.can_dlc < Get_Version_msg_t::msg_length) return Event::kNone;
+
+    bool changed = have_version_ && std::memcmp(version_, frame.data, sizeof(version_)) != 0;
+    std::memcpy(version_, frame.data, sizeof(version_));
+    have_version_ = true;
+    if (!changed || recovering_) {
+        return Event::kNone; // a reboot that was already detected from the heartbeat
+    }
+    return detect(Cause::kVersionChange, now_ns);
+}
+
+bool RebootMonitor::take_version_probe() {
+    return std::exchange(probe_due_, false);
+}
+
+can_frame RebootMonitor::version_request(uint32_t node_id) {
+    can_frame frame = {};
+    frame.can_id = node_id << 5 | Get_Version_msg_t::cmd_id | CAN_RTR_FLAG;
+    frame.can_dlc = Get_Version_msg_t::msg_length;
+    return frame;
+}
+
+RebootMonitor::Event RebootMonitor::detect(Cause cause, uint64_t now_ns) {
+    reboots_++;
+    recovery_ = Recovery();
+    recovery_.cause = cause;
+    recovery_.last_heartbeat_ns = last_heartbeat_ns_;
+    recovery_.detected_ns = now_ns;
+    // Only a state regression shows that the axis was armed
+    bool rearm = rearm_enabled_ && cause == Cause::kStateRegression && requested(AXIS_STATE_CLOSED_LOOP_CONTROL);
+    // The axis would run on a position that no longer means the same
+    recovery_.rearm_refused = rearm && position_referenced_;
+    recovery_.rearm = rearm && !recovery_.rearm_refused;
+
+    burst_ = config_;
+    if (recovery_.rearm) {
+        burst_.push_back(state_request_);
+    }
+    recovering_ = true;
+    heartbeats_to_skip_ = 1;
+    recovery_heartbeats_ = 0;
+    return Event::kReboot;
+}
+
+bool RebootMonitor::requested(uint8_t state) const {
+    if (!state_request_.can_dlc) return false;
+    Set_Axis_State_msg_t request;
+    request.decode_buf(state_request_.data);
+    return request.Axis_Requested_State == state;
+}
+
+const char* RebootMonitor::cause_name(Cause cause) {
+    switch (cause) {
+        case Cause::kNone: return "none";
+        case Cause::kStateRegression: return "state regression";
+        case Cause::kVersionChange: return "version change";
+    }
+    return "unknown";
+}
@@ -0,0 +1,190 @@
+#include "shared_can_bus.hpp"
+#include "command_schedule.hpp"
+#include "tracer.hpp"
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+std::shared_ptr<SharedCanBus> SharedCanBus::acquire(const std::string& interface) {
+    static std::mutex registry_mutex;
+    static std::map<std::string, std::weak_ptr<SharedCanBus>> registry;
+
+    std::lock_guard<std::mutex> guard(registry_mutex);
+    if (auto bus = registry[interface].lock()) {
+        return bus;
+    }
+
+    std::shared_ptr<SharedCanBus> bus(new SharedCanBus());
+    bus->interface_ = interface;
+    if (!bus->can_intf_.init(interface, &bus->event_loop_, std::bind(&SharedCanBus::on_can_msg, bus.get(), _1))) {
+        return nullptr;
+    }
+    registry[interface] = bus;
+    return bus;
+}
+
+SharedCanBus::~SharedCanBus() {
+    flush();
+    can_intf_.deinit();
+}
+
+bool SharedCanBus::attach(uint32_t node_id, const void* owner, FrameProcessor processor) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    if (node_id >= routes_.size() || (routes_[node_id].owner && routes_[node_id].owner != owner)) {
+        return false;
+    }
+    routes_[node_id] = {owner, std::move(processor)};
+    if (std::find(owners_.begin(), owners_.end(), owner) == owners_.end()) {
+        owners_.push_back(owner);
+    }
+    return true;
+}
+
+void SharedCanBus::detach(const void* owner) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    for (auto& route : routes_) {
+        if (route.owner == owner) {
+            route = Route();
+        }
+    }
+    std::erase_if(tx_echo_processors_, [owner](const auto& p) { return p.first == owner; });
+    std::erase(owners_, owner);
+    std::erase(committed_, owner);
+    if (std::erase_if(schedules_, [owner](const Schedule& s) { return s.owner == owner; })) {
+        plan_schedules();
+    }
+}
+
+bool SharedCanBus::add_tx_echo_processor(const void* owner, TxEchoProcessor processor) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    if (tx_echo_processors_.empty()
+        && !can_intf_.enable_tx_echo(std::bind(&SharedCanBus::on_tx_echo, this, _1, std::placeholders::_2))) {
+        return false;
+    }
+    tx_echo_processors_.emplace_back(owner, std::move(processor));
+    return true;
+}
+
+size_t SharedCanBus::poll() {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    // Catch up on batches whose owners did not all commit (e.g. inactive components)
+    flush();
+
+    size_t n_frames = 0;
+    while (can_intf_.read_nonblocking()) {
+        n_frames++; // repeat until CAN interface has no more messages
+    }
+    return n_frames;
+}
+
+void SharedCanBus::queue(const can_frame& frame) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    ODRIVE_TRACE_INSTANT("tx_enqueue", frame.can_id);
+    tx_queue_.push_back(frame);
+}
+
+void SharedCanBus::queue_burst(const can_frame* frames, size_t n_frames) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    ODRIVE_TRACE_INSTANT("tx_enqueue_burst", n_frames);
+    tx_burst_.insert(tx_burst_.end(), frames, frames + n_frames);
+}
+
+void SharedCanBus::flush() {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    send_pending(&tx_queue_);
+    // The burst only goes out behind everything queued before it
+    if (tx_queue_.empty()) {
+        send_pending(&tx_burst_);
+    } else if (tx_burst_.size() > kMaxPendingFrames) {
+        tx_failures_ += tx_burst_.size() - kMaxPendingFrames;
+        tx_burst_.erase(tx_burst_.begin(), tx_burst_.end() - kMaxPendingFrames);
+    }
+}
+
+void SharedCanBus::send_pending(std::vector<can_frame>* frames) {
+    if (frames->empty()) return;
+    size_t n_sent = can_intf_.send_can_frames(frames->data(), frames->size());
+    // Unsent frames are retried by the next flush, the oldest are given up
+    // once too many piled up (e.g. the interface is down)
+    size_t n_dropped = frames->size() - n_sent > kMaxPendingFrames ? frames->size() - n_sent - kMaxPendingFrames : 0;
+    tx_failures_ += n_dropped;
+    frames->erase(frames->begin(), frames->begin() + n_sent + n_dropped);
+}
+
+uint64_t SharedCanBus::tx_failures() const {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    return tx_failures_;
+}
+
+uint64_t SharedCanBus::begin_cycle(const void* owner) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    // An owner that already committed starts the next cycle, e.g. because
+    // another owner is inactive and never commits
+    if (std::find(committed_.begin(), committed_.end(), owner) != committed_.end()) {
+        flush();
+        committed_.clear();
+        cycle_++;
+    }
+    return cycle_;
+}
+
+void SharedCanBus::commit(const void* owner) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    if (std::find(committed_.begin(), committed_.end(), owner) == committed_.end()) {
+        committed_.push_back(owner);
+    }
+    if (committed_.size() >= owners_.size()) {
+        flush();
+        committed_.clear();
+        cycle_++;
+    }
+}
+
+void SharedCanBus::set_command_dividers(const void* owner, const std::vector<uint32_t>& dividers) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    auto it = std::find_if(schedules_.begin(), schedules_.end(), [owner](const Schedule& s) { return s.owner == owner; });
+    if (it == schedules_.end()) {
+        it = schedules_.insert(schedules_.end(), Schedule{owner, {}, {}});
+    }
+    it->dividers = dividers;
+    plan_schedules();
+}
+
+void SharedCanBus::command_phases(const void* owner, std::vector<uint32_t>* phases) const {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    auto it = std::find_if(schedules_.begin(), schedules_.end(), [owner](const Schedule& s) { return s.owner == owner; });
+    if (it != schedules_.end()) {
+        phases->assign(it->phases.begin(), it->phases.end());
+    } else {
+        phases->clear();
+    }
+}
+
+void SharedCanBus::plan_schedules() {
+    std::vector<uint32_t> dividers;
+    for (const Schedule& schedule : schedules_) {
+        dividers.insert(dividers.end(), schedule.dividers.begin(), schedule.dividers.end());
+    }
+    std::vector<uint32_t> phases = plan_command_phases(dividers);
+    auto phase = phases.begin();
+    for (Schedule& schedule : schedules_) {
+        schedule.phases.assign(phase, phase + schedule.dividers.size());
+        phase += schedule.dividers.size();
+    }
+}
+
+void SharedCanBus::on_can_msg(const can_frame& frame) {
+    if (frame.can_id & CAN_EFF_FLAG) return; // not CANSimple
+
+    Route& route = routes_[(frame.can_id >> 5) & 0x3f];
+    if (route.processor) {
+        ODRIVE_TRACE_SCOPE_ARG("route", frame.can_id);
+        route.processor(frame);
+    }
+}
+
+void SharedCanBus::on_tx_echo(const can_frame& frame, uint64_t timestamp_ns) {
+    for (auto& [owner, processor] : tx_echo_processors_) {
+        processor(frame, timestamp_ns);
+    }
+}
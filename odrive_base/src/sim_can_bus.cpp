@@ -0,0 +1,308 @@
+#include "sim_can_bus.hpp"
+#include "can_backend.hpp"
+#include "can_mux.hpp"
+#include "tracer.hpp"
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <ctime>
+#include <iostream>
+#include <map>
+
+// Resolution of the cyclic message timing, same as the firmware's msg_rate_ms
+static constexpr std::chrono::milliseconds kTickPeriod{1};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+std::shared_ptr<SimCanBus> SimCanBus::acquire(const std::string& name) {
+    static std::mutex registry_mutex;
+    static std::map<std::string, std::weak_ptr<SimCanBus>> registry;
+
+    std::lock_guard<std::mutex> guard(registry_mutex);
+    if (auto bus = registry[name].lock()) {
+        return bus;
+    }
+
+    std::shared_ptr<SimCanBus> bus(new SimCanBus());
+    registry[name] = bus;
+    return bus;
+}
+
+SimCanBus::~SimCanBus() {
+    if (thread_.joinable()) {
+        stop_evt_.set();
+        thread_.join();
+    }
+}
+
+bool SimCanBus::add_drive(uint32_t node_id, const SimODriveConfig& config) {
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (node_id >= drives_.size() || drives_[node_id]) {
+            return false;
+        }
+        drives_[node_id] = std::make_unique<SimODrive>(node_id, config, now_ns());
+    }
+
+    if (thread_.joinable()) {
+        return true;
+    }
+
+    // Tearing down the timer and this event on the loop thread leaves the loop
+    // without events, which ends run_until_empty().
+    if (!tick_timer_.init(&event_loop_, kTickPeriod, [this](uint32_t) { on_tick(); })) {
+        remove_drive(node_id);
+        return false;
+    }
+    if (!stop_evt_.init(&event_loop_, [this](uint32_t) {
+            tick_timer_.deinit();
+            stop_evt_.deinit();
+        })) {
+        tick_timer_.deinit();
+        remove_drive(node_id);
+        return false;
+    }
+    thread_ = std::thread([this]() { event_loop_.run_until_empty(); });
+    return true;
+}
+
+void SimCanBus::remove_drive(uint32_t node_id) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (node_id < drives_.size()) {
+        drives_[node_id].reset();
+    }
+}
+
+void SimCanBus::attach(SimCanClient* client) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    clients_.push_back(client);
+}
+
+void SimCanBus::detach(SimCanClient* client) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::erase(clients_, client);
+}
+
+void SimCanBus::send(SimCanClient* sender, const can_frame& frame) {
+    uint64_t now = now_ns();
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    frames_.clear();
+    frames_.push_back(frame);
+    deliver(sender, frames_);
+    if (sender->tx_echo_) {
+        sender->push(frame, now);
+    }
+
+    uint32_t node_id = (frame.can_id & CAN_SFF_MASK) >> 5;
+    if (!(frame.can_id & CAN_EFF_FLAG) && drives_[node_id]) {
+        frames_.clear();
+        drives_[node_id]->on_can_frame(frame, now, &frames_);
+        deliver(nullptr, frames_);
+    }
+}
+
+void SimCanBus::deliver(SimCanClient* sender, const std::vector<can_frame>& frames) {
+    for (SimCanClient* client : clients_) {
+        if (client == sender) {
+            continue;
+        }
+        for (const can_frame& frame : frames) {
+            client->push(frame, 0);
+        }
+    }
+}
+
+void SimCanBus::on_tick() {
+    uint64_t now = now_ns();
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    frames_.clear();
+    for (auto& drive : drives_) {
+        if (drive) {
+            drive->step(now, &frames_);
+        }
+    }
+    deliver(nullptr, frames_);
+}
+
+bool SimCanClient::connect(const std::string& bus) {
+    rx_evt_fd_ = eventfd(0, EFD_NONBLOCK);
+    if (rx_evt_fd_ < 0) {
+        std::cerr << "Failed to create eventfd" << std::endl;
+        return false;
+    }
+    bus_ = SimCanBus::acquire(bus);
+    bus_->attach(this);
+    return true;
+}
+
+void SimCanClient::disconnect() {
+    if (bus_) {
+        bus_->detach(this);
+        bus_.reset();
+    }
+    if (rx_evt_fd_ >= 0) {
+        close(rx_evt_fd_);
+        rx_evt_fd_ = -1;
+    }
+    std::lock_guard<std::mutex> guard(mutex_);
+    rx_queue_.clear();
+}
+
+bool SimCanClient::set_filters(const std::vector<can_filter>& filters) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    filters_ = filters;
+    return true;
+}
+
+bool SimCanClient::send(const can_frame& frame) {
+    bus_->send(this, frame);
+    return true;
+}
+
+bool SimCanClient::receive(can_frame* frame, uint64_t* echo_timestamp_ns) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (rx_queue_.empty()) {
+        return false;
+    }
+    *frame = rx_queue_.front().frame;
+    *echo_timestamp_ns = rx_queue_.front().echo_timestamp_ns;
+    rx_queue_.pop_front();
+    return true;
+}
+
+void SimCanClient::clear_rx_event() {
+    uint64_t value;
+    if (read(rx_evt_fd_, &value, sizeof(value)) != sizeof(value)) {
+        // nothing pending
+    }
+}
+
+uint64_t SimCanClient::rx_dropped() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return rx_dropped_;
+}
+
+void SimCanClient::push(const can_frame& frame, uint64_t echo_timestamp_ns) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!echo_timestamp_ns && !can_mux_match(filters_.data(), filters_.size(), frame)) {
+        return;
+    }
+    if (rx_queue_.size() >= kMaxQueuedFrames) {
+        rx_dropped_++;
+        return;
+    }
+    rx_queue_.push_back({frame, echo_timestamp_ns});
+    if (rx_queue_.size() == 1) {
+        uint64_t value = 1;
+        if (write(rx_evt_fd_, &value, sizeof(value)) != sizeof(value)) {
+            std::cerr << "Failed to signal sim CAN client" << std::endl;
+        }
+    }
+}
+
+namespace {
+
+// "sim:<bus>"
+class SimCanBackend : public CanBackend {
+public:
+    ~SimCanBackend() override { deinit(); }
+
+    bool init(const std::string& name, EpollEventLoop* event_loop, FrameProcessor frame_processor) override {
+        event_loop_ = event_loop;
+        frame_processor_ = std::move(frame_processor);
+        if (!sim_.connect(name)) {
+            return false;
+        }
+        connected_ = true;
+
+        if (!event_loop_->register_event(&rx_evt_id_, sim_.rx_event_fd(), EPOLLIN, [this](uint32_t mask) { on_rx_event(mask); })) {
+            std::cerr << "Failed to register simulated CAN bus with event loop" << std::endl;
+            deinit();
+            return false;
+        }
+        return true;
+    }
+
+    void deinit() override {
+        if (rx_evt_id_) {
+            event_loop_->deregister_event(rx_evt_id_);
+            rx_evt_id_ = nullptr;
+        }
+        if (connected_) {
+            sim_.disconnect();
+            connected_ = false;
+        }
+    }
+
+    bool send_can_frame(const can_frame& frame) override {
+        return connected_ && sim_.send(frame);
+    }
+
+    size_t send_can_frames(const can_frame* frames, size_t n_frames) override {
+        size_t n_sent = 0;
+        while (n_sent < n_frames && send_can_frame(frames[n_sent])) {
+            n_sent++;
+        }
+        return n_sent;
+    }
+
+    bool enable_tx_echo(TxEchoProcessor tx_echo_processor) override {
+        sim_.enable_tx_echo();
+        tx_echo_processor_ = std::move(tx_echo_processor);
+        return true;
+    }
+
+    bool enable_rx_timestamps() override {
+        return false; // frames are not timestamped on arrival
+    }
+
+    bool set_filters(const std::vector<can_filter>& filters) override {
+        return sim_.set_filters(filters);
+    }
+
+    bool read_nonblocking() override {
+        struct can_frame frame;
+        uint64_t echo_timestamp_ns;
+        if (!connected_ || !sim_.receive(&frame, &echo_timestamp_ns)) {
+            return false;
+        }
+        if (echo_timestamp_ns) {
+            if (tx_echo_processor_) {
+                tx_echo_processor_(frame, echo_timestamp_ns);
+            }
+            return true;
+        }
+        ODRIVE_TRACE_SCOPE_ARG("can_rx", frame.can_id);
+        frame_processor_(frame);
+        return true;
+    }
+
+private:
+    void on_rx_event(uint32_t mask) {
+        if (mask & ~EPOLLIN) {
+            std::cerr << "unexpected event " << mask << std::endl;
+            deinit();
+            return;
+        }
+        sim_.clear_rx_event();
+        while (read_nonblocking());
+    }
+
+    SimCanClient sim_;
+    bool connected_ = false;
+    EpollEventLoop* event_loop_ = nullptr;
+    EpollEventLoop::EvtId rx_evt_id_ = nullptr;
+    FrameProcessor frame_processor_;
+    TxEchoProcessor tx_echo_processor_;
+};
+
+} // namespace
+
+void register_sim_can_backend() {
+    register_can_backend("sim:", [] { return std::unique_ptr<CanBackend>(new SimCanBackend()); });
+}
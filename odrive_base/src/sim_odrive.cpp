@@ -0,0 +1,499 @@
+#include "sim_odrive.hpp"
+#include "can_simple_messages.hpp"
+#include "odrive_enums.h"
+#include <algorithm>
+#include <cmath>
+
+// The firmware runs its control loop at 8 kHz
+static constexpr uint64_t kControlPeriodNs = 125000;
+static constexpr double kControlPeriod = kControlPeriodNs * 1e-9;
+
+// Longest stretch that step() catches up on, e.g. after the host stalled
+static constexpr uint64_t kMaxCatchUpNs = 100000000;
+
+static constexpr uint8_t kCyclicCmdIds[kNumCyclicMessages] = {
+    Heartbeat_msg_t::cmd_id,
+    Get_Encoder_Estimates_msg_t::cmd_id,
+    Get_Iq_msg_t::cmd_id,
+    Get_Torques_msg_t::cmd_id,
+    Get_Error_msg_t::cmd_id,
+    Get_Temperature_msg_t::cmd_id,
+    Get_Bus_Voltage_Current_msg_t::cmd_id,
+    Get_Powers_msg_t::cmd_id,
+};
+
+static double move_towards(double value, double target, double max_step) {
+    return value + std::clamp(target - value, -max_step, max_step);
+}
+
+SimODrive::SimODrive(uint32_t node_id, const SimODriveConfig& config, uint64_t now_ns)
+    : node_id_(node_id),
+      config_(config),
+      sim_time_ns_(now_ns),
+      calibrated_(config.calibrated),
+      pos_(config.position) {
+    saved_.control_mode = CONTROL_MODE_POSITION_CONTROL;
+    saved_.input_mode = INPUT_MODE_PASSTHROUGH;
+    saved_.current_limit = config.current_limit;
+    saved_.vel_limit = config.vel_limit;
+    saved_.pos_gain = config.pos_gain;
+    saved_.vel_gain = config.vel_gain;
+    saved_.vel_integrator_gain = config.vel_integrator_gain;
+    saved_.traj_vel_limit = config.traj_vel_limit;
+    saved_.traj_accel_limit = config.traj_accel_limit;
+    saved_.traj_decel_limit = config.traj_decel_limit;
+    saved_.traj_inertia = config.traj_inertia;
+    saved_.msg_rate_ms = config.msg_rate_ms;
+    settings_ = saved_;
+    next_msg_ns_.fill(now_ns);
+    input_pos_ = pos_setpoint_ = pos_;
+}
+
+void SimODrive::on_can_frame(const can_frame& frame, uint64_t now_ns, std::vector<can_frame>* out) {
+    if (now_ns < booting_until_ns_) {
+        return;
+    }
+
+    uint8_t cmd_id = frame.can_id & 0x1f;
+    if (frame.can_id & CAN_RTR_FLAG) {
+        can_frame reply;
+        if (encode_message(cmd_id, &reply)) {
+            out->push_back(reply);
+        }
+        return;
+    }
+
+    switch (cmd_id) {
+        case Estop_msg_t::cmd_id: {
+            disarm(ODRIVE_ERROR_ESTOP_REQUESTED);
+        } break;
+        case 0x004: { // RxSdo, only writes of the message rates
+            if (frame.can_dlc < 8 || can_get_signal_raw<uint8_t>(frame.data, 0, 8, true) != 1) {
+                break;
+            }
+            int32_t endpoint_id = can_get_signal_raw<uint16_t>(frame.data, 8, 16, true);
+            for (size_t i = 0; i < kNumCyclicMessages; ++i) {
+                if (config_.endpoint_ids[i] == endpoint_id) {
+                    settings_.msg_rate_ms[i] = can_get_signal_raw<uint32_t>(frame.data, 32, 32, true);
+                    next_msg_ns_[i] = now_ns;
+                }
+            }
+        } break;
+        case Set_Axis_State_msg_t::cmd_id: {
+            Set_Axis_State_msg_t msg;
+            msg.decode_buf(frame.data);
+            request_state(msg.Axis_Requested_State, now_ns);
+        } break;
+        case Set_Controller_Mode_msg_t::cmd_id: {
+            Set_Controller_Mode_msg_t msg;
+            msg.decode_buf(frame.data);
+            settings_.control_mode = msg.Control_Mode;
+            settings_.input_mode = msg.Input_Mode;
+        } break;
+        case Set_Input_Pos_msg_t::cmd_id: {
+            Set_Input_Pos_msg_t msg;
+            msg.decode_buf(frame.data);
+            input_pos_ = msg.Input_Pos;
+            input_vel_ = msg.Vel_FF;
+            input_torque_ = msg.Torque_FF;
+            if (settings_.input_mode == INPUT_MODE_TRAP_TRAJ && axis_state_ == AXIS_STATE_CLOSED_LOOP_CONTROL) {
+                trajectory_.plan(
+                    input_pos_,
+                    pos_setpoint_,
+                    vel_setpoint_,
+                    settings_.traj_vel_limit,
+                    settings_.traj_accel_limit,
+                    settings_.traj_decel_limit
+                );
+                trajectory_time_ = 0.0;
+                trajectory_done_ = false;
+            }
+        } break;
+        case Set_Input_Vel_msg_t::cmd_id: {
+            Set_Input_Vel_msg_t msg;
+            msg.decode_buf(frame.data);
+            input_vel_ = msg.Input_Vel;
+            input_torque_ = msg.Input_Torque_FF;
+        } break;
+        case Set_Input_Torque_msg_t::cmd_id: {
+            Set_Input_Torque_msg_t msg;
+            msg.decode_buf(frame.data);
+            input_torque_ = msg.Input_Torque;
+        } break;
+        case Set_Limits_msg_t::cmd_id: {
+            Set_Limits_msg_t msg;
+            msg.decode_buf(frame.data);
+            settings_.vel_limit = msg.Velocity_Limit;
+            settings_.current_limit = msg.Current_Limit;
+        } break;
+        case Set_Traj_Vel_Limit_msg_t::cmd_id: {
+            Set_Traj_Vel_Limit_msg_t msg;
+            msg.decode_buf(frame.data);
+            settings_.traj_vel_limit = msg.Traj_Vel_Limit;
+        } break;
+        case Set_Traj_Accel_Limits_msg_t::cmd_id: {
+            Set_Traj_Accel_Limits_msg_t msg;
+            msg.decode_buf(frame.data);
+            settings_.traj_accel_limit = msg.Traj_Accel_Limit;
+            settings_.traj_decel_limit = msg.Traj_Decel_Limit;
+        } break;
+        case Set_Traj_Inertia_msg_t::cmd_id: {
+            Set_Traj_Inertia_msg_t msg;
+            msg.decode_buf(frame.data);
+            settings_.traj_inertia = msg.Traj_Inertia;
+        } break;
+        case Reboot_msg_t::cmd_id: {
+            Reboot_msg_t msg;
+            msg.decode_buf(frame.data);
+            if (msg.Action == 1) { // save configuration
+                if (axis_state_ != AXIS_STATE_IDLE) break;
+                saved_ = settings_;
+            }
+            reboot(now_ns);
+        } break;
+        case Clear_Errors_msg_t::cmd_id: {
+            active_errors_ = 0;
+            disarm_reason_ = 0;
+        } break;
+        case Set_Absolute_Position_msg_t::cmd_id: {
+            Set_Absolute_Position_msg_t msg;
+            msg.decode_buf(frame.data);
+            double offset = msg.Position - pos_;
+            pos_ += offset;
+            pos_setpoint_ += offset;
+            input_pos_ += offset;
+        } break;
+        case Set_Pos_Gain_msg_t::cmd_id: {
+            Set_Pos_Gain_msg_t msg;
+            msg.decode_buf(frame.data);
+            settings_.pos_gain = msg.Pos_Gain;
+        } break;
+        case Set_Vel_Gains_msg_t::cmd_id: {
+            Set_Vel_Gains_msg_t msg;
+            msg.decode_buf(frame.data);
+            settings_.vel_gain = msg.Vel_Gain;
+            settings_.vel_integrator_gain = msg.Vel_Integrator_Gain;
+        } break;
+        default:
+            break; // not simulated
+    }
+}
+
+void SimODrive::request_state(uint32_t state, uint64_t now_ns) {
+    if (state == AXIS_STATE_UNDEFINED) {
+        return;
+    }
+    if (state == AXIS_STATE_IDLE) {
+        if (axis_state_ != AXIS_STATE_IDLE && axis_state_ != AXIS_STATE_CLOSED_LOOP_CONTROL) {
+            procedure_result_ = PROCEDURE_RESULT_CANCELLED;
+        }
+        axis_state_ = AXIS_STATE_IDLE;
+        return;
+    }
+    if (disarm_reason_) {
+        procedure_result_ = PROCEDURE_RESULT_DISARMED;
+        axis_state_ = AXIS_STATE_IDLE;
+        return;
+    }
+    if (state == AXIS_STATE_CLOSED_LOOP_CONTROL) {
+        if (!calibrated_) {
+            procedure_result_ = PROCEDURE_RESULT_NOT_CALIBRATED;
+            axis_state_ = AXIS_STATE_IDLE;
+            return;
+        }
+        if (axis_state_ != AXIS_STATE_CLOSED_LOOP_CONTROL) {
+            enter_closed_loop();
+        }
+        procedure_result_ = PROCEDURE_RESULT_SUCCESS;
+        return;
+    }
+
+    // Calibration, homing etc. run for a while and end in IDLE
+    axis_state_ = state;
+    procedure_result_ = PROCEDURE_RESULT_BUSY;
+    procedure_end_ns_ = now_ns + static_cast<uint64_t>(config_.procedure_s * 1e9);
+}
+
+void SimODrive::enter_closed_loop() {
+    axis_state_ = AXIS_STATE_CLOSED_LOOP_CONTROL;
+    input_pos_ = pos_setpoint_ = pos_;
+    input_vel_ = vel_setpoint_ = 0.0;
+    input_torque_ = torque_setpoint_ = 0.0;
+    vel_integrator_torque_ = 0.0;
+    trajectory_done_ = true;
+}
+
+void SimODrive::disarm(uint32_t error) {
+    active_errors_ |= error;
+    disarm_reason_ = error;
+    procedure_result_ = PROCEDURE_RESULT_DISARMED;
+    axis_state_ = AXIS_STATE_IDLE;
+}
+
+void SimODrive::reboot(uint64_t now_ns) {
+    settings_ = saved_;
+    axis_state_ = AXIS_STATE_IDLE;
+    procedure_result_ = PROCEDURE_RESULT_SUCCESS;
+    calibrated_ = config_.calibrated;
+    active_errors_ = 0;
+    disarm_reason_ = 0;
+    booting_until_ns_ = now_ns + static_cast<uint64_t>(config_.boot_s * 1e9);
+    next_msg_ns_.fill(booting_until_ns_);
+}
+
+void SimODrive::step(uint64_t now_ns, std::vector<can_frame>* out) {
+    if (now_ns > sim_time_ns_ + kMaxCatchUpNs) {
+        sim_time_ns_ = now_ns - kMaxCatchUpNs;
+    }
+    while (sim_time_ns_ + kControlPeriodNs <= now_ns) {
+        sim_time_ns_ += kControlPeriodNs;
+        if (axis_state_ != AXIS_STATE_IDLE && axis_state_ != AXIS_STATE_CLOSED_LOOP_CONTROL
+            && sim_time_ns_ >= procedure_end_ns_) {
+            axis_state_ = AXIS_STATE_IDLE;
+            procedure_result_ = PROCEDURE_RESULT_SUCCESS;
+            calibrated_ = true;
+        }
+        update_input(kControlPeriod);
+        simulate(kControlPeriod);
+    }
+
+    if (now_ns < booting_until_ns_) {
+        return;
+    }
+    for (size_t i = 0; i < kNumCyclicMessages; ++i) {
+        uint32_t rate_ms = settings_.msg_rate_ms[i];
+        if (!rate_ms || now_ns < next_msg_ns_[i]) {
+            continue;
+        }
+        can_frame frame;
+        if (encode_message(kCyclicCmdIds[i], &frame)) {
+            out->push_back(frame);
+        }
+        next_msg_ns_[i] += rate_ms * 1000000ull;
+        if (next_msg_ns_[i] <= now_ns) {
+            next_msg_ns_[i] = now_ns + rate_ms * 1000000ull; // fell behind, don't burst
+        }
+    }
+}
+
+void SimODrive::update_input(double dt) {
+    if (axis_state_ != AXIS_STATE_CLOSED_LOOP_CONTROL) {
+        return;
+    }
+
+    switch (settings_.input_mode) {
+        case INPUT_MODE_VEL_RAMP: {
+            vel_setpoint_ = move_towards(vel_setpoint_, input_vel_, config_.vel_ramp_rate * dt);
+            torque_setpoint_ = input_torque_;
+        } break;
+        case INPUT_MODE_TORQUE_RAMP: {
+            torque_setpoint_ = move_towards(torque_setpoint_, input_torque_, config_.torque_ramp_rate * dt);
+        } break;
+        case INPUT_MODE_POS_FILTER: {
+            // Critically damped second order filter, as in the firmware
+            double ki = 2.0 * config_.input_filter_bandwidth;
+            double kp = 0.25 * ki * ki;
+            double accel = kp * (input_pos_ - pos_setpoint_) + ki * (input_vel_ - vel_setpoint_);
+            torque_setpoint_ = input_torque_ + accel * settings_.traj_inertia;
+            vel_setpoint_ += dt * accel;
+            pos_setpoint_ += dt * vel_setpoint_;
+        } break;
+        case INPUT_MODE_TRAP_TRAJ: {
+            if (trajectory_done_) {
+                break;
+            }
+            trajectory_time_ += dt;
+            double accel;
+            trajectory_.eval(trajectory_time_, &pos_setpoint_, &vel_setpoint_, &accel);
+            torque_setpoint_ = accel * settings_.traj_inertia;
+            if (trajectory_time_ >= trajectory_.t_total) {
+                trajectory_done_ = true;
+            }
+        } break;
+        default: { // passthrough and everything that is not simulated
+            pos_setpoint_ = input_pos_;
+            vel_setpoint_ = input_vel_;
+            torque_setpoint_ = input_torque_;
+        } break;
+    }
+}
+
+void SimODrive::simulate(double dt) {
+    double torque = 0.0;
+    if (axis_state_ == AXIS_STATE_CLOSED_LOOP_CONTROL) {
+        // Cascaded position => velocity => torque controller
+        double vel_des = vel_setpoint_;
+        if (settings_.control_mode >= CONTROL_MODE_POSITION_CONTROL) {
+            vel_des += settings_.pos_gain * (pos_setpoint_ - pos_);
+        }
+        vel_des = std::clamp(vel_des, -settings_.vel_limit, settings_.vel_limit);
+
+        torque = torque_setpoint_;
+        if (settings_.control_mode >= CONTROL_MODE_VELOCITY_CONTROL) {
+            double vel_error = vel_des - vel_;
+            torque += settings_.vel_gain * vel_error + vel_integrator_torque_;
+            vel_integrator_torque_ += settings_.vel_integrator_gain * dt * vel_error;
+        }
+
+        double torque_limit = settings_.current_limit * config_.torque_constant;
+        if (std::abs(torque) > torque_limit) {
+            torque = std::clamp(torque, -torque_limit, torque_limit);
+            vel_integrator_torque_ *= 0.99; // anti-windup, as in the firmware
+        }
+    } else {
+        vel_integrator_torque_ = 0.0;
+    }
+    torque_target_ = torque;
+
+    // Rigid rotor with viscous and Coulomb friction
+    double drive = torque - config_.viscous_friction * vel_;
+    if (vel_ == 0.0 && std::abs(drive) <= config_.coulomb_friction) {
+        drive = 0.0; // sticking
+    } else {
+        drive -= std::copysign(config_.coulomb_friction, vel_ != 0.0 ? vel_ : drive);
+    }
+    double new_vel = vel_ + dt * drive / config_.inertia;
+    if (vel_ != 0.0 && std::signbit(new_vel) != std::signbit(vel_) && std::abs(torque) <= config_.coulomb_friction) {
+        new_vel = 0.0; // friction stops the rotor instead of reversing it
+    }
+    vel_ = new_vel;
+    pos_ += dt * vel_;
+
+    if (axis_state_ == AXIS_STATE_CLOSED_LOOP_CONTROL && config_.vel_limit_tolerance > 0.0
+        && std::abs(vel_) > settings_.vel_limit * config_.vel_limit_tolerance) {
+        disarm(ODRIVE_ERROR_VELOCITY_LIMIT_VIOLATION);
+    }
+}
+
+bool SimODrive::encode_message(uint8_t cmd_id, can_frame* frame) const {
+    frame->can_id = node_id_ << 5 | cmd_id;
+    frame->can_dlc = 8;
+    std::fill(std::begin(frame->data), std::end(frame->data), 0);
+
+    double iq = torque_target_ / config_.torque_constant;
+    double mechanical_power = torque_target_ * vel_ * 2 * M_PI;
+    double electrical_power = mechanical_power + 1.5 * config_.phase_resistance * iq * iq;
+
+    switch (cmd_id) {
+        case Get_Version_msg_t::cmd_id: {
+            Get_Version_msg_t msg;
+            msg.Protocol_Version = 2;
+            msg.Fw_Version_Major = 0;
+            msg.Fw_Version_Minor = 6;
+            msg.Fw_Version_Revision = 0;
+            msg.encode_buf(frame->data);
+        } break;
+        case Heartbeat_msg_t::cmd_id: {
+            Heartbeat_msg_t msg;
+            msg.Axis_Error = active_errors_;
+            msg.Axis_State = axis_state_;
+            msg.Procedure_Result = procedure_result_;
+            msg.Trajectory_Done_Flag = trajectory_done_;
+            msg.encode_buf(frame->data);
+        } break;
+        case Get_Error_msg_t::cmd_id: {
+            Get_Error_msg_t msg;
+            msg.Active_Errors = active_errors_;
+            msg.Disarm_Reason = disarm_reason_;
+            msg.encode_buf(frame->data);
+        } break;
+        case Get_Encoder_Estimates_msg_t::cmd_id: {
+            Get_Encoder_Estimates_msg_t msg;
+            msg.Pos_Estimate = pos_;
+            msg.Vel_Estimate = vel_;
+            msg.encode_buf(frame->data);
+        } break;
+        case Get_Iq_msg_t::cmd_id: {
+            Get_Iq_msg_t msg;
+            msg.Iq_Setpoint = iq;
+            msg.Iq_Measured = iq;
+            msg.encode_buf(frame->data);
+        } break;
+        case Get_Temperature_msg_t::cmd_id: {
+            Get_Temperature_msg_t msg;
+            msg.FET_Temperature = 25.0f;
+            msg.Motor_Temperature = 25.0f;
+            msg.encode_buf(frame->data);
+        } break;
+        case Get_Bus_Voltage_Current_msg_t::cmd_id: {
+            Get_Bus_Voltage_Current_msg_t msg;
+            msg.Bus_Voltage = config_.bus_voltage;
+            msg.Bus_Current = electrical_power / config_.bus_voltage;
+            msg.encode_buf(frame->data);
+        } break;
+        case Get_Torques_msg_t::cmd_id: {
+            Get_Torques_msg_t msg;
+            msg.Torque_Target = torque_target_;
+            msg.Torque_Estimate = torque_target_;
+            msg.encode_buf(frame->data);
+        } break;
+        case Get_Powers_msg_t::cmd_id: {
+            Get_Powers_msg_t msg;
+            msg.Electrical_Power = electrical_power;
+            msg.Mechanical_Power = mechanical_power;
+            msg.encode_buf(frame->data);
+        } break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+// Time-optimal profile under the limits, starting from an arbitrary velocity.
+// Falls back to a triangular profile if the cruise velocity is not reached.
+void SimODrive::Trajectory::plan(double goal_pos, double pos, double vel, double v_max, double a_max, double d_max) {
+    start_pos = pos;
+    start_vel = vel;
+    goal = goal_pos;
+
+    double distance = goal - pos;
+    double stop_distance = std::copysign(vel * vel / (2.0 * d_max), vel);
+    double dir = distance - stop_distance >= 0.0 ? 1.0 : -1.0;
+    accel = dir * a_max;
+    decel = -dir * d_max;
+    cruise_vel = dir * v_max;
+    if (dir * vel > dir * cruise_vel) {
+        accel = -accel; // faster than allowed, slow down to the cruise velocity
+    }
+
+    t_accel = (cruise_vel - vel) / accel;
+    double t_decel = -cruise_vel / decel;
+    double min_distance = 0.5 * t_accel * (cruise_vel + vel) + 0.5 * t_decel * cruise_vel;
+
+    if (dir * distance < dir * min_distance) {
+        cruise_vel = dir * std::sqrt(std::max((decel * vel * vel + 2 * accel * decel * distance) / (decel - accel), 0.0));
+        t_accel = std::max(0.0, (cruise_vel - vel) / accel);
+        t_decel = std::max(0.0, -cruise_vel / decel);
+        t_cruise = 0.0;
+    } else {
+        t_cruise = (distance - min_distance) / cruise_vel;
+    }
+
+    t_total = t_accel + t_cruise + t_decel;
+    pos_after_accel = pos + vel * t_accel + 0.5 * accel * t_accel * t_accel;
+}
+
+void SimODrive::Trajectory::eval(double t, double* pos, double* vel, double* accel_out) const {
+    if (t < 0.0) {
+        *pos = start_pos;
+        *vel = start_vel;
+        *accel_out = 0.0;
+    } else if (t < t_accel) {
+        *pos = start_pos + start_vel * t + 0.5 * accel * t * t;
+        *vel = start_vel + accel * t;
+        *accel_out = accel;
+    } else if (t < t_accel + t_cruise) {
+        *pos = pos_after_accel + cruise_vel * (t - t_accel);
+        *vel = cruise_vel;
+        *accel_out = 0.0;
+    } else if (t < t_total) {
+        double t_left = t - t_total;
+        *pos = goal + 0.5 * decel * t_left * t_left;
+        *vel = decel * t_left;
+        *accel_out = decel;
+    } else {
+        *pos = goal;
+        *vel = 0.0;
+        *accel_out = 0.0;
+    }
+}
@@ -1,4 +1,6 @@
 #include "socket_can.hpp"
+#include "perf_counters.hpp"
+#include "tracer.hpp"
 #include <unistd.h>
 #include <cstring>
 #include <iostream>
@@ -10,11 +12,32 @@
 #include <cerrno>
 #include <net/if.h>
 #include <sys/ioctl.h>
+#include <ctime>
+#include <algorithm>
 
 bool SocketCanIntf::init(const std::string& interface, EpollEventLoop* event_loop, FrameProcessor frame_processor) {
     interface_ = interface;
     event_loop_ = event_loop;
     frame_processor_ = std::move(frame_processor);
+    broken_ = true; // until the socket is registered with the event loop
+    rx_timestamps_ = false;
+    rx_timestamp_ns_ = 0;
+
+    std::string name;
+    backend_ = make_can_backend(interface_, &name);
+    if (backend_) {
+        if (!backend_->init(name, event_loop_, frame_processor_)) {
+            backend_.reset();
+            return false;
+        }
+        return true;
+    }
+    if (interface_.find(':') != std::string::npos) {
+        // Kernel interface names cannot contain ':'
+        std::cerr << "No CAN backend registered for " << interface_ << std::endl;
+        return false;
+    }
+
     socket_id_ = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
     if (socket_id_ == -1) {
         std::cerr << "Failed to create socket" << std::endl;
@@ -26,6 +49,7 @@ bool SocketCanIntf::init(const std::string& interface, EpollEventLoop* event_loo
     if (ioctl(socket_id_, SIOCGIFINDEX, &ifr) == -1) {
         std::cerr << "Failed to get interface index" << std::endl;
         close(socket_id_);
+        socket_id_ = -1;
         return false;
     }
 
@@ -36,6 +60,7 @@ bool SocketCanIntf::init(const std::string& interface, EpollEventLoop* event_loo
     if (bind(socket_id_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
         std::cerr << "Failed to bind socket" << std::endl;
         close(socket_id_);
+        socket_id_ = -1;
         return false;
     }
 
@@ -52,32 +77,128 @@ bool SocketCanIntf::init(const std::string& interface, EpollEventLoop* event_loo
     int retcode = recvmsg(socket_id_, &message, 0);
     if (retcode < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
         close(socket_id_);
-        socket_id_ = 0;
+        socket_id_ = -1;
         return false;
     }
 
     if (!event_loop_->register_event(&socket_evt_id_, socket_id_, EPOLLIN, [this](uint32_t mask) { on_socket_event(mask); })) {
         std::cerr << "Failed to register socket with event loop" << std::endl;
         close(socket_id_);
-        socket_id_ = 0;
+        socket_id_ = -1;
         return false;
     }
+    broken_ = false;
 
     return true;
 }
 
 void SocketCanIntf::deinit() {
+    if (backend_) {
+        // Kept until the next init(), deinit() may come from its callbacks
+        backend_->deinit();
+        return;
+    }
     if (!broken_) {
         event_loop_->deregister_event(socket_evt_id_);
     }
-    close(socket_id_);
+    if (socket_id_ >= 0) {
+        close(socket_id_);
+        socket_id_ = -1;
+    }
     broken_ = true;
 }
 
 bool SocketCanIntf::send_can_frame(const can_frame& frame) {
+    ODRIVE_TRACE_SCOPE_ARG("can_tx", frame.can_id);
+    if (backend_) {
+        return backend_->send_can_frame(frame);
+    }
+
     ssize_t nbytes = write(socket_id_, &frame, sizeof(frame));
     if (nbytes == -1) {
-        std::cerr << "Failed to send CAN frame" << std::endl;
+        if (errno != ENOBUFS && errno != EAGAIN) { // full TX queue is up to the caller
+            std::cerr << "Failed to send CAN frame" << std::endl;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+size_t SocketCanIntf::send_can_frames(const can_frame* frames, size_t n_frames) {
+    ODRIVE_TRACE_SCOPE_ARG("can_tx_batch", n_frames);
+    if (backend_) {
+        return backend_->send_can_frames(frames, n_frames);
+    }
+
+    // Hand all frames to the kernel in a single syscall so they are queued
+    // back-to-back, without other traffic from this process in between.
+    constexpr size_t kMaxBatch = 64;
+    struct iovec vecs[kMaxBatch];
+    struct mmsghdr msgs[kMaxBatch];
+
+    size_t n_sent = 0;
+    while (n_sent < n_frames) {
+        size_t n_batch = std::min(n_frames - n_sent, kMaxBatch);
+        for (size_t i = 0; i < n_batch; ++i) {
+            vecs[i] = {.iov_base = const_cast<can_frame*>(&frames[n_sent + i]), .iov_len = sizeof(can_frame)};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_iov = &vecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = sendmmsg(socket_id_, msgs, n_batch, 0);
+        if (n <= 0) {
+            int err = errno;
+            if (err != ENOBUFS && err != EAGAIN) {
+                std::cerr << "Failed to send CAN frames" << std::endl;
+            }
+            errno = err; // tells the caller whether to retry
+            break;
+        }
+        n_sent += n;
+    }
+
+    return n_sent;
+}
+
+bool SocketCanIntf::enable_tx_echo(TxEchoProcessor tx_echo_processor) {
+    if (backend_) {
+        return backend_->enable_tx_echo(std::move(tx_echo_processor));
+    }
+
+    // Frames sent on this socket are looped back with MSG_CONFIRM once the
+    // controller transmitted them, timestamped by the kernel.
+    int enable = 1;
+    if (setsockopt(socket_id_, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &enable, sizeof(enable)) == -1
+        || setsockopt(socket_id_, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) == -1) {
+        std::cerr << "Failed to enable TX echo" << std::endl;
+        return false;
+    }
+    tx_echo_processor_ = std::move(tx_echo_processor);
+    return true;
+}
+
+bool SocketCanIntf::enable_rx_timestamps() {
+    if (backend_) {
+        return backend_->enable_rx_timestamps();
+    }
+
+    int enable = 1;
+    if (setsockopt(socket_id_, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) == -1) {
+        std::cerr << "Failed to enable RX timestamps" << std::endl;
+        return false;
+    }
+    rx_timestamps_ = true;
+    return true;
+}
+
+bool SocketCanIntf::set_filters(const std::vector<can_filter>& filters) {
+    if (backend_) {
+        return backend_->set_filters(filters);
+    }
+
+    if (setsockopt(socket_id_, SOL_CAN_RAW, CAN_RAW_FILTER, filters.data(), filters.size() * sizeof(can_filter)) == -1) {
+        std::cerr << "Failed to set CAN filters" << std::endl;
         return false;
     }
 
@@ -102,8 +223,14 @@ void SocketCanIntf::on_socket_event(uint32_t mask) {
 }
 
 bool SocketCanIntf::read_nonblocking() {
+    ODRIVE_PERF_SCOPE("can_rx");
+
+    if (backend_) {
+        return backend_->read_nonblocking();
+    }
+
     struct can_frame frame;
-    struct cmsghdr ctrlmsg;
+    alignas(struct cmsghdr) char ctrlmsg[CMSG_SPACE(sizeof(struct timespec))];
 
     struct iovec vec = {.iov_base = &frame, .iov_len = sizeof(frame)};
     struct msghdr message = {
@@ -111,7 +238,7 @@ bool SocketCanIntf::read_nonblocking() {
         .msg_namelen = 0,
         .msg_iov = &vec, 
         .msg_iovlen = 1,
-        .msg_control = &ctrlmsg,
+        .msg_control = ctrlmsg,
         .msg_controllen = sizeof(ctrlmsg),
         .msg_flags = 0
         };
@@ -132,6 +259,24 @@ bool SocketCanIntf::read_nonblocking() {
         return true;
     }
 
-    process_can_frame(frame);
+    uint64_t timestamp_ns = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            timestamp_ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+        }
+    }
+
+    if (message.msg_flags & MSG_CONFIRM) {
+        if (tx_echo_processor_) {
+            tx_echo_processor_(frame, timestamp_ns);
+        }
+        return true;
+    }
+
+    ODRIVE_TRACE_SCOPE_ARG("can_rx", frame.can_id);
+    rx_timestamp_ns_ = rx_timestamps_ ? timestamp_ns : 0;
+    frame_processor_(frame);
     return true;
 }
@@ -0,0 +1,38 @@
+#include "staged_move.hpp"
+#include <cstring>
+
+void StagedMove::clear() {
+    frames_.clear();
+    echoed_.clear();
+    n_released_ = 0;
+    n_echoed_ = 0;
+    first_echo_ns_ = 0;
+    last_echo_ns_ = 0;
+}
+
+void StagedMove::release(SharedCanBus* bus) {
+    echoed_.assign(frames_.size(), false);
+    n_echoed_ = 0;
+    n_released_ = frames_.size();
+    bus->queue_burst(frames_.data(), frames_.size());
+}
+
+bool StagedMove::on_tx_echo(const can_frame& frame, uint64_t timestamp_ns) {
+    if (complete()) return false;
+
+    for (size_t i = 0; i < n_released_; ++i) {
+        if (echoed_[i] || frames_[i].can_id != frame.can_id || frames_[i].can_dlc != frame.can_dlc
+            || std::memcmp(frames_[i].data, frame.data, frame.can_dlc) != 0) {
+            continue;
+        }
+
+        echoed_[i] = true;
+        if (n_echoed_++ == 0) {
+            first_echo_ns_ = timestamp_ns;
+        }
+        last_echo_ns_ = timestamp_ns;
+        return complete();
+    }
+
+    return false; // not part of this burst
+}
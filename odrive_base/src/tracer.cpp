@@ -0,0 +1,162 @@
+#include "tracer.hpp"
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Tracer::enabled_{false};
+
+namespace {
+
+// Single writer (the owning thread), any number of readers. Slots are atomics
+// so an export can run concurrently; readers discard slots that may have been
+// overwritten while they were copied, as in a seqlock.
+struct TraceBuffer {
+    struct Slot {
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint64_t> start_ns{0};
+        std::atomic<uint64_t> duration_ns{0};
+        std::atomic<uint64_t> arg{0};
+    };
+
+    explicit TraceBuffer(size_t capacity) : slots(new Slot[capacity]), capacity(capacity) {}
+
+    std::unique_ptr<Slot[]> slots;
+    size_t capacity;
+    std::atomic<uint64_t> head{0}; // number of events ever written
+    std::atomic<const char*> thread_name{nullptr};
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+};
+
+struct Event {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint64_t arg;
+};
+
+std::mutex registry_mutex;
+size_t events_per_thread = Tracer::kDefaultEventsPerThread;
+// Buffers outlive their threads so events of finished threads are exported too
+std::vector<std::shared_ptr<TraceBuffer>> registry;
+thread_local TraceBuffer* thread_buffer = nullptr; // allocated on the first event
+thread_local const char* thread_name = nullptr;
+
+TraceBuffer* get_thread_buffer() {
+    if (!thread_buffer) {
+        std::lock_guard<std::mutex> guard(registry_mutex);
+        registry.push_back(std::make_shared<TraceBuffer>(events_per_thread));
+        thread_buffer = registry.back().get();
+        thread_buffer->thread_name.store(thread_name, std::memory_order_relaxed);
+    }
+    return thread_buffer;
+}
+
+std::vector<Event> snapshot(const TraceBuffer& buffer) {
+    uint64_t head = buffer.head.load(std::memory_order_acquire);
+    uint64_t begin = head > buffer.capacity ? head - buffer.capacity : 0;
+
+    std::vector<Event> events;
+    events.reserve(head - begin);
+    for (uint64_t i = begin; i < head; ++i) {
+        const TraceBuffer::Slot& slot = buffer.slots[i % buffer.capacity];
+        events.push_back({
+            slot.name.load(std::memory_order_relaxed),
+            slot.start_ns.load(std::memory_order_relaxed),
+            slot.duration_ns.load(std::memory_order_relaxed),
+            slot.arg.load(std::memory_order_relaxed),
+        });
+    }
+
+    // Slot i is being rewritten once head reaches i + capacity
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t head_after = buffer.head.load(std::memory_order_relaxed);
+    uint64_t first_valid = head_after >= buffer.capacity ? head_after - buffer.capacity + 1 : 0;
+    if (first_valid > begin) {
+        events.erase(events.begin(), events.begin() + std::min<uint64_t>(first_valid - begin, events.size()));
+    }
+    return events;
+}
+
+} // namespace
+
+void Tracer::enable(size_t capacity) {
+    {
+        std::lock_guard<std::mutex> guard(registry_mutex);
+        events_per_thread = capacity ? capacity : kDefaultEventsPerThread;
+    }
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::disable() {
+    enabled_.store(false, std::memory_order_relaxed);
+}
+
+void Tracer::set_thread_name(const char* name) {
+    thread_name = name;
+    if (thread_buffer) thread_buffer->thread_name.store(name, std::memory_order_relaxed);
+}
+
+void Tracer::record(const char* name, uint64_t start_ns, uint64_t duration_ns, uint64_t arg) {
+    TraceBuffer* buffer = get_thread_buffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    TraceBuffer::Slot& slot = buffer->slots[head % buffer->capacity];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start_ns.store(start_ns, std::memory_order_relaxed);
+    slot.duration_ns.store(duration_ns, std::memory_order_relaxed);
+    slot.arg.store(arg, std::memory_order_relaxed);
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+bool Tracer::write_chrome_json(const std::string& path) {
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> guard(registry_mutex);
+        buffers = registry;
+    }
+
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) return false;
+
+    int pid = getpid();
+    const char* separator = "";
+    std::fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (const auto& buffer : buffers) {
+        if (const char* thread_name = buffer->thread_name.load(std::memory_order_relaxed)) {
+            std::fprintf(
+                file,
+                "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                separator,
+                pid,
+                buffer->tid,
+                thread_name
+            );
+            separator = ",";
+        }
+        for (const Event& event : snapshot(*buffer)) {
+            // Timestamps are in microseconds
+            std::fprintf(
+                file,
+                "%s\n{\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,",
+                separator,
+                event.name,
+                pid,
+                buffer->tid,
+                event.start_ns / 1e3
+            );
+            if (event.duration_ns == kInstant) {
+                std::fprintf(file, "\"ph\":\"i\",\"s\":\"t\",");
+            } else {
+                std::fprintf(file, "\"ph\":\"X\",\"dur\":%.3f,", event.duration_ns / 1e3);
+            }
+            std::fprintf(file, "\"args\":{\"arg\":%" PRIu64 "}}", event.arg);
+            separator = ",";
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+    return std::fclose(file) == 0;
+}
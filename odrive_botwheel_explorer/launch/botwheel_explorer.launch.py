@@ -39,10 +39,18 @@ def generate_launch_description():
            description="Start robot with mock hardware mirroring command to its states.",
        )
    )
+    declared_arguments.append(
+       DeclareLaunchArgument(
+           "use_sim_hardware",
+           default_value="false",
+           description="Start robot with simulated ODrives instead of a CAN interface.",
+       )
+   )
 
     # Initialize Arguments
     use_rviz = LaunchConfiguration("use_rviz")
     use_mock_hardware = LaunchConfiguration("use_mock_hardware")
+    use_sim_hardware = LaunchConfiguration("use_sim_hardware")
 
     # Get URDF via xacro
     robot_description_content = Command(
@@ -54,6 +62,8 @@ def generate_launch_description():
             ),
            " ",
            "use_mock_hardware:=", use_mock_hardware,
+           " ",
+           "use_sim_hardware:=", use_sim_hardware,
         ]
     )
     robot_description = {"robot_description": robot_description_content}
@@ -0,0 +1,50 @@
+#ifndef ODRIVE_BRINGUP_NODE_HPP
+#define ODRIVE_BRINGUP_NODE_HPP
+
+#include <rclcpp/rclcpp.hpp>
+#include <rclcpp_action/rclcpp_action.hpp>
+#include "odrive_can/action/bringup.hpp"
+#include "bringup.hpp"
+#include "epoll_coro.hpp"
+#include "epoll_event_loop.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+using Bringup = odrive_can::action::Bringup;
+using BringupGoalHandle = rclcpp_action::ServerGoalHandle<Bringup>;
+using BringupEventMsg = odrive_can::msg::BringupEvent;
+
+// Serves the bringup action: calibrates, homes and sets the absolute position
+// of many axes concurrently (see odrive_base/include/bringup.hpp). Runs next
+// to the odrive_can_node instances of the axes, on its own socket.
+class ODriveBringupNode : public rclcpp::Node {
+public:
+    ODriveBringupNode(const std::string& node_name, const rclcpp::NodeOptions& options = rclcpp::NodeOptions());
+    bool init(EpollEventLoop* event_loop);
+    // Closes the socket on the CAN thread, after which its event loop returns
+    void deinit();
+private:
+    rclcpp_action::GoalResponse handle_goal(const rclcpp_action::GoalUUID& uuid, std::shared_ptr<const Bringup::Goal> goal);
+    rclcpp_action::CancelResponse handle_cancel(const std::shared_ptr<BringupGoalHandle> goal_handle);
+    void handle_accepted(const std::shared_ptr<BringupGoalHandle> goal_handle);
+    void goal_callback();
+    CoTask<void> run_goal(std::shared_ptr<BringupGoalHandle> goal_handle);
+    static BringupEventMsg to_msg(const BringupEvent& event, uint64_t start_ns);
+
+    std::string interface_;
+    BringupConfig config_;
+    CoCanBus bus_; // only used on the CAN thread
+
+    // A single bring-up at a time. Accepted on the executor, started on the CAN thread.
+    std::atomic<bool> busy_{false};
+    EpollEvent goal_evt_;
+    std::mutex goal_mutex_;
+    std::shared_ptr<BringupGoalHandle> pending_goal_;
+    rclcpp_action::Server<Bringup>::SharedPtr action_server_;
+
+    EpollEvent stop_evt_;
+};
+
+#endif // ODRIVE_BRINGUP_NODE_HPP
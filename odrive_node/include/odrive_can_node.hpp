@@ -5,14 +5,29 @@
 #include "odrive_can/msg/o_drive_status.hpp"
 #include "odrive_can/msg/controller_status.hpp"
 #include "odrive_can/msg/control_message.hpp"
+#include "odrive_can/msg/controller_gains.hpp"
+#include "odrive_can/msg/status_aggregate.hpp"
 #include "odrive_can/srv/axis_state.hpp"
 #include "std_srvs/srv/empty.hpp"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "odrive_type_adapters.hpp"
 #include "socket_can.hpp"
+#include "signal_statistics.hpp"
+#include "gain_streamer.hpp"
+#include "shm_channel.hpp"
+#include "cyclic_rates.hpp"
+#include "reboot_monitor.hpp"
+#include "tracer.hpp"
 
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
 #include <array>
 #include <algorithm>
+#include <chrono>
+#include <optional>
+#include <memory>
+#include <thread>
 #include <linux/can.h>
 #include <linux/can/raw.h>
 
@@ -22,43 +37,127 @@ using std::placeholders::_2;
 using ODriveStatus = odrive_can::msg::ODriveStatus;
 using ControllerStatus = odrive_can::msg::ControllerStatus;
 using ControlMessage = odrive_can::msg::ControlMessage;
+using StatusAggregate = odrive_can::msg::StatusAggregate;
+using ControllerGainsMsg = odrive_can::msg::ControllerGains;
+using DiagnosticArray = diagnostic_msgs::msg::DiagnosticArray;
+using DiagnosticStatus = diagnostic_msgs::msg::DiagnosticStatus;
 
 using AxisState = odrive_can::srv::AxisState;
 using Empty = std_srvs::srv::Empty;
 
 class ODriveCanNode : public rclcpp::Node {
 public:
-    ODriveCanNode(const std::string& node_name);
+    ODriveCanNode(const std::string& node_name, const rclcpp::NodeOptions& options = rclcpp::NodeOptions());
+    // Component constructor: runs its own event loop on a CAN thread, which the destructor stops and joins
+    explicit ODriveCanNode(const rclcpp::NodeOptions& options);
+    ~ODriveCanNode() override;
     bool init(EpollEventLoop* event_loop); 
+    // Tears the node down on the CAN thread, after which its event loop returns
     void deinit();
 private:
+    void teardown();
     void recv_callback(const can_frame& frame);
-    void subscriber_callback(const ControlMessage::SharedPtr msg);
+    void subscriber_callback(const ControlMessageData& msg);
     void service_callback(const std::shared_ptr<AxisState::Request> request, std::shared_ptr<AxisState::Response> response);
     void service_clear_errors_callback(const std::shared_ptr<Empty::Request> request, std::shared_ptr<Empty::Response> response);
+    void service_dump_trace_callback(const std::shared_ptr<Empty::Request> request, std::shared_ptr<Empty::Response> response);
     void request_state_callback();
     void request_clear_errors_callback();
     void ctrl_msg_callback();
-    inline bool verify_length(const std::string&name, uint8_t expected, uint8_t length);
+    void gains_subscriber_callback(const ControllerGainsMsg::SharedPtr msg);
+    void send_gains();
+    void shm_command_callback();
+    void aggregate_sample(uint32_t cmd_id);
+    void update_cyclic_rates(bool idle);
+    void on_reboot_event(RebootMonitor::Event event);
+    void publish_diagnostics();
+    rcl_interfaces::msg::SetParametersResult on_set_parameters(const std::vector<rclcpp::Parameter>& parameters);
+    void reconfigure_callback();
+    bool set_node_filter();
+    inline bool verify_length(uint32_t cmd_id, uint8_t expected, uint8_t length);
+
+    template <typename T>
+    void send(const T& msg) {
+        struct can_frame frame = {};
+        frame.can_id = node_id_ << 5 | msg.cmd_id;
+        frame.can_dlc = msg.msg_length;
+        msg.encode_buf(frame.data);
+        send_frame(frame);
+    }
+
+    // All frames to the ODrive go through here, so that a reboot can be undone
+    void send_frame(const can_frame& frame) {
+        reboot_monitor_.on_send(frame);
+        can_intf_.send_can_frame(frame);
+    }
     
-    uint16_t node_id_;
+    std::atomic<uint16_t> node_id_{0}; // changed on the CAN thread by reconfigure_callback()
     bool axis_idle_on_shutdown_;
+    std::string interface_;
+    EpollEventLoop* event_loop_ = nullptr;
     SocketCanIntf can_intf_ = SocketCanIntf();
     
     short int ctrl_pub_flag_ = 0;
     std::mutex ctrl_stat_mutex_;
-    ControllerStatus ctrl_stat_ = ControllerStatus();
-    rclcpp::Publisher<ControllerStatus>::SharedPtr ctrl_publisher_;
+    ControllerStatusData ctrl_stat_ = ControllerStatusData();
+    rclcpp::Publisher<AdaptedControllerStatus>::SharedPtr ctrl_publisher_;
     
     short int odrv_pub_flag_ = 0;
     std::mutex odrv_stat_mutex_;
-    ODriveStatus odrv_stat_ = ODriveStatus();
-    rclcpp::Publisher<ODriveStatus>::SharedPtr odrv_publisher_;
+    ODriveStatusData odrv_stat_ = ODriveStatusData();
+    rclcpp::Publisher<AdaptedODriveStatus>::SharedPtr odrv_publisher_;
+
+    // Frame counters, incremented on the CAN thread and reported by the
+    // diagnostics timer, so the RX path neither allocates nor formats
+    static constexpr size_t kNumCmdIds = 32;
+    std::atomic<uint64_t> rx_frames_{0};
+    std::array<std::atomic<uint32_t>, kNumCmdIds> bad_length_counts_{};
+    std::array<std::atomic<uint32_t>, kNumCmdIds> unhandled_counts_{};
+    std::array<uint32_t, kNumCmdIds> reported_bad_length_{};
+    rclcpp::Publisher<DiagnosticArray>::SharedPtr diagnostics_publisher_;
+    rclcpp::TimerBase::SharedPtr diagnostics_timer_;
+
+    // Rolling statistics, only touched by the CAN thread
+    std::chrono::steady_clock::duration aggregation_window_{};
+    std::chrono::steady_clock::time_point window_start_;
+    SignalStatistics iq_measured_stats_;
+    SignalStatistics bus_voltage_stats_;
+    SignalStatistics bus_current_stats_;
+    SignalStatistics fet_temperature_stats_;
+    SignalStatistics motor_temperature_stats_;
+    rclcpp::Publisher<StatusAggregate>::SharedPtr aggregate_publisher_;
 
     EpollEvent sub_evt_;
     std::mutex ctrl_msg_mutex_;
-    ControlMessage ctrl_msg_ = ControlMessage();
-    rclcpp::Subscription<ControlMessage>::SharedPtr subscriber_;
+    ControlMessageData ctrl_msg_ = ControlMessageData();
+    rclcpp::Subscription<AdaptedControlMessage>::SharedPtr subscriber_;
+
+    EpollEvent gains_evt_;
+    std::mutex gains_mutex_;
+    ControllerGains gains_;
+    GainStreamer gain_streamer_; // only used on the CAN thread
+    rclcpp::Subscription<ControllerGainsMsg>::SharedPtr gains_subscriber_;
+
+    // Raw state export / setpoint injection for non-ROS processes
+    ShmChannel shm_;
+    ShmAxisState shm_state_; // only used on the CAN thread
+    EpollEvent shm_evt_; // set by shm_waiter_ when the client rang the doorbell
+    std::thread shm_waiter_;
+    std::atomic<bool> shm_stop_{false};
+    std::atomic<uint32_t> shm_foreign_commands_{0}; // dropped, their node_id is not ours
+    uint32_t reported_foreign_commands_ = 0;
+
+    // Cyclic message rates, re-planned whenever the axis enters or leaves idle
+    CyclicRateConfig rate_config_;
+    int rates_idle_ = -1; // -1 until the first heartbeat, only used on the CAN thread
+
+    // Re-provisions the ODrive after it rebooted. The monitor is only used on
+    // the CAN thread; the atomics are reported by the diagnostics timer.
+    RebootMonitor reboot_monitor_;
+    std::atomic<uint32_t> reboots_{0};
+    std::atomic<uint64_t> last_recovery_ns_{0};
+    std::atomic<uint64_t> last_downtime_ns_{0};
+    uint32_t reported_reboots_ = 0;
 
     EpollEvent srv_evt_;
     uint32_t axis_state_;
@@ -69,6 +168,32 @@ private:
     EpollEvent srv_clear_errors_evt_;
     rclcpp::Service<Empty>::SharedPtr service_clear_errors_;
 
+    std::string trace_file_; // empty if tracing is disabled
+    rclcpp::Service<Empty>::SharedPtr service_dump_trace_;
+
+    // Parameter changes at runtime. They are validated on the executor thread
+    // and applied on the CAN thread, while the executor waits for the result.
+    // A change that the CAN thread does not apply within kReconfigTimeout is
+    // withdrawn and rejected.
+    struct Reconfig {
+        std::optional<std::string> interface;
+        std::optional<uint16_t> node_id;
+        std::optional<int> gain_rate_limit_ms;
+        std::optional<CyclicRateConfig> rate_config;
+        bool pending = false; // cleared when applied or withdrawn
+        std::string error; // empty on success
+    };
+    EpollEvent reconfig_evt_;
+    std::mutex reconfig_call_mutex_; // serializes on_set_parameters() calls that reconfigure
+    std::mutex reconfig_mutex_;
+    std::condition_variable reconfig_done_;
+    Reconfig reconfig_;
+    rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr param_callback_;
+
+    EpollEvent stop_evt_;
+    std::unique_ptr<EpollEventLoop> own_event_loop_; // only set by the component constructor
+    std::thread own_can_thread_;
+
 };
 
 #endif // ODRIVE_CAN_NODE_HPP
@@ -0,0 +1,137 @@
+#ifndef ODRIVE_TYPE_ADAPTERS_HPP
+#define ODRIVE_TYPE_ADAPTERS_HPP
+
+#include <rclcpp/type_adapter.hpp>
+#include "odrive_can/msg/o_drive_status.hpp"
+#include "odrive_can/msg/controller_status.hpp"
+#include "odrive_can/msg/control_message.hpp"
+
+#include <cstdint>
+
+// Internal representations of the node's topics. The CAN thread decodes frames
+// straight into these, and rclcpp only converts them to ROS messages when an
+// inter-process subscriber exists. Intra-process subscribers that use the same
+// adapted types receive the structs without any conversion.
+//
+// Fields are ordered by size, so the only padding is the trailing byte of
+// ControllerStatusData.
+
+struct ControllerStatusData {
+    float pos_estimate = 0.0f;
+    float vel_estimate = 0.0f;
+    float torque_target = 0.0f;
+    float torque_estimate = 0.0f;
+    float iq_setpoint = 0.0f;
+    float iq_measured = 0.0f;
+    uint32_t active_errors = 0;
+    uint8_t axis_state = 0;
+    uint8_t procedure_result = 0;
+    bool trajectory_done_flag = false;
+};
+static_assert(sizeof(ControllerStatusData) == 32, "ControllerStatusData: unexpected padding");
+
+struct ODriveStatusData {
+    float bus_voltage = 0.0f;
+    float bus_current = 0.0f;
+    float fet_temperature = 0.0f;
+    float motor_temperature = 0.0f;
+    uint32_t active_errors = 0;
+    uint32_t disarm_reason = 0;
+};
+static_assert(sizeof(ODriveStatusData) == 24, "ODriveStatusData: unexpected padding");
+
+struct ControlMessageData {
+    uint32_t control_mode = 0;
+    uint32_t input_mode = 0;
+    float input_pos = 0.0f;
+    float input_vel = 0.0f;
+    float input_torque = 0.0f;
+};
+static_assert(sizeof(ControlMessageData) == 20, "ControlMessageData: unexpected padding");
+
+template <>
+struct rclcpp::TypeAdapter<ControllerStatusData, odrive_can::msg::ControllerStatus> {
+    using is_specialized = std::true_type;
+    using custom_type = ControllerStatusData;
+    using ros_message_type = odrive_can::msg::ControllerStatus;
+
+    static void convert_to_ros_message(const custom_type& source, ros_message_type& destination) {
+        destination.pos_estimate = source.pos_estimate;
+        destination.vel_estimate = source.vel_estimate;
+        destination.torque_target = source.torque_target;
+        destination.torque_estimate = source.torque_estimate;
+        destination.iq_setpoint = source.iq_setpoint;
+        destination.iq_measured = source.iq_measured;
+        destination.active_errors = source.active_errors;
+        destination.axis_state = source.axis_state;
+        destination.procedure_result = source.procedure_result;
+        destination.trajectory_done_flag = source.trajectory_done_flag;
+    }
+
+    static void convert_to_custom(const ros_message_type& source, custom_type& destination) {
+        destination.pos_estimate = source.pos_estimate;
+        destination.vel_estimate = source.vel_estimate;
+        destination.torque_target = source.torque_target;
+        destination.torque_estimate = source.torque_estimate;
+        destination.iq_setpoint = source.iq_setpoint;
+        destination.iq_measured = source.iq_measured;
+        destination.active_errors = source.active_errors;
+        destination.axis_state = source.axis_state;
+        destination.procedure_result = source.procedure_result;
+        destination.trajectory_done_flag = source.trajectory_done_flag;
+    }
+};
+
+template <>
+struct rclcpp::TypeAdapter<ODriveStatusData, odrive_can::msg::ODriveStatus> {
+    using is_specialized = std::true_type;
+    using custom_type = ODriveStatusData;
+    using ros_message_type = odrive_can::msg::ODriveStatus;
+
+    static void convert_to_ros_message(const custom_type& source, ros_message_type& destination) {
+        destination.bus_voltage = source.bus_voltage;
+        destination.bus_current = source.bus_current;
+        destination.fet_temperature = source.fet_temperature;
+        destination.motor_temperature = source.motor_temperature;
+        destination.active_errors = source.active_errors;
+        destination.disarm_reason = source.disarm_reason;
+    }
+
+    static void convert_to_custom(const ros_message_type& source, custom_type& destination) {
+        destination.bus_voltage = source.bus_voltage;
+        destination.bus_current = source.bus_current;
+        destination.fet_temperature = source.fet_temperature;
+        destination.motor_temperature = source.motor_temperature;
+        destination.active_errors = source.active_errors;
+        destination.disarm_reason = source.disarm_reason;
+    }
+};
+
+template <>
+struct rclcpp::TypeAdapter<ControlMessageData, odrive_can::msg::ControlMessage> {
+    using is_specialized = std::true_type;
+    using custom_type = ControlMessageData;
+    using ros_message_type = odrive_can::msg::ControlMessage;
+
+    static void convert_to_ros_message(const custom_type& source, ros_message_type& destination) {
+        destination.control_mode = source.control_mode;
+        destination.input_mode = source.input_mode;
+        destination.input_pos = source.input_pos;
+        destination.input_vel = source.input_vel;
+        destination.input_torque = source.input_torque;
+    }
+
+    static void convert_to_custom(const ros_message_type& source, custom_type& destination) {
+        destination.control_mode = source.control_mode;
+        destination.input_mode = source.input_mode;
+        destination.input_pos = source.input_pos;
+        destination.input_vel = source.input_vel;
+        destination.input_torque = source.input_torque;
+    }
+};
+
+using AdaptedControllerStatus = rclcpp::TypeAdapter<ControllerStatusData, odrive_can::msg::ControllerStatus>;
+using AdaptedODriveStatus = rclcpp::TypeAdapter<ODriveStatusData, odrive_can::msg::ODriveStatus>;
+using AdaptedControlMessage = rclcpp::TypeAdapter<ControlMessageData, odrive_can::msg::ControlMessage>;
+
+#endif // ODRIVE_TYPE_ADAPTERS_HPP
@@ -0,0 +1,18 @@
+#include "odrive_bringup_node.hpp"
+#include "epoll_event_loop.hpp"
+#include <thread>
+
+int main(int argc, char* argv[]) {
+    rclcpp::init(argc, argv);
+    EpollEventLoop event_loop;
+    auto bringup_node = std::make_shared<ODriveBringupNode>("ODriveBringupNode");
+
+    if (!bringup_node->init(&event_loop)) return -1;
+
+    std::thread can_event_loop([&event_loop]() { event_loop.run_until_empty(); });
+    rclcpp::spin(bringup_node);
+    bringup_node->deinit();
+    can_event_loop.join();
+    rclcpp::shutdown();
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include "can_mux_server.hpp"
+#include "epoll_event_loop.hpp"
+#include "fault_injection.hpp"
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <iostream>
+
+// Bus-owner daemon: holds the only raw socket on a CAN interface and shares it
+// with clients that use "mux:<interface>" as their interface name.
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <interface>" << std::endl;
+        return -1;
+    }
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    register_fault_can_backend();
+    EpollEventLoop event_loop;
+    CanMuxServer server;
+    if (!server.init(argv[1], &event_loop)) {
+        std::cerr << "Failed to initialize CAN mux on " << argv[1] << std::endl;
+        return -1;
+    }
+
+    EpollEventLoop::EvtId signal_evt;
+    event_loop.register_event(&signal_evt, signal_fd, EPOLLIN, [&](uint32_t) {
+        // Leaves the event loop without events, which ends run_until_empty()
+        server.deinit();
+        event_loop.deregister_event(signal_evt);
+    });
+
+    std::cout << "odrive_can_mux serving " << argv[1] << std::endl;
+    event_loop.run_until_empty();
+    close(signal_fd);
+    return 0;
+}
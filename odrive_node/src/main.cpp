@@ -1,18 +1,20 @@
 #include "odrive_can_node.hpp"
-#include "epoll_event_loop.hpp"
-#include "socket_can.hpp"
-#include <thread>
+#include <exception>
+#include <iostream>
 
 int main(int argc, char* argv[]) {
     rclcpp::init(argc, argv);
-    EpollEventLoop event_loop;
-    auto can_node = std::make_shared<ODriveCanNode>("ODriveCanNode");
-
-    if (!can_node->init(&event_loop)) return -1;
-
-    std::thread can_event_loop([&event_loop]() { event_loop.run_until_empty(); });
+    Tracer::set_thread_name("executor");
+    std::shared_ptr<ODriveCanNode> can_node;
+    try {
+        can_node = std::make_shared<ODriveCanNode>(rclcpp::NodeOptions());
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        rclcpp::shutdown();
+        return -1;
+    }
     rclcpp::spin(can_node);
-    can_node->deinit();
+    can_node.reset(); // stops and joins the CAN thread
     rclcpp::shutdown();
     return 0;
 }
@@ -0,0 +1,155 @@
+#include "odrive_bringup_node.hpp"
+#include "can_mux_client.hpp"
+#include "fault_injection.hpp"
+#include <chrono>
+
+using std::placeholders::_1;
+using std::placeholders::_2;
+
+ODriveBringupNode::ODriveBringupNode(const std::string& node_name, const rclcpp::NodeOptions& options) : rclcpp::Node(node_name, options) {
+    rclcpp::Node::declare_parameter<std::string>("interface", "can0");
+    rclcpp::Node::declare_parameter<int>("calibration_timeout_ms", 60000);
+    rclcpp::Node::declare_parameter<int>("homing_timeout_ms", 30000);
+    rclcpp::Node::declare_parameter<int>("heartbeat_timeout_ms", 1000);
+    rclcpp::Node::declare_parameter<int>("max_parallel", 0);
+}
+
+bool ODriveBringupNode::init(EpollEventLoop* event_loop) {
+    interface_ = rclcpp::Node::get_parameter("interface").as_string();
+    config_.calibration_timeout = std::chrono::milliseconds(rclcpp::Node::get_parameter("calibration_timeout_ms").as_int());
+    config_.homing_timeout = std::chrono::milliseconds(rclcpp::Node::get_parameter("homing_timeout_ms").as_int());
+    config_.heartbeat_timeout = std::chrono::milliseconds(rclcpp::Node::get_parameter("heartbeat_timeout_ms").as_int());
+    config_.max_parallel = rclcpp::Node::get_parameter("max_parallel").as_int();
+
+    register_mux_can_backend();
+    register_fault_can_backend();
+    if (!bus_.init(interface_, event_loop)) {
+        RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to initialize socket can interface: %s", interface_.c_str());
+        return false;
+    }
+    if (!goal_evt_.init(event_loop, std::bind(&ODriveBringupNode::goal_callback, this))) {
+        RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to initialize goal event");
+        return false;
+    }
+    // Tearing down on the CAN thread ends a running bring-up there and lets run_until_empty() return
+    if (!stop_evt_.init(event_loop, [this](uint32_t) {
+            goal_evt_.deinit();
+            bus_.deinit();
+            stop_evt_.deinit();
+        })) {
+        RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to initialize stop event");
+        return false;
+    }
+
+    action_server_ = rclcpp_action::create_server<Bringup>(
+        this,
+        "bringup",
+        std::bind(&ODriveBringupNode::handle_goal, this, _1, _2),
+        std::bind(&ODriveBringupNode::handle_cancel, this, _1),
+        std::bind(&ODriveBringupNode::handle_accepted, this, _1)
+    );
+
+    RCLCPP_INFO(rclcpp::Node::get_logger(), "interface: %s", interface_.c_str());
+    return true;
+}
+
+void ODriveBringupNode::deinit() {
+    stop_evt_.set();
+}
+
+rclcpp_action::GoalResponse ODriveBringupNode::handle_goal(const rclcpp_action::GoalUUID& uuid, std::shared_ptr<const Bringup::Goal> goal) {
+    (void)uuid;
+    if (busy_.exchange(true)) {
+        RCLCPP_WARN(rclcpp::Node::get_logger(), "Rejecting bring-up goal, another bring-up is running");
+        return rclcpp_action::GoalResponse::REJECT;
+    }
+    RCLCPP_INFO(rclcpp::Node::get_logger(), "bring-up of %zu axes", goal->axes.size());
+    return rclcpp_action::GoalResponse::ACCEPT_AND_EXECUTE;
+}
+
+rclcpp_action::CancelResponse ODriveBringupNode::handle_cancel(const std::shared_ptr<BringupGoalHandle> goal_handle) {
+    (void)goal_handle;
+    // A procedure in progress would leave the axis half calibrated
+    RCLCPP_WARN(rclcpp::Node::get_logger(), "Bring-up cannot be canceled");
+    return rclcpp_action::CancelResponse::REJECT;
+}
+
+void ODriveBringupNode::handle_accepted(const std::shared_ptr<BringupGoalHandle> goal_handle) {
+    std::lock_guard<std::mutex> guard(goal_mutex_);
+    pending_goal_ = goal_handle;
+    goal_evt_.set();
+}
+
+void ODriveBringupNode::goal_callback() {
+    std::shared_ptr<BringupGoalHandle> goal_handle;
+    {
+        std::lock_guard<std::mutex> guard(goal_mutex_);
+        goal_handle.swap(pending_goal_);
+    }
+    if (goal_handle) {
+        co_spawn(run_goal(goal_handle));
+    }
+}
+
+BringupEventMsg ODriveBringupNode::to_msg(const BringupEvent& event, uint64_t start_ns) {
+    BringupEventMsg msg;
+    msg.node_id = event.node_id;
+    msg.step = static_cast<uint8_t>(event.step);
+    msg.outcome = static_cast<uint8_t>(event.outcome);
+    msg.start_time = (static_cast<int64_t>(event.start_ns) - static_cast<int64_t>(start_ns)) / 1e9;
+    msg.end_time = event.end_ns ? (static_cast<int64_t>(event.end_ns) - static_cast<int64_t>(start_ns)) / 1e9 : 0.0;
+    msg.axis_state = event.axis_state;
+    msg.procedure_result = event.procedure_result;
+    msg.axis_error = event.axis_error;
+    return msg;
+}
+
+CoTask<void> ODriveBringupNode::run_goal(std::shared_ptr<BringupGoalHandle> goal_handle) {
+    std::vector<BringupAxis> axes;
+    for (const auto& axis_msg : goal_handle->get_goal()->axes) {
+        BringupAxis axis;
+        axis.node_id = axis_msg.node_id;
+        axis.calibrate = axis_msg.calibrate;
+        axis.home = axis_msg.home;
+        if (axis_msg.set_absolute_position) axis.absolute_position = axis_msg.absolute_position;
+        axis.group = axis_msg.group;
+        axis.after.assign(axis_msg.after.begin(), axis_msg.after.end());
+        axes.push_back(axis);
+    }
+
+    // Same clock as the event timestamps
+    uint64_t start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+    auto feedback = std::make_shared<Bringup::Feedback>();
+    BringupReport report = co_await run_bringup(bus_, std::move(axes), config_, [&](const BringupEvent& event) {
+        feedback->event = to_msg(event, start_ns);
+        goal_handle->publish_feedback(feedback);
+    });
+
+    auto result = std::make_shared<Bringup::Result>();
+    result->success = report.success;
+    result->error = report.error;
+    result->duration = (report.end_ns - report.start_ns) / 1e9;
+    result->failed_node_ids.assign(report.failed.begin(), report.failed.end());
+    double busy = 0.0; // sum over all steps, i.e. the duration if run one after the other
+    for (const BringupEvent& event : report.timeline) {
+        result->timeline.push_back(to_msg(event, start_ns));
+        busy += (event.end_ns - event.start_ns) / 1e9;
+    }
+
+    if (!report.error.empty()) {
+        RCLCPP_ERROR(rclcpp::Node::get_logger(), "Bring-up rejected: %s", report.error.c_str());
+    } else {
+        RCLCPP_INFO(rclcpp::Node::get_logger(), "bring-up %s in %.2f s (steps summed: %.2f s), %zu axes failed",
+            report.success ? "succeeded" : "failed", result->duration, busy, report.failed.size());
+    }
+    if (rclcpp::ok()) { // the result cannot be sent once the node shuts down
+        if (report.success) {
+            goal_handle->succeed(result);
+        } else {
+            goal_handle->abort(result);
+        }
+    }
+    busy_ = false;
+}
@@ -1,11 +1,18 @@
 #include "odrive_can_node.hpp"
 #include "odrive_enums.h"
+#include "can_mux_client.hpp"
+#include "fault_injection.hpp"
 #include "epoll_event_loop.hpp"
 #include "byte_swap.hpp"
+#include <rclcpp_components/register_node_macro.hpp>
 #include <sys/eventfd.h>
+#include <cmath>
+#include <cstdio>
 #include <chrono>
+#include <stdexcept>
 
 enum CmdId : uint32_t {
+    kGetVersion = 0x000,           // RebootMonitor     - requested by RTR
     kHeartbeat = 0x001,            // ControllerStatus  - publisher
     kGetError = 0x003,             // SystemStatus      - publisher
     kSetAxisState = 0x007,         // SetAxisState      - service
@@ -28,20 +35,51 @@ enum ControlMode : uint64_t {
     kPositionControl,
 };
 
-ODriveCanNode::ODriveCanNode(const std::string& node_name) : rclcpp::Node(node_name) {
+// Intra-process communication does not support KeepAll, so the adapted topics
+// fall back to a bounded history when it is enabled.
+static constexpr size_t kIntraProcessDepth = 10;
+static constexpr std::chrono::seconds kReconfigTimeout{1};
+
+static rclcpp::QoS topic_qos(const rclcpp::NodeOptions& options) {
+    if (options.use_intra_process_comms()) return rclcpp::QoS(rclcpp::KeepLast(kIntraProcessDepth));
+    return rclcpp::QoS(rclcpp::KeepAll{});
+}
+
+ODriveCanNode::ODriveCanNode(const std::string& node_name, const rclcpp::NodeOptions& options) : rclcpp::Node(node_name, options) {
     
     rclcpp::Node::declare_parameter<std::string>("interface", "can0");
     rclcpp::Node::declare_parameter<uint16_t>("node_id", 0);
     rclcpp::Node::declare_parameter<bool>("axis_idle_on_shutdown", false);
+    rclcpp::Node::declare_parameter<int>("aggregation_window_ms", 0);
+    rclcpp::Node::declare_parameter<int>("gain_rate_limit_ms", 0);
+    rclcpp::Node::declare_parameter<std::string>("shm_name", "");
+    rclcpp::Node::declare_parameter<int>("diagnostics_period_ms", 1000);
+    rclcpp::Node::declare_parameter<std::string>("trace_file", "");
+    rclcpp::Node::declare_parameter<int>("trace_buffer_events", Tracer::kDefaultEventsPerThread);
+    rclcpp::Node::declare_parameter<bool>("reboot_recovery.rearm", false);
+    rclcpp::Node::declare_parameter<int>("reboot_recovery.min_silence_ms", 200);
+    rclcpp::Node::declare_parameter<int>("rate_config.bus_bitrate", 0);
+    rclcpp::Node::declare_parameter<int>("rate_config.num_axes", 1);
+    rclcpp::Node::declare_parameter<double>("rate_config.bus_budget", rate_config_.bus_budget);
+    rclcpp::Node::declare_parameter<double>("rate_config.command_rate_hz", rate_config_.command_rate_hz);
+    rclcpp::Node::declare_parameter<int>("rate_config.idle_period_ms", rate_config_.idle_period_ms);
+    for (size_t i = 0; i < kNumCyclicMessages; ++i) {
+        std::string name = kCyclicMessageNames[i];
+        rclcpp::Node::declare_parameter<double>("rate_config.weight." + name, rate_config_.weights[i]);
+        rclcpp::Node::declare_parameter<int>("rate_config.endpoint_id." + name, rate_config_.endpoint_ids[i]);
+    }
 
-    rclcpp::QoS ctrl_stat_qos(rclcpp::KeepAll{});
-    ctrl_publisher_ = rclcpp::Node::create_publisher<ControllerStatus>("controller_status", ctrl_stat_qos);
+    rclcpp::QoS ctrl_stat_qos = topic_qos(options);
+    ctrl_publisher_ = rclcpp::Node::create_publisher<AdaptedControllerStatus>("controller_status", ctrl_stat_qos);
     
-    rclcpp::QoS odrv_stat_qos(rclcpp::KeepAll{});
-    odrv_publisher_ = rclcpp::Node::create_publisher<ODriveStatus>("odrive_status", odrv_stat_qos);
+    rclcpp::QoS odrv_stat_qos = topic_qos(options);
+    odrv_publisher_ = rclcpp::Node::create_publisher<AdaptedODriveStatus>("odrive_status", odrv_stat_qos);
 
-    rclcpp::QoS ctrl_msg_qos(rclcpp::KeepAll{});
-    subscriber_ = rclcpp::Node::create_subscription<ControlMessage>("control_message", ctrl_msg_qos, std::bind(&ODriveCanNode::subscriber_callback, this, _1));
+    rclcpp::QoS ctrl_msg_qos = topic_qos(options);
+    subscriber_ = rclcpp::Node::create_subscription<AdaptedControlMessage>("control_message", ctrl_msg_qos, std::bind(&ODriveCanNode::subscriber_callback, this, _1));
+
+    rclcpp::QoS gains_qos(rclcpp::KeepAll{});
+    gains_subscriber_ = rclcpp::Node::create_subscription<ControllerGainsMsg>("controller_gains", gains_qos, std::bind(&ODriveCanNode::gains_subscriber_callback, this, _1));
 
     rclcpp::QoS srv_qos(rclcpp::KeepAll{});
     service_ = rclcpp::Node::create_service<AxisState>("request_axis_state", std::bind(&ODriveCanNode::service_callback, this, _1, _2), srv_qos.get_rmw_qos_profile());
@@ -50,34 +88,91 @@ ODriveCanNode::ODriveCanNode(const std::string& node_name) : rclcpp::Node(node_n
     service_clear_errors_ = rclcpp::Node::create_service<Empty>("clear_errors", std::bind(&ODriveCanNode::service_clear_errors_callback, this, _1, _2), srv_clear_errors_qos.get_rmw_qos_profile());
 }
 
+ODriveCanNode::ODriveCanNode(const rclcpp::NodeOptions& options) : ODriveCanNode("ODriveCanNode", options) {
+    own_event_loop_ = std::make_unique<EpollEventLoop>();
+    if (!init(own_event_loop_.get())) {
+        throw std::runtime_error("Failed to initialize ODriveCanNode");
+    }
+    own_can_thread_ = std::thread([this]() {
+        Tracer::set_thread_name("can_event_loop");
+        own_event_loop_->run_until_empty();
+    });
+}
+
+ODriveCanNode::~ODriveCanNode() {
+    if (own_can_thread_.joinable()) {
+        deinit();
+        own_can_thread_.join();
+    }
+}
+
 void ODriveCanNode::deinit() {
+    stop_evt_.set();
+}
+
+void ODriveCanNode::teardown() {
     if (axis_idle_on_shutdown_) {
         struct can_frame frame = {};
         frame.can_id = node_id_ << 5 | CmdId::kSetAxisState;
         write_le<uint32_t>(ODriveAxisState::AXIS_STATE_IDLE, frame.data);
         frame.can_dlc = 4;
-        can_intf_.send_can_frame(frame);
+        send_frame(frame);
     }
 
     sub_evt_.deinit();
+    gains_evt_.deinit();
+    if (shm_waiter_.joinable()) {
+        shm_stop_.store(true);
+        shm_.ring_doorbell();
+        shm_waiter_.join();
+    }
+    shm_evt_.deinit();
+    shm_.close();
     srv_evt_.deinit();
+    srv_clear_errors_evt_.deinit();
+    reconfig_evt_.deinit();
     can_intf_.deinit();
+    stop_evt_.deinit();
+
+    if (!trace_file_.empty() && !Tracer::write_chrome_json(trace_file_)) {
+        RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to write trace to %s", trace_file_.c_str());
+    }
 }
 
 bool ODriveCanNode::init(EpollEventLoop* event_loop) {
 
     node_id_ = rclcpp::Node::get_parameter("node_id").as_int();
+    trace_file_ = rclcpp::Node::get_parameter("trace_file").as_string();
+    if (!trace_file_.empty()) {
+        Tracer::enable(rclcpp::Node::get_parameter("trace_buffer_events").as_int());
+        rclcpp::QoS srv_dump_trace_qos(rclcpp::KeepAll{});
+        service_dump_trace_ = rclcpp::Node::create_service<Empty>("dump_trace", std::bind(&ODriveCanNode::service_dump_trace_callback, this, _1, _2), srv_dump_trace_qos.get_rmw_qos_profile());
+        RCLCPP_INFO(rclcpp::Node::get_logger(), "tracing to %s", trace_file_.c_str());
+    }
     axis_idle_on_shutdown_ = rclcpp::Node::get_parameter("axis_idle_on_shutdown").as_bool();
-    std::string interface = rclcpp::Node::get_parameter("interface").as_string();
+    interface_ = rclcpp::Node::get_parameter("interface").as_string();
+    event_loop_ = event_loop;
 
-    if (!can_intf_.init(interface, event_loop, std::bind(&ODriveCanNode::recv_callback, this, _1))) {
-        RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to initialize socket can interface: %s", interface.c_str());
+    register_mux_can_backend();
+    register_fault_can_backend();
+    if (!can_intf_.init(interface_, event_loop, std::bind(&ODriveCanNode::recv_callback, this, _1))) {
+        RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to initialize socket can interface: %s", interface_.c_str());
         return false;
     }
+    if (!set_node_filter()) {
+        RCLCPP_WARN(rclcpp::Node::get_logger(), "Failed to set CAN filter, frames of other nodes are dropped in software");
+    }
     if (!sub_evt_.init(event_loop, std::bind(&ODriveCanNode::ctrl_msg_callback, this))) {
         RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to initialize subscriber event");
         return false;
     }
+    if (!gains_evt_.init(event_loop, std::bind(&ODriveCanNode::send_gains, this))) {
+        RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to initialize gains event");
+        return false;
+    }
+    gain_streamer_.set_min_interval(std::chrono::milliseconds(rclcpp::Node::get_parameter("gain_rate_limit_ms").as_int()));
+    reboot_monitor_.set_rearm(rclcpp::Node::get_parameter("reboot_recovery.rearm").as_bool());
+    reboot_monitor_.set_min_silence(std::chrono::milliseconds(rclcpp::Node::get_parameter("reboot_recovery.min_silence_ms").as_int()));
     if (!srv_evt_.init(event_loop, std::bind(&ODriveCanNode::request_state_callback, this))) {
         RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to initialize service event");
         return false;
@@ -86,18 +181,268 @@ bool ODriveCanNode::init(EpollEventLoop* event_loop) {
         RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to initialize clear errors service event");
         return false;
     }
-    RCLCPP_INFO(rclcpp::Node::get_logger(), "node_id: %d", node_id_);
-    RCLCPP_INFO(rclcpp::Node::get_logger(), "interface: %s", interface.c_str());
+    if (!reconfig_evt_.init(event_loop, std::bind(&ODriveCanNode::reconfigure_callback, this))) {
+        RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to initialize reconfiguration event");
+        return false;
+    }
+    if (!stop_evt_.init(event_loop, [this](uint32_t) { teardown(); })) {
+        RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to initialize stop event");
+        return false;
+    }
+
+    std::string shm_name = rclcpp::Node::get_parameter("shm_name").as_string();
+    if (!shm_name.empty()) {
+        if (!shm_.create(shm_name)) {
+            RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to create shared memory region (in use by another process?): %s", shm_name.c_str());
+            return false;
+        }
+        if (!shm_evt_.init(event_loop, std::bind(&ODriveCanNode::shm_command_callback, this))) {
+            RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to initialize shared memory event");
+            return false;
+        }
+        shm_stop_.store(false);
+        shm_waiter_ = std::thread([this]() {
+            // Forwards the client's doorbell to the CAN thread
+            Tracer::set_thread_name("shm_doorbell");
+            uint32_t seen = shm_.doorbell();
+            shm_evt_.set(); // commands pushed before the node started
+            while (true) {
+                shm_.wait_doorbell(seen);
+                if (shm_stop_.load()) break;
+                uint32_t doorbell = shm_.doorbell();
+                if (doorbell != seen) {
+                    seen = doorbell;
+                    shm_evt_.set();
+                }
+            }
+        });
+        RCLCPP_INFO(rclcpp::Node::get_logger(), "shared memory: %s", shm_name.c_str());
+    }
+
+    int diagnostics_period_ms = rclcpp::Node::get_parameter("diagnostics_period_ms").as_int();
+    if (diagnostics_period_ms > 0) {
+        rclcpp::QoS diagnostics_qos(rclcpp::KeepLast(1));
+        diagnostics_publisher_ = rclcpp::Node::create_publisher<DiagnosticArray>("/diagnostics", diagnostics_qos);
+        diagnostics_timer_ = rclcpp::Node::create_wall_timer(std::chrono::milliseconds(diagnostics_period_ms), std::bind(&ODriveCanNode::publish_diagnostics, this));
+    }
+
+    int aggregation_window_ms = rclcpp::Node::get_parameter("aggregation_window_ms").as_int();
+    if (aggregation_window_ms > 0) {
+        aggregation_window_ = std::chrono::milliseconds(aggregation_window_ms);
+        window_start_ = std::chrono::steady_clock::now();
+        rclcpp::QoS aggregate_qos(rclcpp::KeepAll{});
+        aggregate_publisher_ = rclcpp::Node::create_publisher<StatusAggregate>("status_aggregate", aggregate_qos);
+    }
+
+    rate_config_.bus_bitrate = rclcpp::Node::get_parameter("rate_config.bus_bitrate").as_int();
+    rate_config_.num_axes = rclcpp::Node::get_parameter("rate_config.num_axes").as_int();
+    rate_config_.bus_budget = rclcpp::Node::get_parameter("rate_config.bus_budget").as_double();
+    rate_config_.command_rate_hz = rclcpp::Node::get_parameter("rate_config.command_rate_hz").as_double();
+    rate_config_.idle_period_ms = rclcpp::Node::get_parameter("rate_config.idle_period_ms").as_int();
+    for (size_t i = 0; i < kNumCyclicMessages; ++i) {
+        std::string name = kCyclicMessageNames[i];
+        rate_config_.weights[i] = rclcpp::Node::get_parameter("rate_config.weight." + name).as_double();
+        rate_config_.endpoint_ids[i] = rclcpp::Node::get_parameter("rate_config.endpoint_id." + name).as_int();
+    }
+    if (rate_config_.bus_bitrate) {
+        double load = cyclic_bus_load(rate_config_, plan_cyclic_rates(rate_config_, false));
+        RCLCPP_INFO(rclcpp::Node::get_logger(), "planned bus load: %.0f%%", load * 100.0);
+        if (load > rate_config_.bus_budget) {
+            RCLCPP_WARN(rclcpp::Node::get_logger(), "Cyclic messages exceed the bus budget of %.0f%%", rate_config_.bus_budget * 100.0);
+        }
+    }
+
+    param_callback_ = rclcpp::Node::add_on_set_parameters_callback(std::bind(&ODriveCanNode::on_set_parameters, this, _1));
+
+    RCLCPP_INFO(rclcpp::Node::get_logger(), "node_id: %d", node_id_.load());
+    RCLCPP_INFO(rclcpp::Node::get_logger(), "interface: %s", interface_.c_str());
+    return true;
+}
+
+bool ODriveCanNode::set_node_filter() {
+    // Only standard data frames of our node_id wake up the CAN thread
+    struct can_filter filter = {
+        .can_id = static_cast<canid_t>(node_id_) << 5,
+        .can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | (0x3F << 5),
+    };
+    return can_intf_.set_filters({filter});
+}
+
+// Applies a rate_config.* parameter to config. Returns false for other parameters.
+static bool set_rate_config_parameter(CyclicRateConfig* config, const rclcpp::Parameter& param) {
+    const std::string& name = param.get_name();
+    if (name == "rate_config.bus_bitrate") {
+        config->bus_bitrate = param.as_int();
+    } else if (name == "rate_config.num_axes") {
+        config->num_axes = param.as_int();
+    } else if (name == "rate_config.bus_budget") {
+        config->bus_budget = param.as_double();
+    } else if (name == "rate_config.command_rate_hz") {
+        config->command_rate_hz = param.as_double();
+    } else if (name == "rate_config.idle_period_ms") {
+        config->idle_period_ms = param.as_int();
+    } else {
+        for (size_t i = 0; i < kNumCyclicMessages; ++i) {
+            std::string msg_name = kCyclicMessageNames[i];
+            if (name == "rate_config.weight." + msg_name) {
+                config->weights[i] = param.as_double();
+                return true;
+            }
+            if (name == "rate_config.endpoint_id." + msg_name) {
+                config->endpoint_ids[i] = param.as_int();
+                return true;
+            }
+        }
+        return false;
+    }
     return true;
 }
 
+rcl_interfaces::msg::SetParametersResult ODriveCanNode::on_set_parameters(const std::vector<rclcpp::Parameter>& parameters) {
+    rcl_interfaces::msg::SetParametersResult result;
+    result.successful = true;
+
+    // rate_config_ is only written by reconfigure_callback(), which runs while
+    // this thread waits for it
+    Reconfig reconfig;
+    CyclicRateConfig rate_config = rate_config_;
+    std::optional<bool> axis_idle_on_shutdown;
+    for (const rclcpp::Parameter& param : parameters) {
+        const std::string& name = param.get_name();
+        if (name == "interface") {
+            reconfig.interface = param.as_string();
+        } else if (name == "node_id") {
+            if (param.as_int() < 0 || param.as_int() > 0x3F) {
+                result.successful = false;
+                result.reason = "node_id must be between 0 and 63";
+                return result;
+            }
+            reconfig.node_id = param.as_int();
+        } else if (name == "gain_rate_limit_ms") {
+            reconfig.gain_rate_limit_ms = param.as_int();
+        } else if (name == "axis_idle_on_shutdown") {
+            axis_idle_on_shutdown = param.as_bool();
+        } else if (set_rate_config_parameter(&rate_config, param)) {
+            reconfig.rate_config = rate_config;
+        } else {
+            result.successful = false;
+            result.reason = name + " can only be set at startup";
+            return result;
+        }
+    }
+
+    if (reconfig.interface || reconfig.node_id || reconfig.gain_rate_limit_ms || reconfig.rate_config) {
+        // One change at a time, a second one would overwrite reconfig_
+        std::lock_guard<std::mutex> call_guard(reconfig_call_mutex_);
+        std::unique_lock<std::mutex> guard(reconfig_mutex_);
+        reconfig_ = std::move(reconfig);
+        reconfig_.pending = true;
+        reconfig_evt_.set();
+        if (!reconfig_done_.wait_for(guard, kReconfigTimeout, [this]() { return !reconfig_.pending; })) {
+            // The CAN thread holds reconfig_mutex_ while it applies a change,
+            // so it has not started and skips the withdrawn one.
+            reconfig_.pending = false;
+            result.successful = false;
+            result.reason = "Timed out waiting for the CAN thread";
+            return result;
+        }
+        if (!reconfig_.error.empty()) {
+            result.successful = false;
+            result.reason = reconfig_.error;
+            return result;
+        }
+    }
+
+    if (axis_idle_on_shutdown) axis_idle_on_shutdown_ = *axis_idle_on_shutdown;
+    return result;
+}
+
+void ODriveCanNode::reconfigure_callback() {
+    std::lock_guard<std::mutex> guard(reconfig_mutex_);
+    if (!reconfig_.pending) {
+        return; // withdrawn after a timeout
+    }
+
+    // Nothing is received or sent between closing the old socket and binding
+    // the new one; frames on the bus during that window are lost.
+    bool rebind = reconfig_.interface && *reconfig_.interface != interface_;
+    if (rebind) {
+        auto start = std::chrono::steady_clock::now();
+        can_intf_.deinit();
+        if (!can_intf_.init(*reconfig_.interface, event_loop_, std::bind(&ODriveCanNode::recv_callback, this, _1))) {
+            reconfig_.error = "Failed to initialize socket can interface: " + *reconfig_.interface;
+            if (!can_intf_.init(interface_, event_loop_, std::bind(&ODriveCanNode::recv_callback, this, _1))) {
+                RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to restore socket can interface: %s", interface_.c_str());
+            } else {
+                set_node_filter();
+            }
+            reconfig_.pending = false;
+            reconfig_done_.notify_one();
+            return;
+        }
+        interface_ = *reconfig_.interface;
+        reboot_monitor_.reset(); // the blackout is not a silence of the ODrive
+        auto blackout = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+        RCLCPP_INFO(rclcpp::Node::get_logger(), "interface: %s (rebound in %.2f ms)", interface_.c_str(), blackout.count());
+    }
+
+    bool new_node_id = reconfig_.node_id && *reconfig_.node_id != node_id_;
+    if (new_node_id) {
+        node_id_ = *reconfig_.node_id;
+        {
+            std::lock_guard<std::mutex> ctrl_guard(ctrl_stat_mutex_);
+            ctrl_stat_ = ControllerStatusData();
+            ctrl_pub_flag_ = 0;
+        }
+        {
+            std::lock_guard<std::mutex> odrv_guard(odrv_stat_mutex_);
+            odrv_stat_ = ODriveStatusData();
+            odrv_pub_flag_ = 0;
+        }
+        shm_state_ = ShmAxisState();
+        gain_streamer_.reset(); // the new ODrive has not seen our gains yet
+        rates_idle_ = -1;
+        reboot_monitor_.reset();
+        iq_measured_stats_.reset();
+        bus_voltage_stats_.reset();
+        bus_current_stats_.reset();
+        fet_temperature_stats_.reset();
+        motor_temperature_stats_.reset();
+        window_start_ = std::chrono::steady_clock::now();
+        RCLCPP_INFO(rclcpp::Node::get_logger(), "node_id: %d", node_id_.load());
+    }
+    if ((rebind || new_node_id) && !set_node_filter()) {
+        RCLCPP_WARN(rclcpp::Node::get_logger(), "Failed to set CAN filter, frames of other nodes are dropped in software");
+    }
+
+    if (reconfig_.gain_rate_limit_ms) {
+        gain_streamer_.set_min_interval(std::chrono::milliseconds(*reconfig_.gain_rate_limit_ms));
+    }
+    if (reconfig_.rate_config) {
+        rate_config_ = *reconfig_.rate_config;
+        rates_idle_ = -1; // re-planned and sent with the next heartbeat
+    }
+
+    reconfig_.pending = false;
+    reconfig_done_.notify_one();
+}
+
 void ODriveCanNode::recv_callback(const can_frame& frame) {
 
     if(((frame.can_id >> 5) & 0x3F) != node_id_) return;
 
+    ODRIVE_TRACE_SCOPE_ARG("decode", frame.can_id & 0x1F);
+    rx_frames_.fetch_add(1, std::memory_order_relaxed);
+    bool decoded = false; // false for frames that were dropped or are not used
     switch(frame.can_id & 0x1F) {
+        case CmdId::kGetVersion: {
+            if (!verify_length(CmdId::kGetVersion, 8, frame.can_dlc)) break;
+            on_reboot_event(reboot_monitor_.on_version(frame, ShmChannel::now_ns()));
+            decoded = true;
+            break;
+        }
         case CmdId::kHeartbeat: {
-            if (!verify_length("kHeartbeat", 8, frame.can_dlc)) break;
+            if (!verify_length(CmdId::kHeartbeat, 8, frame.can_dlc)) break;
             std::lock_guard<std::mutex> guard(ctrl_stat_mutex_);
             ctrl_stat_.active_errors    = read_le<uint32_t>(frame.data + 0);
             ctrl_stat_.axis_state        = read_le<uint8_t>(frame.data + 4);
@@ -105,79 +450,170 @@ void ODriveCanNode::recv_callback(const can_frame& frame) {
             ctrl_stat_.trajectory_done_flag = read_le<bool>(frame.data + 6);
             ctrl_pub_flag_ |= 0b0001;
             fresh_heartbeat_.notify_one();
+            on_reboot_event(reboot_monitor_.on_heartbeat(frame, ShmChannel::now_ns()));
+            if (reboot_monitor_.take_version_probe()) {
+                send_frame(RebootMonitor::version_request(node_id_));
+            }
+            // While recovering from a reboot, the replayed rates stay until the axis is back
+            if (rate_config_.bus_bitrate && !reboot_monitor_.recovering()) {
+                update_cyclic_rates(ctrl_stat_.axis_state == ODriveAxisState::AXIS_STATE_IDLE);
+            }
+            decoded = true;
             break;
         }
         case CmdId::kGetError: {
-            if (!verify_length("kGetError", 8, frame.can_dlc)) break;
+            if (!verify_length(CmdId::kGetError, 8, frame.can_dlc)) break;
             std::lock_guard<std::mutex> guard(odrv_stat_mutex_);
             odrv_stat_.active_errors = read_le<uint32_t>(frame.data + 0);
             odrv_stat_.disarm_reason = read_le<uint32_t>(frame.data + 4);
             odrv_pub_flag_ |= 0b001;
+            decoded = true;
             break;
         }
         case CmdId::kGetEncoderEstimates: {
-            if (!verify_length("kGetEncoderEstimates", 8, frame.can_dlc)) break;
+            if (!verify_length(CmdId::kGetEncoderEstimates, 8, frame.can_dlc)) break;
             std::lock_guard<std::mutex> guard(ctrl_stat_mutex_);
             ctrl_stat_.pos_estimate = read_le<float>(frame.data + 0);
             ctrl_stat_.vel_estimate = read_le<float>(frame.data + 4);
             ctrl_pub_flag_ |= 0b0010;
+            decoded = true;
             break;
         }
         case CmdId::kGetIq: {
-            if (!verify_length("kGetIq", 8, frame.can_dlc)) break;
+            if (!verify_length(CmdId::kGetIq, 8, frame.can_dlc)) break;
             std::lock_guard<std::mutex> guard(ctrl_stat_mutex_);
             ctrl_stat_.iq_setpoint = read_le<float>(frame.data + 0);
             ctrl_stat_.iq_measured = read_le<float>(frame.data + 4);
             ctrl_pub_flag_ |= 0b0100;
+            decoded = true;
             break;
         }
         case CmdId::kGetTemp: {
-            if (!verify_length("kGetTemp", 8, frame.can_dlc)) break;
+            if (!verify_length(CmdId::kGetTemp, 8, frame.can_dlc)) break;
             std::lock_guard<std::mutex> guard(odrv_stat_mutex_);
             odrv_stat_.fet_temperature   = read_le<float>(frame.data + 0);
             odrv_stat_.motor_temperature = read_le<float>(frame.data + 4);
             odrv_pub_flag_ |= 0b010;
+            decoded = true;
             break;
         }
         case CmdId::kGetBusVoltageCurrent: {
-            if (!verify_length("kGetBusVoltageCurrent", 8, frame.can_dlc)) break;
+            if (!verify_length(CmdId::kGetBusVoltageCurrent, 8, frame.can_dlc)) break;
             std::lock_guard<std::mutex> guard(odrv_stat_mutex_);
             odrv_stat_.bus_voltage = read_le<float>(frame.data + 0);
             odrv_stat_.bus_current = read_le<float>(frame.data + 4);
             odrv_pub_flag_ |= 0b100;
+            decoded = true;
             break;
         }
         case CmdId::kGetTorques: {
-            if (!verify_length("kGetTorques", 8, frame.can_dlc)) break;
+            if (!verify_length(CmdId::kGetTorques, 8, frame.can_dlc)) break;
             std::lock_guard<std::mutex> guard(ctrl_stat_mutex_);
             ctrl_stat_.torque_target   = read_le<float>(frame.data + 0);
             ctrl_stat_.torque_estimate = read_le<float>(frame.data + 4);
             ctrl_pub_flag_ |= 0b1000; 
+            decoded = true;
             break;
         }
         default: {
-            RCLCPP_WARN(rclcpp::Node::get_logger(), "Received unused message: ID = 0x%x", (frame.can_id & 0x1F));
+            unhandled_counts_[frame.can_id & 0x1F].fetch_add(1, std::memory_order_relaxed);
             break;
         }
     }
     
+    if (aggregate_publisher_ && decoded) aggregate_sample(frame.can_id & 0x1F);
+
+    if (shm_.is_open()) {
+        // ctrl_stat_ and odrv_stat_ are only written on this thread
+        shm_state_.timestamp_ns = ShmChannel::now_ns();
+        shm_state_.pos_estimate = ctrl_stat_.pos_estimate;
+        shm_state_.vel_estimate = ctrl_stat_.vel_estimate;
+        shm_state_.torque_target = ctrl_stat_.torque_target;
+        shm_state_.torque_estimate = ctrl_stat_.torque_estimate;
+        shm_state_.iq_setpoint = ctrl_stat_.iq_setpoint;
+        shm_state_.iq_measured = ctrl_stat_.iq_measured;
+        shm_state_.bus_voltage = odrv_stat_.bus_voltage;
+        shm_state_.bus_current = odrv_stat_.bus_current;
+        shm_state_.fet_temperature = odrv_stat_.fet_temperature;
+        shm_state_.motor_temperature = odrv_stat_.motor_temperature;
+        shm_state_.active_errors = ctrl_stat_.active_errors;
+        shm_state_.disarm_reason = odrv_stat_.disarm_reason;
+        shm_state_.axis_state = ctrl_stat_.axis_state;
+        shm_state_.procedure_result = ctrl_stat_.procedure_result;
+        shm_state_.trajectory_done_flag = ctrl_stat_.trajectory_done_flag;
+        shm_.write_state(node_id_, shm_state_);
+    }
+
     if (ctrl_pub_flag_ == 0b1111) {
-        ctrl_publisher_->publish(ctrl_stat_);
+        ODRIVE_TRACE_SCOPE("publish_controller_status");
+        ctrl_publisher_->publish(std::make_unique<ControllerStatusData>(ctrl_stat_));
         ctrl_pub_flag_ = 0;
     }
     
     if (odrv_pub_flag_ == 0b111) {
-        odrv_publisher_->publish(odrv_stat_);
+        ODRIVE_TRACE_SCOPE("publish_odrive_status");
+        odrv_publisher_->publish(std::make_unique<ODriveStatusData>(odrv_stat_));
         odrv_pub_flag_ = 0;
     }
 }
 
-void ODriveCanNode::subscriber_callback(const ControlMessage::SharedPtr msg) {
+void ODriveCanNode::aggregate_sample(uint32_t cmd_id) {
+    // ctrl_stat_ and odrv_stat_ are only written on this thread, so no lock is
+    // needed to read them back here.
+    switch (cmd_id) {
+        case CmdId::kGetIq:
+            iq_measured_stats_.add(ctrl_stat_.iq_measured);
+            break;
+        case CmdId::kGetTemp:
+            fet_temperature_stats_.add(odrv_stat_.fet_temperature);
+            motor_temperature_stats_.add(odrv_stat_.motor_temperature);
+            break;
+        case CmdId::kGetBusVoltageCurrent:
+            bus_voltage_stats_.add(odrv_stat_.bus_voltage);
+            bus_current_stats_.add(odrv_stat_.bus_current);
+            break;
+        default:
+            break;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - window_start_ < aggregation_window_) return;
+
+    auto fill = [](odrive_can::msg::SignalStatistics& dst, SignalStatistics& src) {
+        dst.min = src.min();
+        dst.max = src.max();
+        dst.mean = src.mean();
+        dst.count = src.count();
+        src.reset();
+    };
+
+    StatusAggregate msg;
+    msg.window_duration = std::chrono::duration<float>(now - window_start_).count();
+    fill(msg.iq_measured, iq_measured_stats_);
+    fill(msg.bus_voltage, bus_voltage_stats_);
+    fill(msg.bus_current, bus_current_stats_);
+    fill(msg.fet_temperature, fet_temperature_stats_);
+    fill(msg.motor_temperature, motor_temperature_stats_);
+    aggregate_publisher_->publish(msg);
+    window_start_ = now;
+}
+
+void ODriveCanNode::subscriber_callback(const ControlMessageData& msg) {
+    ODRIVE_TRACE_INSTANT("control_message", msg.control_mode);
     std::lock_guard<std::mutex> guard(ctrl_msg_mutex_);
-    ctrl_msg_ = *msg;
+    ctrl_msg_ = msg;
     sub_evt_.set();
 }
 
+void ODriveCanNode::gains_subscriber_callback(const ControllerGainsMsg::SharedPtr msg) {
+    // NaN fields keep the previously requested value
+    std::lock_guard<std::mutex> guard(gains_mutex_);
+    if (!std::isnan(msg->pos_gain)) gains_.pos_gain = msg->pos_gain;
+    if (!std::isnan(msg->vel_gain)) gains_.vel_gain = msg->vel_gain;
+    if (!std::isnan(msg->vel_integrator_gain)) gains_.vel_integrator_gain = msg->vel_integrator_gain;
+    gains_evt_.set();
+}
+
 void ODriveCanNode::service_callback(const std::shared_ptr<AxisState::Request> request, std::shared_ptr<AxisState::Response> response) {
     {
         std::unique_lock<std::mutex> guard(axis_state_mutex_);
@@ -206,6 +642,16 @@ void ODriveCanNode::service_clear_errors_callback(const std::shared_ptr<Empty::R
     (void)response;
 }
 
+void ODriveCanNode::service_dump_trace_callback(const std::shared_ptr<Empty::Request> request, std::shared_ptr<Empty::Response> response) {
+    if (Tracer::write_chrome_json(trace_file_)) {
+        RCLCPP_INFO(rclcpp::Node::get_logger(), "trace written to %s", trace_file_.c_str());
+    } else {
+        RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to write trace to %s", trace_file_.c_str());
+    }
+    (void)request;
+    (void)response;
+}
+
 void ODriveCanNode::request_state_callback() {
     uint32_t axis_state;
     {
@@ -220,14 +666,14 @@ void ODriveCanNode::request_state_callback() {
         frame.can_id = node_id_ << 5 | CmdId::kClearErrors;
         write_le<uint8_t>(0, frame.data);
         frame.can_dlc = 1;
-        can_intf_.send_can_frame(frame);
+        send_frame(frame);
     }
 
     // Set state
     frame.can_id = node_id_ << 5 | CmdId::kSetAxisState;
     write_le<uint32_t>(axis_state, frame.data);
     frame.can_dlc = 4;
-    can_intf_.send_can_frame(frame);
+    send_frame(frame);
 }
 
 void ODriveCanNode::request_clear_errors_callback() {
@@ -235,10 +681,11 @@ void ODriveCanNode::request_clear_errors_callback() {
     frame.can_id = node_id_ << 5 | CmdId::kClearErrors;
     write_le<uint8_t>(0, frame.data);
     frame.can_dlc = 1;
-    can_intf_.send_can_frame(frame);
+    send_frame(frame);
 }
 
 void ODriveCanNode::ctrl_msg_callback() {
+    ODRIVE_TRACE_SCOPE("control_message_tx");
 
     uint32_t control_mode;
     struct can_frame frame;
@@ -250,7 +697,7 @@ void ODriveCanNode::ctrl_msg_callback() {
         control_mode = ctrl_msg_.control_mode;
     }
     frame.can_dlc = 8;
-    can_intf_.send_can_frame(frame);
+    send_frame(frame);
     
     frame = can_frame{};
     switch (control_mode) {
@@ -290,12 +737,158 @@ void ODriveCanNode::ctrl_msg_callback() {
             return;
     }
 
-    can_intf_.send_can_frame(frame);
+    send_frame(frame);
+
+    // Gain changes that were held back by the rate limit go out with the setpoint
+    send_gains();
 }
 
-inline bool ODriveCanNode::verify_length(const std::string&name, uint8_t expected, uint8_t length) {
-    bool valid = expected == length;
-    RCLCPP_DEBUG(rclcpp::Node::get_logger(), "received %s", name.c_str());
-    if (!valid) RCLCPP_WARN(rclcpp::Node::get_logger(), "Incorrect %s frame length: %d != %d", name.c_str(), length, expected);
-    return valid;
+void ODriveCanNode::send_gains() {
+    ControllerGains gains;
+    {
+        std::lock_guard<std::mutex> guard(gains_mutex_);
+        gains = gains_;
+    }
+
+    gain_streamer_.update(gains, std::chrono::steady_clock::now(), [this](const auto& msg) { send(msg); });
+}
+
+void ODriveCanNode::shm_command_callback() {
+    ShmCommand command;
+    while (shm_.pop_command(&command)) {
+        if (command.node_id != node_id_) {
+            shm_foreign_commands_.fetch_add(1, std::memory_order_relaxed); // this node only serves one axis
+            continue;
+        }
+
+        switch (command.kind) {
+            case ShmCommand::kInputPos: {
+                Set_Input_Pos_msg_t msg;
+                msg.Input_Pos = command.input_pos;
+                msg.Vel_FF = command.input_vel;
+                msg.Torque_FF = command.input_torque;
+                send(msg);
+                break;
+            }
+            case ShmCommand::kInputVel: {
+                Set_Input_Vel_msg_t msg;
+                msg.Input_Vel = command.input_vel;
+                msg.Input_Torque_FF = command.input_torque;
+                send(msg);
+                break;
+            }
+            case ShmCommand::kInputTorque: {
+                Set_Input_Torque_msg_t msg;
+                msg.Input_Torque = command.input_torque;
+                send(msg);
+                break;
+            }
+        }
+    }
+}
+
+void ODriveCanNode::update_cyclic_rates(bool idle) {
+    if (rates_idle_ == static_cast<int>(idle)) return;
+    rates_idle_ = idle;
+    apply_cyclic_rates(rate_config_, plan_cyclic_rates(rate_config_, idle), [this](const auto& msg) { send(msg); });
+}
+
+void ODriveCanNode::on_reboot_event(RebootMonitor::Event event) {
+    const RebootMonitor::Recovery& recovery = reboot_monitor_.recovery();
+    if (event == RebootMonitor::Event::kReboot) {
+        reboots_.store(reboot_monitor_.reboots(), std::memory_order_relaxed);
+        const std::vector<can_frame>& frames = reboot_monitor_.reprovision_frames();
+        RCLCPP_WARN(rclcpp::Node::get_logger(), "ODrive rebooted (%s), replaying %zu frames%s",
+            RebootMonitor::cause_name(recovery.cause), frames.size(), recovery.rearm ? " and re-arming" : "");
+        // Back to back, so the axis is configured before the next setpoint arrives
+        if (can_intf_.send_can_frames(frames.data(), frames.size()) != frames.size()) {
+            RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to send all frames to re-provision the ODrive");
+        }
+    } else if (event == RebootMonitor::Event::kRefresh) {
+        const std::vector<can_frame>& frames = reboot_monitor_.reprovision_frames();
+        RCLCPP_DEBUG(rclcpp::Node::get_logger(), "heartbeats resumed in IDLE, re-sending %zu frames", frames.size());
+        if (can_intf_.send_can_frames(frames.data(), frames.size()) != frames.size()) {
+            RCLCPP_ERROR(rclcpp::Node::get_logger(), "Failed to send all frames to re-provision the ODrive");
+        }
+    } else if (event == RebootMonitor::Event::kRecovered) {
+        last_recovery_ns_.store(recovery.time_to_recover_ns(), std::memory_order_relaxed);
+        last_downtime_ns_.store(recovery.downtime_ns(), std::memory_order_relaxed);
+        if (recovery.success) {
+            RCLCPP_INFO(rclcpp::Node::get_logger(), "recovered from reboot in %.1f ms (down for %.1f ms)",
+                recovery.time_to_recover_ns() / 1e6, recovery.downtime_ns() / 1e6);
+        } else if (recovery.rearm_refused) {
+            RCLCPP_ERROR(rclcpp::Node::get_logger(), "Not re-arming after reboot: the position set with Set_Absolute_Position or homing was lost");
+        } else {
+            RCLCPP_ERROR(rclcpp::Node::get_logger(), "ODrive did not re-enter closed loop control after reboot, state: %d, procedure result: %d",
+                ctrl_stat_.axis_state, ctrl_stat_.procedure_result);
+        }
+    }
 }
+
+inline bool ODriveCanNode::verify_length(uint32_t cmd_id, uint8_t expected, uint8_t length) {
+    if (expected == length) return true;
+    bad_length_counts_[cmd_id].fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void ODriveCanNode::publish_diagnostics() {
+    DiagnosticStatus status;
+    status.name = "odrive_can: node_id " + std::to_string(node_id_);
+    status.hardware_id = "odrive_" + std::to_string(node_id_);
+    status.level = DiagnosticStatus::OK;
+    status.message = "OK";
+
+    auto add_value = [&status](const std::string& key, uint64_t value) {
+        diagnostic_msgs::msg::KeyValue kv;
+        kv.key = key;
+        kv.value = std::to_string(value);
+        status.values.push_back(kv);
+    };
+    auto id_key = [](const char* prefix, size_t cmd_id) {
+        char key[32];
+        std::snprintf(key, sizeof(key), "%s 0x%03zx", prefix, cmd_id);
+        return std::string(key);
+    };
+
+    add_value("rx frames", rx_frames_.load(std::memory_order_relaxed));
+    for (size_t cmd_id = 0; cmd_id < kNumCmdIds; ++cmd_id) {
+        uint32_t bad_length = bad_length_counts_[cmd_id].load(std::memory_order_relaxed);
+        if (bad_length) add_value(id_key("bad length", cmd_id), bad_length);
+        if (bad_length != reported_bad_length_[cmd_id]) {
+            // Only frames that arrived since the last report raise the level
+            status.level = DiagnosticStatus::WARN;
+            status.message = "frames with invalid length";
+            reported_bad_length_[cmd_id] = bad_length;
+        }
+
+        uint32_t unhandled = unhandled_counts_[cmd_id].load(std::memory_order_relaxed);
+        if (unhandled) add_value(id_key("unhandled", cmd_id), unhandled);
+    }
+
+    uint32_t reboots = reboots_.load(std::memory_order_relaxed);
+    if (reboots) {
+        add_value("reboots", reboots);
+        add_value("last recovery us", last_recovery_ns_.load(std::memory_order_relaxed) / 1000);
+        add_value("last downtime us", last_downtime_ns_.load(std::memory_order_relaxed) / 1000);
+    }
+    uint32_t foreign = shm_foreign_commands_.load(std::memory_order_relaxed);
+    if (foreign) add_value("shm commands for other node_ids", foreign);
+    if (foreign != reported_foreign_commands_) {
+        status.level = DiagnosticStatus::WARN;
+        status.message = "shared-memory commands for other node_ids";
+        reported_foreign_commands_ = foreign;
+    }
+
+    if (reboots != reported_reboots_) {
+        status.level = DiagnosticStatus::WARN;
+        status.message = "ODrive rebooted";
+        reported_reboots_ = reboots;
+    }
+
+    DiagnosticArray msg;
+    msg.header.stamp = rclcpp::Node::now();
+    msg.status.push_back(status);
+    diagnostics_publisher_->publish(msg);
+}
+
+RCLCPP_COMPONENTS_REGISTER_NODE(ODriveCanNode)
@@ -0,0 +1,140 @@
+#include "batch_decoder.hpp"
+#include "can_log.hpp"
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <cstring>
+#include <stdexcept>
+
+namespace py = pybind11;
+
+// Hands the vector's buffer to NumPy without copying
+template <typename T>
+static py::array_t<T> to_array(std::vector<T>&& values, std::vector<py::ssize_t> shape = {}) {
+    auto* owned = new std::vector<T>(std::move(values));
+    py::capsule owner(owned, [](void* p) { delete static_cast<std::vector<T>*>(p); });
+    if (shape.empty()) {
+        shape.push_back(static_cast<py::ssize_t>(owned->size()));
+    }
+    return py::array_t<T>(shape, owned->data(), owner);
+}
+
+// {node_id: {message: {"timestamp": ndarray, signal: ndarray, ...}}}
+static py::dict to_dict(BatchDecoder& decoder) {
+    py::dict result;
+    for (BatchDecoder::Series& series : decoder.series()) {
+        py::int_ node_id(series.node_id);
+        py::dict messages = result.contains(node_id) ? result[node_id].cast<py::dict>() : py::dict();
+        py::dict columns;
+        columns["timestamp"] = to_array(std::move(series.timestamps));
+        for (size_t i = 0; i < series.signals.size(); ++i) {
+            columns[series.message->signal_names[i]] = to_array(std::move(series.signals[i]));
+        }
+        messages[series.message->name] = columns;
+        result[node_id] = messages;
+    }
+    decoder.series().clear();
+    return result;
+}
+
+static CanLog read_log(const std::string& path, const std::string& interface) {
+    CanLog log;
+    bool ok;
+    {
+        py::gil_scoped_release release;
+        ok = read_candump_log(path, &log, interface);
+    }
+    if (!ok) {
+        throw std::runtime_error("failed to read " + path);
+    }
+    return log;
+}
+
+PYBIND11_MODULE(odrive_decode, m) {
+    m.doc() = "Batch decoding of recorded ODrive CANSimple traffic into NumPy arrays";
+
+    m.def(
+        "read_candump",
+        [](const std::string& path, const std::string& interface) {
+            CanLog log = read_log(path, interface);
+            size_t n = log.frames.size();
+            std::vector<uint32_t> can_ids(n);
+            std::vector<uint8_t> dlcs(n);
+            std::vector<uint8_t> data(n * CAN_MAX_DLEN);
+            for (size_t i = 0; i < n; ++i) {
+                can_ids[i] = log.frames[i].can_id;
+                dlcs[i] = log.frames[i].can_dlc;
+                std::memcpy(&data[i * CAN_MAX_DLEN], log.frames[i].data, CAN_MAX_DLEN);
+            }
+            return py::make_tuple(
+                to_array(std::move(log.timestamps)),
+                to_array(std::move(can_ids)),
+                to_array(std::move(dlcs)),
+                to_array(std::move(data), {static_cast<py::ssize_t>(n), CAN_MAX_DLEN})
+            );
+        },
+        py::arg("path"),
+        py::arg("interface") = "",
+        "Reads a candump -l log. Returns (timestamp, can_id, dlc, data[n, 8]); can_id carries the SocketCAN flags."
+    );
+
+    m.def(
+        "decode",
+        [](py::array_t<double, py::array::c_style | py::array::forcecast> timestamps,
+           py::array_t<uint32_t, py::array::c_style | py::array::forcecast> can_ids,
+           py::array_t<uint8_t, py::array::c_style | py::array::forcecast> dlcs,
+           py::array_t<uint8_t, py::array::c_style | py::array::forcecast> data) {
+            size_t n = timestamps.size();
+            if (can_ids.size() != static_cast<py::ssize_t>(n) || dlcs.size() != static_cast<py::ssize_t>(n)
+                || data.ndim() != 2 || data.shape(0) != static_cast<py::ssize_t>(n) || data.shape(1) != CAN_MAX_DLEN) {
+                throw std::invalid_argument("expected timestamp, can_id, dlc of length n and data of shape (n, 8)");
+            }
+            BatchDecoder decoder;
+            {
+                py::gil_scoped_release release;
+                std::vector<can_frame> frames(n);
+                for (size_t i = 0; i < n; ++i) {
+                    frames[i].can_id = can_ids.data()[i];
+                    frames[i].can_dlc = dlcs.data()[i];
+                    std::memcpy(frames[i].data, data.data() + i * CAN_MAX_DLEN, CAN_MAX_DLEN);
+                }
+                decoder.decode(timestamps.data(), frames.data(), n);
+            }
+            return to_dict(decoder);
+        },
+        py::arg("timestamp"),
+        py::arg("can_id"),
+        py::arg("dlc"),
+        py::arg("data"),
+        "Decodes frames as returned by read_candump(). Returns {node_id: {message: {signal: ndarray}}}, "
+        "where every message also has a 'timestamp' column."
+    );
+
+    m.def(
+        "decode_candump",
+        [](const std::string& path, const std::string& interface) {
+            CanLog log = read_log(path, interface);
+            BatchDecoder decoder;
+            {
+                py::gil_scoped_release release;
+                decoder.decode(log.timestamps.data(), log.frames.data(), log.frames.size());
+            }
+            return to_dict(decoder);
+        },
+        py::arg("path"),
+        py::arg("interface") = "",
+        "Same as decode(*read_candump(path, interface)), without the intermediate arrays."
+    );
+
+    m.def(
+        "messages",
+        []() {
+            py::dict result;
+            for (const DecodedMessage& message : decoded_messages()) {
+                result[message.name] = message.signal_names;
+            }
+            return result;
+        },
+        "Decoded messages and their signals"
+    );
+}
@@ -1,22 +1,64 @@
 
 #include "can_helpers.hpp"
+#include "can_mux_client.hpp"
 #include "can_simple_messages.hpp"
+#include "command_schedule.hpp"
+#include "cycle_trigger.hpp"
+#include "cyclic_rates.hpp"
+#include "fault_injection.hpp"
+#include "gain_streamer.hpp"
+#include "histogram.hpp"
 #include "hardware_interface/system_interface.hpp"
 #include "hardware_interface/types/hardware_interface_type_values.hpp"
+#include "impedance_controller.hpp"
 #include "odrive_enums.h"
+#include "perf_counters.hpp"
 #include "pluginlib/class_list_macros.hpp"
 #include "rclcpp/rclcpp.hpp"
+#include "reboot_monitor.hpp"
+#include "shared_can_bus.hpp"
+#include "shm_channel.hpp"
+#include "sim_can_bus.hpp"
 #include "socket_can.hpp"
+#include "staged_move.hpp"
+#include "tracer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <type_traits>
 
 namespace odrive_ros2_control {
 
 class Axis;
 
-class ODriveHardwareInterface final : public hardware_interface::SystemInterface {
+// One cycle statistic: the samples of the current period and the percentiles
+// exported for the previous one (NaN if it had no samples)
+struct CycleStat {
+    Histogram hist;
+    double p50 = NAN;
+    double p99 = NAN;
+    double max = NAN;
+
+    // Exports the percentiles, multiplied by scale, and starts a new period
+    void publish(double scale) {
+        p50 = hist.count() ? hist.percentile(0.50) * scale : NAN;
+        p99 = hist.count() ? hist.percentile(0.99) * scale : NAN;
+        max = hist.count() ? hist.max() * scale : NAN;
+        hist.reset();
+    }
+};
+
+class ODriveHardwareInterface : public hardware_interface::SystemInterface {
 public:
     using return_type = hardware_interface::return_type;
     using State = rclcpp_lifecycle::State;
 
+    ~ODriveHardwareInterface() override { stop_event_triggered_loop(); }
+
     CallbackReturn on_init(const hardware_interface::HardwareInfo& info) override;
     CallbackReturn on_configure(const State& previous_state) override;
     CallbackReturn on_cleanup(const State& previous_state) override;
@@ -36,20 +78,81 @@ public:
 
 private:
     void on_can_msg(const can_frame& frame);
+    void on_tx_echo(const can_frame& frame, uint64_t timestamp_ns);
+    void send_shm_commands();
     void set_axis_command_mode(Axis& axis);
+    void plan_command_schedule();
+    bool start_event_triggered_loop();
+    void stop_event_triggered_loop();
+    void on_event_triggered_msg(const can_frame& frame);
+    void release_sync_trigger();
+    void publish_cycle_stats();
 
     bool active_;
-    EpollEventLoop event_loop_;
     std::vector<Axis> axes_;
     std::string can_intf_name_;
-    SocketCanIntf can_intf_;
+    std::chrono::milliseconds gain_rate_limit_{0};
+    std::string trace_file_; // written on deactivation, empty if tracing is disabled
+    CyclicRateConfig rate_config_;
+    std::shared_ptr<SharedCanBus> bus_; // shared with other components on the same interface
     rclcpp::Time timestamp_;
+
+    // Joints with a command_rate only send their setpoint every divider-th
+    // write(). update_rate is required for them, the phases are planned by the
+    // bus across all components on it.
+    double update_rate_ = 0.0; // [Hz]
+    std::vector<uint32_t> command_phases_; // refreshed from the bus in every write()
+
+    // Raw state export / setpoint injection for non-ROS processes
+    std::string shm_name_;
+    ShmChannel shm_;
+
+    // Synchronized start: position setpoints of all axes are staged in write()
+    // and released as one burst. The skew of the last completed burst is
+    // exported as a state interface.
+    bool synchronized_start_ = false;
+    StagedMove staged_move_;
+    double start_skew_ = NAN; // [s]
+
+    // Event-triggered control runs on a second socket that only receives the
+    // encoder estimates of the participating axes. It is serviced by its own
+    // thread so the torque goes out as soon as the estimate arrives instead of
+    // waiting for the next read()/write() cycle.
+    EpollEventLoop et_event_loop_;
+    SocketCanIntf et_can_intf_;
+    EpollEvent et_stop_evt_;
+    std::thread et_thread_;
+
+    // Telemetry-synchronous cycles: the same thread watches the encoder
+    // estimates of all axes and notifies sync_trigger_ once sync_quorum_ of
+    // them have reported since the last notification. fresh_axes_ is only
+    // touched by the event-triggered thread.
+    std::string sync_trigger_name_; // empty if disabled
+    size_t sync_quorum_ = 0;
+    std::shared_ptr<CycleTrigger> sync_trigger_;
+    int sync_source_ = -1;
+    uint64_t fresh_axes_ = 0; // bit mask over axes_, on_init() rejects more than 64
+
+    // Cycle statistics, collected in every read()/write() and exported as
+    // state interfaces once per cycle_stats_period_ (0 = disabled)
+    std::chrono::milliseconds cycle_stats_period_{0};
+    std::chrono::steady_clock::time_point cycle_stats_published_;
+    CycleStat read_time_; // [s]
+    CycleStat write_time_; // [s]
+    CycleStat frames_per_read_;
+    double tx_failures_ = 0.0; // frames the shared bus failed to send, cumulative
+
+    // Process-wide performance counters, exported with the cycle statistics
+    // as the mean per execution of each region over the last period
+    static constexpr std::array<const char*, 4> kPerfRegions = {"read", "write", "can_rx", "decode"};
+    bool perf_counters_ = false;
+    std::array<PerfRegionStats, kPerfRegions.size()> perf_last_ = {};
+    std::array<std::array<double, kNumPerfEvents>, kPerfRegions.size()> perf_means_;
 };
 
 struct Axis {
-    Axis(SocketCanIntf* can_intf, uint32_t node_id, double transmission_ratio = 1.0, bool reverse_axis = false)
-        : can_intf_(can_intf),
-          node_id_(node_id),
+    Axis(uint32_t node_id, double transmission_ratio = 1.0, bool reverse_axis = false)
+        : node_id_(node_id),
           transmission_ratio_(transmission_ratio),
           reverse_axis_(reverse_axis) {}
 
@@ -57,7 +160,11 @@ struct Axis {
 
     void on_can_msg();
 
-    SocketCanIntf* can_intf_;
+    void update_impedance_target(bool active);
+    bool update_shm_state(const can_frame& frame);
+    void on_reboot_event(RebootMonitor::Event event);
+
+    SharedCanBus* bus_ = nullptr;
     uint32_t node_id_;
     double transmission_ratio_;
     bool reverse_axis_;
@@ -67,6 +174,13 @@ struct Axis {
     double vel_setpoint_ = 0.0f; // [rad/s]
     double torque_setpoint_ = 0.0f; // [Nm]
 
+    // Gains (ros2_control => ODrives), in ODrive units. Only sent when they
+    // change, NaN leaves the ODrive's configuration untouched.
+    double pos_gain_ = NAN; // [(rev/s) / rev]
+    double vel_gain_ = NAN; // [Nm / (rev/s)]
+    double vel_integrator_gain_ = NAN; // [Nm / rev]
+    GainStreamer gain_streamer_;
+
     // State (ODrives => ros2_control)
     // rclcpp::Time encoder_estimates_timestamp_;
     // uint32_t axis_error_ = 0;
@@ -95,17 +209,74 @@ struct Axis {
     bool vel_input_enabled_ = false;
     bool torque_input_enabled_ = false;
 
+    // Host-side impedance law, only allocated if event_triggered is enabled for
+    // this joint. Targets are handed over from write() without locking.
+    std::unique_ptr<ImpedanceController> impedance_;
+    double stiffness_ = 0.0; // [Nm/rad]
+    double damping_ = 0.0; // [Nm/(rad/s)]
+    double torque_limit_ = 0.0; // [Nm], <= 0 means unlimited
+
+    uint32_t input_mode_ = INPUT_MODE_PASSTHROUGH;
+
+    double command_rate_ = 0.0; // [Hz], 0 = every write()
+    uint32_t command_divider_ = 1;
+    bool command_due(uint64_t cycle, uint32_t phase) const { return cycle % command_divider_ == phase; }
+
+    // Cyclic message rates, re-planned whenever the axis enters or leaves idle
+    const CyclicRateConfig* rate_config_ = nullptr;
+    int rates_idle_ = -1; // -1 until the first heartbeat
+
+    // Raw ODrive state as exported through shared memory (ODrive units)
+    ShmAxisState shm_state_;
+
+    // Reception time (CLOCK_REALTIME) of the latest frame and the age it had
+    // at each read(), only maintained if cycle statistics are enabled
+    uint64_t last_rx_ns_ = 0;
+    CycleStat frame_age_; // [s]
+
+    // Re-provisions the ODrive after it rebooted, see reboot_monitor.hpp
+    RebootMonitor reboot_monitor_;
+    double reboots_ = 0.0;
+    double recovery_time_ = NAN; // [s] of the last recovery
+
     template <typename T>
-    void send(const T& msg) const {
+    static can_frame encode(uint32_t node_id, const T& msg) {
         struct can_frame frame;
-        frame.can_id = node_id_ << 5 | msg.cmd_id;
+        frame.can_id = node_id << 5 | msg.cmd_id;
         frame.can_dlc = msg.msg_length;
         msg.encode_buf(frame.data);
+        return frame;
+    }
 
-        can_intf_->send_can_frame(frame);
+    // Queued on the shared bus, sent once all components finished write()
+    template <typename T>
+    void send(const T& msg) {
+        can_frame frame = encode(node_id_, msg);
+        reboot_monitor_.on_send(frame);
+        bus_->queue(frame);
+    }
+
+    // Sent immediately on the given interface
+    template <typename T>
+    void send(const T& msg, SocketCanIntf* can_intf) const {
+        can_intf->send_can_frame(encode(node_id_, msg));
     }
 };
 
+// The same plugin, running on an in-process SimCanBus with one simulated ODrive
+// per joint instead of a CAN interface. Everything from encoding the setpoints
+// to decoding the telemetry goes through the same code as on hardware.
+class ODriveSimSystem final : public ODriveHardwareInterface {
+public:
+    ~ODriveSimSystem() override;
+
+    CallbackReturn on_init(const hardware_interface::HardwareInfo& info) override;
+
+private:
+    std::shared_ptr<SimCanBus> sim_bus_;
+    std::vector<uint32_t> sim_node_ids_;
+};
+
 } // namespace odrive_ros2_control
 
 using namespace odrive_ros2_control;
@@ -113,12 +284,118 @@ using namespace odrive_ros2_control;
 using hardware_interface::CallbackReturn;
 using hardware_interface::return_type;
 
+// Same clock as the kernel's SO_TIMESTAMPNS receive timestamps
+static uint64_t realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
 CallbackReturn ODriveHardwareInterface::on_init(const hardware_interface::HardwareInfo& info) {
     if (hardware_interface::SystemInterface::on_init(info) != CallbackReturn::SUCCESS) {
         return CallbackReturn::ERROR;
     }
 
     can_intf_name_ = info_.hardware_parameters["can"];
+    register_mux_can_backend();
+    register_fault_can_backend();
+    register_sim_can_backend();
+    if (info_.hardware_parameters.find("shm_name") != info_.hardware_parameters.end()) {
+        shm_name_ = info_.hardware_parameters.at("shm_name");
+    }
+    if (info_.hardware_parameters.find("synchronized_start") != info_.hardware_parameters.end()) {
+        std::string synchronized_start_str = info_.hardware_parameters.at("synchronized_start");
+        synchronized_start_ = (synchronized_start_str == "true" || synchronized_start_str == "1");
+    }
+    if (info_.hardware_parameters.find("trace_file") != info_.hardware_parameters.end()) {
+        trace_file_ = info_.hardware_parameters.at("trace_file");
+        Tracer::enable();
+    }
+    if (info_.hardware_parameters.find("sync_trigger") != info_.hardware_parameters.end()) {
+        sync_trigger_name_ = info_.hardware_parameters.at("sync_trigger");
+        if (info_.joints.size() > 64) {
+            RCLCPP_ERROR(rclcpp::get_logger("ODriveHardwareInterface"), "sync_trigger supports at most 64 joints per component");
+            return CallbackReturn::ERROR;
+        }
+    }
+    sync_quorum_ = info_.joints.size();
+    if (info_.hardware_parameters.find("sync_quorum") != info_.hardware_parameters.end()) {
+        sync_quorum_ = std::clamp<size_t>(std::stoul(info_.hardware_parameters.at("sync_quorum")), 1, info_.joints.size());
+    }
+    if (info_.hardware_parameters.find("update_rate") != info_.hardware_parameters.end()) {
+        update_rate_ = std::stod(info_.hardware_parameters.at("update_rate"));
+    }
+    if (info_.hardware_parameters.find("gain_rate_limit_ms") != info_.hardware_parameters.end()) {
+        gain_rate_limit_ = std::chrono::milliseconds(std::stoi(info_.hardware_parameters.at("gain_rate_limit_ms")));
+    }
+    if (info_.hardware_parameters.find("cycle_stats_period_ms") != info_.hardware_parameters.end()) {
+        cycle_stats_period_ = std::chrono::milliseconds(std::stoi(info_.hardware_parameters.at("cycle_stats_period_ms")));
+    }
+    if (info_.hardware_parameters.find("perf_counters") != info_.hardware_parameters.end()) {
+        std::string perf_counters_str = info_.hardware_parameters.at("perf_counters");
+        perf_counters_ = (perf_counters_str == "true" || perf_counters_str == "1");
+    }
+    if (perf_counters_ && cycle_stats_period_.count() <= 0) {
+        RCLCPP_WARN(rclcpp::get_logger("ODriveHardwareInterface"), "perf_counters requires cycle_stats_period_ms, ignoring");
+        perf_counters_ = false;
+    }
+    if (perf_counters_) {
+        PerfCounters::enable();
+        for (auto& means : perf_means_) {
+            means.fill(NAN);
+        }
+    }
+
+    // Cyclic message rates. num_axes defaults to the joints of this component
+    // and must be raised if other components or nodes share the bus.
+    rate_config_.num_axes = info_.joints.size();
+    if (info_.hardware_parameters.find("bus_bitrate") != info_.hardware_parameters.end()) {
+        rate_config_.bus_bitrate = std::stoul(info_.hardware_parameters.at("bus_bitrate"));
+    }
+    if (info_.hardware_parameters.find("num_axes") != info_.hardware_parameters.end()) {
+        rate_config_.num_axes = std::stoul(info_.hardware_parameters.at("num_axes"));
+    }
+    if (info_.hardware_parameters.find("bus_budget") != info_.hardware_parameters.end()) {
+        rate_config_.bus_budget = std::stod(info_.hardware_parameters.at("bus_budget"));
+    }
+    if (info_.hardware_parameters.find("command_rate_hz") != info_.hardware_parameters.end()) {
+        rate_config_.command_rate_hz = std::stod(info_.hardware_parameters.at("command_rate_hz"));
+    }
+    if (info_.hardware_parameters.find("idle_period_ms") != info_.hardware_parameters.end()) {
+        rate_config_.idle_period_ms = std::stoul(info_.hardware_parameters.at("idle_period_ms"));
+    }
+    for (size_t i = 0; i < kNumCyclicMessages; ++i) {
+        std::string name = kCyclicMessageNames[i];
+        if (info_.hardware_parameters.find("rate_weight." + name) != info_.hardware_parameters.end()) {
+            rate_config_.weights[i] = std::stod(info_.hardware_parameters.at("rate_weight." + name));
+        }
+        if (info_.hardware_parameters.find("endpoint_id." + name) != info_.hardware_parameters.end()) {
+            rate_config_.endpoint_ids[i] = std::stoi(info_.hardware_parameters.at("endpoint_id." + name));
+        }
+    }
+    if (rate_config_.bus_bitrate) {
+        double load = cyclic_bus_load(rate_config_, plan_cyclic_rates(rate_config_, false));
+        RCLCPP_INFO(rclcpp::get_logger("ODriveHardwareInterface"), "planned bus load: %.0f%%", load * 100.0);
+        if (load > rate_config_.bus_budget) {
+            RCLCPP_WARN(
+                rclcpp::get_logger("ODriveHardwareInterface"),
+                "Cyclic messages exceed the bus budget of %.0f%%",
+                rate_config_.bus_budget * 100.0
+            );
+        }
+    }
+
+    // Re-arming after a reboot assumes the ODrive comes back with a valid
+    // position, e.g. from an absolute encoder
+    bool rearm_after_reboot = false;
+    std::chrono::milliseconds reboot_min_silence{200};
+    if (info_.hardware_parameters.find("rearm_after_reboot") != info_.hardware_parameters.end()) {
+        std::string rearm_after_reboot_str = info_.hardware_parameters.at("rearm_after_reboot");
+        rearm_after_reboot = (rearm_after_reboot_str == "true" || rearm_after_reboot_str == "1");
+    }
+    if (info_.hardware_parameters.find("reboot_min_silence_ms") != info_.hardware_parameters.end()) {
+        reboot_min_silence = std::chrono::milliseconds(std::stoi(info_.hardware_parameters.at("reboot_min_silence_ms")));
+    }
 
     for (auto& joint : info_.joints) {
         double transmission_ratio = 1.0;
@@ -133,13 +410,60 @@ CallbackReturn ODriveHardwareInterface::on_init(const hardware_interface::Hardwa
 
         }
 
-        axes_.emplace_back(&can_intf_, std::stoi(joint.parameters.at("node_id")), transmission_ratio, reverse_axis);
+        axes_.emplace_back(std::stoi(joint.parameters.at("node_id")), transmission_ratio, reverse_axis);
+        axes_.back().gain_streamer_.set_min_interval(gain_rate_limit_);
+        if (joint.parameters.find("input_mode") != joint.parameters.end()) {
+            std::string input_mode_str = joint.parameters.at("input_mode");
+            if (input_mode_str == "trap_traj") {
+                axes_.back().input_mode_ = INPUT_MODE_TRAP_TRAJ;
+            } else if (input_mode_str != "passthrough") {
+                RCLCPP_ERROR(
+                    rclcpp::get_logger("ODriveHardwareInterface"),
+                    "Unsupported input_mode for joint %s: %s",
+                    joint.name.c_str(),
+                    input_mode_str.c_str()
+                );
+                return CallbackReturn::ERROR;
+            }
+        }
+
+        if (joint.parameters.find("command_rate") != joint.parameters.end()) {
+            axes_.back().command_rate_ = std::stod(joint.parameters.at("command_rate"));
+            if (axes_.back().command_rate_ > 0.0 && update_rate_ <= 0.0) {
+                // The hardware interface is not told the controller_manager's rate
+                RCLCPP_ERROR(
+                    rclcpp::get_logger("ODriveHardwareInterface"),
+                    "command_rate of joint %s requires the update_rate hardware parameter",
+                    joint.name.c_str()
+                );
+                return CallbackReturn::ERROR;
+            }
+        }
+        axes_.back().reboot_monitor_.set_rearm(rearm_after_reboot);
+        axes_.back().reboot_monitor_.set_min_silence(reboot_min_silence);
+
+        auto event_triggered = joint.parameters.find("event_triggered");
+        if (event_triggered != joint.parameters.end()
+            && (event_triggered->second == "true" || event_triggered->second == "1")) {
+            Axis& axis = axes_.back();
+            axis.impedance_ = std::make_unique<ImpedanceController>();
+            if (joint.parameters.find("stiffness") != joint.parameters.end()) {
+                axis.stiffness_ = std::stod(joint.parameters.at("stiffness"));
+            }
+            if (joint.parameters.find("damping") != joint.parameters.end()) {
+                axis.damping_ = std::stod(joint.parameters.at("damping"));
+            }
+            if (joint.parameters.find("torque_limit") != joint.parameters.end()) {
+                axis.torque_limit_ = std::stod(joint.parameters.at("torque_limit"));
+            }
+        }
     }
     return CallbackReturn::SUCCESS;
 }
 
 CallbackReturn ODriveHardwareInterface::on_configure(const State&) {
-    if (!can_intf_.init(can_intf_name_, &event_loop_, std::bind(&ODriveHardwareInterface::on_can_msg, this, _1))) {
+    bus_ = SharedCanBus::acquire(can_intf_name_);
+    if (!bus_) {
         RCLCPP_ERROR(
             rclcpp::get_logger("ODriveHardwareInterface"),
             "Failed to initialize SocketCAN on %s",
@@ -147,12 +471,73 @@ CallbackReturn ODriveHardwareInterface::on_configure(const State&) {
         );
         return CallbackReturn::ERROR;
     }
+    for (auto& axis : axes_) {
+        axis.bus_ = bus_.get();
+        axis.rate_config_ = rate_config_.bus_bitrate ? &rate_config_ : nullptr;
+        axis.rates_idle_ = -1;
+        axis.reboot_monitor_.reset();
+        if (!bus_->attach(axis.node_id_, this, std::bind(&ODriveHardwareInterface::on_can_msg, this, _1))) {
+            RCLCPP_ERROR(
+                rclcpp::get_logger("ODriveHardwareInterface"),
+                "node_id %u is already used by another component on %s",
+                axis.node_id_,
+                can_intf_name_.c_str()
+            );
+            bus_->detach(this);
+            bus_.reset();
+            return CallbackReturn::ERROR;
+        }
+    }
     RCLCPP_INFO(rclcpp::get_logger("ODriveHardwareInterface"), "Initialized SocketCAN on %s", can_intf_name_.c_str());
+    plan_command_schedule();
+
+    if (synchronized_start_
+        && !bus_->add_tx_echo_processor(this, [this](const can_frame& frame, uint64_t timestamp_ns) {
+               on_tx_echo(frame, timestamp_ns);
+           })) {
+        RCLCPP_WARN(rclcpp::get_logger("ODriveHardwareInterface"), "TX echo unavailable, start skew will not be measured");
+    }
+
+    if (cycle_stats_period_.count() > 0 && !bus_->intf()->enable_rx_timestamps()) {
+        RCLCPP_INFO(
+            rclcpp::get_logger("ODriveHardwareInterface"),
+            "No kernel RX timestamps on %s, frame ages are measured from when read() drains them",
+            can_intf_name_.c_str()
+        );
+    }
+    cycle_stats_published_ = std::chrono::steady_clock::now();
+    for (size_t i = 0; perf_counters_ && i < kPerfRegions.size(); ++i) {
+        perf_last_[i] = PerfCounters::region(kPerfRegions[i])->stats();
+    }
+
+    if (!shm_name_.empty() && !shm_.create(shm_name_)) {
+        RCLCPP_ERROR(
+            rclcpp::get_logger("ODriveHardwareInterface"),
+            "Failed to create shared memory region %s",
+            shm_name_.c_str()
+        );
+        bus_->detach(this);
+        bus_.reset();
+        return CallbackReturn::ERROR;
+    }
+
+    if (!start_event_triggered_loop()) {
+        RCLCPP_ERROR(rclcpp::get_logger("ODriveHardwareInterface"), "Failed to start event-triggered control");
+        shm_.close();
+        bus_->detach(this);
+        bus_.reset();
+        return CallbackReturn::ERROR;
+    }
     return CallbackReturn::SUCCESS;
 }
 
 CallbackReturn ODriveHardwareInterface::on_cleanup(const State&) {
-    can_intf_.deinit();
+    stop_event_triggered_loop();
+    shm_.close();
+    if (bus_) {
+        bus_->detach(this);
+        bus_.reset();
+    }
     return CallbackReturn::SUCCESS;
 }
 
@@ -178,6 +563,10 @@ CallbackReturn ODriveHardwareInterface::on_deactivate(const State&) {
         set_axis_command_mode(axis);
     }
 
+    if (!trace_file_.empty() && !Tracer::write_chrome_json(trace_file_)) {
+        RCLCPP_WARN(rclcpp::get_logger("ODriveHardwareInterface"), "Failed to write trace to %s", trace_file_.c_str());
+    }
+
     return CallbackReturn::SUCCESS;
 }
 
@@ -200,6 +589,35 @@ std::vector<hardware_interface::StateInterface> ODriveHardwareInterface::export_
             hardware_interface::HW_IF_POSITION,
             &axes_[i].pos_estimate_
         ));
+        state_interfaces.emplace_back(hardware_interface::StateInterface(info_.joints[i].name, "reboots", &axes_[i].reboots_));
+        state_interfaces.emplace_back(hardware_interface::StateInterface(info_.joints[i].name, "recovery_time", &axes_[i].recovery_time_));
+    }
+
+    if (synchronized_start_) {
+        state_interfaces.emplace_back(hardware_interface::StateInterface(info_.name, "start_skew", &start_skew_));
+    }
+
+    if (cycle_stats_period_.count() > 0) {
+        std::array<std::pair<std::string, CycleStat*>, 3> stats = {
+            {{"read_time", &read_time_}, {"write_time", &write_time_}, {"frames_per_read", &frames_per_read_}}};
+        for (auto& [name, stat] : stats) {
+            state_interfaces.emplace_back(hardware_interface::StateInterface(info_.name, name + "_p50", &stat->p50));
+            state_interfaces.emplace_back(hardware_interface::StateInterface(info_.name, name + "_p99", &stat->p99));
+            state_interfaces.emplace_back(hardware_interface::StateInterface(info_.name, name + "_max", &stat->max));
+        }
+        state_interfaces.emplace_back(hardware_interface::StateInterface(info_.name, "tx_failures", &tx_failures_));
+        for (size_t i = 0; perf_counters_ && i < kPerfRegions.size(); ++i) {
+            for (size_t j = 0; j < kNumPerfEvents; ++j) {
+                std::string name = std::string("perf_") + kPerfRegions[i] + "_" + kPerfEventNames[j];
+                state_interfaces.emplace_back(hardware_interface::StateInterface(info_.name, name, &perf_means_[i][j]));
+            }
+        }
+        for (size_t i = 0; i < info_.joints.size(); i++) {
+            CycleStat& stat = axes_[i].frame_age_;
+            state_interfaces.emplace_back(hardware_interface::StateInterface(info_.joints[i].name, "frame_age_p50", &stat.p50));
+            state_interfaces.emplace_back(hardware_interface::StateInterface(info_.joints[i].name, "frame_age_p99", &stat.p99));
+            state_interfaces.emplace_back(hardware_interface::StateInterface(info_.joints[i].name, "frame_age_max", &stat.max));
+        }
     }
 
     return state_interfaces;
@@ -224,6 +642,33 @@ std::vector<hardware_interface::CommandInterface> ODriveHardwareInterface::expor
             hardware_interface::HW_IF_POSITION,
             &axes_[i].pos_setpoint_
         ));
+        command_interfaces.emplace_back(hardware_interface::CommandInterface(
+            info_.joints[i].name,
+            "pos_gain",
+            &axes_[i].pos_gain_
+        ));
+        command_interfaces.emplace_back(hardware_interface::CommandInterface(
+            info_.joints[i].name,
+            "vel_gain",
+            &axes_[i].vel_gain_
+        ));
+        command_interfaces.emplace_back(hardware_interface::CommandInterface(
+            info_.joints[i].name,
+            "vel_integrator_gain",
+            &axes_[i].vel_integrator_gain_
+        ));
+        if (axes_[i].impedance_) {
+            command_interfaces.emplace_back(hardware_interface::CommandInterface(
+                info_.joints[i].name,
+                "stiffness",
+                &axes_[i].stiffness_
+            ));
+            command_interfaces.emplace_back(hardware_interface::CommandInterface(
+                info_.joints[i].name,
+                "damping",
+                &axes_[i].damping_
+            ));
+        }
     }
 
     return command_interfaces;
@@ -269,11 +714,13 @@ return_type ODriveHardwareInterface::perform_command_mode_switch(
 }
 
 return_type ODriveHardwareInterface::read(const rclcpp::Time& timestamp, const rclcpp::Duration&) {
+    ODRIVE_TRACE_SCOPE("read");
+    ODRIVE_PERF_SCOPE("read");
+    auto start = std::chrono::steady_clock::now();
     timestamp_ = timestamp;
 
-    while (can_intf_.read_nonblocking()) {
-        // repeat until CAN interface has no more messages
-    }
+    // Also delivers the frames of other components on the same bus
+    size_t n_frames = bus_->poll();
 
     // Convert motor state to joint state using transmission_ratio
     for (auto& axis : axes_) {
@@ -288,14 +735,39 @@ return_type ODriveHardwareInterface::read(const rclcpp::Time& timestamp, const r
         }
     }
 
+    if (cycle_stats_period_.count() > 0) {
+        uint64_t now_ns = realtime_ns();
+        for (auto& axis : axes_) {
+            if (axis.last_rx_ns_) {
+                axis.frame_age_.hist.add(now_ns > axis.last_rx_ns_ ? now_ns - axis.last_rx_ns_ : 0);
+            }
+        }
+        frames_per_read_.hist.add(n_frames);
+        auto end = std::chrono::steady_clock::now();
+        read_time_.hist.add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+
     return return_type::OK;
 }
 
 return_type ODriveHardwareInterface::write(const rclcpp::Time&, const rclcpp::Duration&) {
+    ODRIVE_TRACE_SCOPE("write");
+    ODRIVE_PERF_SCOPE("write");
+    auto start = std::chrono::steady_clock::now();
+    uint64_t cycle = bus_->begin_cycle(this);
+    bus_->command_phases(this, &command_phases_);
+
+    auto now = GainStreamer::Clock::now();
+    staged_move_.clear();
     int i = 0;
     for (auto& axis : axes_) {
         // Send the CAN message that fits the set of enabled setpoints
-        if (axis.pos_input_enabled_) {
+        if (axis.pos_input_enabled_ && axis.impedance_) {
+            // The torque is sent from the event-triggered thread
+            axis.update_impedance_target(true);
+        } else if (!axis.command_due(cycle, command_phases_[i])) {
+            // not this joint's turn - the ODrive keeps the previous setpoint
+        } else if (axis.pos_input_enabled_) {
             Set_Input_Pos_msg_t msg;
             if (axis.reverse_axis_ == true) {
                 msg.Input_Pos = -axis.pos_setpoint_
@@ -321,7 +793,11 @@ return_type ODriveHardwareInterface::write(const rclcpp::Time&, const rclcpp::Du
                 }
             }
 
-            axis.send(msg);
+            if (synchronized_start_) {
+                staged_move_.stage(axis.node_id_, msg);
+            } else {
+                axis.send(msg);
+            }
         } else if (axis.vel_input_enabled_) {
             Set_Input_Vel_msg_t msg;
             if (axis.reverse_axis_ == true) {
@@ -350,26 +826,148 @@ return_type ODriveHardwareInterface::write(const rclcpp::Time&, const rclcpp::Du
         } else {
             // no control enabled - don't send any setpoint
         }
+
+        // Gain changes go out right behind the setpoint of the same cycle
+        ControllerGains gains;
+        gains.pos_gain = axis.pos_gain_;
+        gains.vel_gain = axis.vel_gain_;
+        gains.vel_integrator_gain = axis.vel_integrator_gain_;
+        axis.gain_streamer_.update(gains, now, [&axis](const auto& msg) { axis.send(msg); });
         i++;
     }
 
+    if (staged_move_.size()) {
+        staged_move_.release(bus_.get());
+    }
+
+    if (shm_.is_open()) {
+        send_shm_commands();
+    }
+
+    bus_->commit(this);
+
+    if (cycle_stats_period_.count() > 0) {
+        auto end = std::chrono::steady_clock::now();
+        write_time_.hist.add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        if (end - cycle_stats_published_ >= cycle_stats_period_) {
+            publish_cycle_stats();
+            cycle_stats_published_ = end;
+        }
+    }
+
     return return_type::OK;
 }
 
+void ODriveHardwareInterface::publish_cycle_stats() {
+    read_time_.publish(1e-9);
+    write_time_.publish(1e-9);
+    frames_per_read_.publish(1.0);
+    for (auto& axis : axes_) {
+        axis.frame_age_.publish(1e-9);
+    }
+    tx_failures_ = bus_->tx_failures();
+
+    uint32_t available = PerfCounters::available_events();
+    for (size_t i = 0; perf_counters_ && i < kPerfRegions.size(); ++i) {
+        PerfRegionStats stats = PerfCounters::region(kPerfRegions[i])->stats();
+        uint64_t samples = stats.samples - perf_last_[i].samples;
+        for (size_t j = 0; j < kNumPerfEvents; ++j) {
+            perf_means_[i][j] = samples && (available & (1u << j))
+                                  ? static_cast<double>(stats.totals[j] - perf_last_[i].totals[j]) / samples
+                                  : NAN;
+        }
+        perf_last_[i] = stats;
+    }
+}
+
+void ODriveHardwareInterface::plan_command_schedule() {
+    std::vector<uint32_t> dividers;
+    for (auto& axis : axes_) {
+        axis.command_divider_ = command_divider(update_rate_, axis.command_rate_);
+        dividers.push_back(axis.command_divider_);
+        if (axis.command_divider_ > 1) {
+            RCLCPP_INFO(
+                rclcpp::get_logger("ODriveHardwareInterface"),
+                "node_id %u: setpoint every %u cycles (%.1f Hz)",
+                axis.node_id_,
+                axis.command_divider_,
+                update_rate_ / axis.command_divider_
+            );
+        }
+    }
+    // Phases are planned together with the other components on the bus
+    bus_->set_command_dividers(this, dividers);
+}
+
 void ODriveHardwareInterface::on_can_msg(const can_frame& frame) {
+    // The bus only routes frames of our own node_ids here
     for (auto& axis : axes_) {
         if ((frame.can_id >> 5) == axis.node_id_) {
-            axis.on_can_msg(timestamp_, frame);
+            if (cycle_stats_period_.count() > 0) {
+                uint64_t rx_ns = bus_->intf()->rx_timestamp_ns();
+                axis.last_rx_ns_ = rx_ns ? rx_ns : realtime_ns();
+            }
+            {
+                ODRIVE_PERF_SCOPE("decode");
+                axis.on_can_msg(timestamp_, frame);
+            }
+            if (shm_.is_open() && axis.update_shm_state(frame)) {
+                shm_.write_state(axis.node_id_, axis.shm_state_);
+            }
+        }
+    }
+}
+
+void ODriveHardwareInterface::on_tx_echo(const can_frame& frame, uint64_t timestamp_ns) {
+    if (staged_move_.on_tx_echo(frame, timestamp_ns)) {
+        start_skew_ = staged_move_.skew_ns() * 1e-9;
+    }
+}
+
+void ODriveHardwareInterface::send_shm_commands() {
+    // Injected setpoints are sent after the ones from ros2_control, in ODrive units
+    ShmCommand command;
+    while (shm_.pop_command(&command)) {
+        auto axis = std::find_if(axes_.begin(), axes_.end(), [&](const Axis& a) { return a.node_id_ == command.node_id; });
+        if (axis == axes_.end()) {
+            continue; // not ours
+        }
+
+        switch (command.kind) {
+            case ShmCommand::kInputPos: {
+                Set_Input_Pos_msg_t msg;
+                msg.Input_Pos = command.input_pos;
+                msg.Vel_FF = command.input_vel;
+                msg.Torque_FF = command.input_torque;
+                axis->send(msg);
+            } break;
+            case ShmCommand::kInputVel: {
+                Set_Input_Vel_msg_t msg;
+                msg.Input_Vel = command.input_vel;
+                msg.Input_Torque_FF = command.input_torque;
+                axis->send(msg);
+            } break;
+            case ShmCommand::kInputTorque: {
+                Set_Input_Torque_msg_t msg;
+                msg.Input_Torque = command.input_torque;
+                axis->send(msg);
+            } break;
         }
     }
 }
 
 void ODriveHardwareInterface::set_axis_command_mode(Axis& axis) {
+    // Stop the event-triggered law until write() provides a target for the new mode
+    if (axis.impedance_) {
+        axis.update_impedance_target(false);
+    }
+
     if (!active_) {
         RCLCPP_INFO(rclcpp::get_logger("ODriveHardwareInterface"), "Interface inactive. Setting axis to idle.");
         Set_Axis_State_msg_t idle_msg;
         idle_msg.Axis_Requested_State = AXIS_STATE_IDLE;
         axis.send(idle_msg);
+        bus_->flush();
         return;
     }
 
@@ -378,7 +976,7 @@ void ODriveHardwareInterface::set_axis_command_mode(Axis& axis) {
     Set_Axis_State_msg_t state_msg;
 
     clear_error_msg.Identify = 0;
-    control_msg.Input_Mode = INPUT_MODE_PASSTHROUGH;
+    control_msg.Input_Mode = INPUT_MODE_PASSTHROUGH; // input_mode only applies to position control
     state_msg.Axis_Requested_State = AXIS_STATE_CLOSED_LOOP_CONTROL;
 
     if (axis.pos_input_enabled_) {
@@ -388,8 +986,14 @@ void ODriveHardwareInterface::set_axis_command_mode(Axis& axis) {
         axis.vel_setpoint_ = 0.0f;
         axis.torque_setpoint_ = 0.0f;
         
-        RCLCPP_INFO(rclcpp::get_logger("ODriveHardwareInterface"), "Setting to position control.");
-        control_msg.Control_Mode = CONTROL_MODE_POSITION_CONTROL;
+        if (axis.impedance_) {
+            RCLCPP_INFO(rclcpp::get_logger("ODriveHardwareInterface"), "Setting to event-triggered impedance control.");
+            control_msg.Control_Mode = CONTROL_MODE_TORQUE_CONTROL;
+        } else {
+            RCLCPP_INFO(rclcpp::get_logger("ODriveHardwareInterface"), "Setting to position control.");
+            control_msg.Control_Mode = CONTROL_MODE_POSITION_CONTROL;
+            control_msg.Input_Mode = axis.input_mode_;
+        }
     } else if (axis.vel_input_enabled_) {
         RCLCPP_INFO(rclcpp::get_logger("ODriveHardwareInterface"), "Setting to velocity control.");
         control_msg.Control_Mode = CONTROL_MODE_VELOCITY_CONTROL;
@@ -400,12 +1004,204 @@ void ODriveHardwareInterface::set_axis_command_mode(Axis& axis) {
         RCLCPP_INFO(rclcpp::get_logger("ODriveHardwareInterface"), "No control mode specified. Setting to idle.");
         state_msg.Axis_Requested_State = AXIS_STATE_IDLE;
         axis.send(state_msg);
+        bus_->flush();
         return;
     }
 
     axis.send(control_msg);
     axis.send(clear_error_msg);
     axis.send(state_msg);
+    bus_->flush();
+}
+
+bool ODriveHardwareInterface::start_event_triggered_loop() {
+    std::vector<can_filter> filters;
+    for (auto& axis : axes_) {
+        if (axis.impedance_ || !sync_trigger_name_.empty()) {
+            filters.push_back({axis.node_id_ << 5 | Get_Encoder_Estimates_msg_t::cmd_id, CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_SFF_MASK});
+        }
+    }
+    if (filters.empty()) {
+        return true; // no joint uses event-triggered control and sync is disabled
+    }
+
+    if (!sync_trigger_name_.empty()) {
+        sync_trigger_ = CycleTrigger::acquire(sync_trigger_name_);
+        sync_source_ = sync_trigger_->add_source();
+        if (sync_source_ < 0) {
+            sync_trigger_.reset();
+            return false;
+        }
+        fresh_axes_ = 0;
+    }
+
+    if (!et_can_intf_.init(can_intf_name_, &et_event_loop_, std::bind(&ODriveHardwareInterface::on_event_triggered_msg, this, _1))) {
+        release_sync_trigger();
+        return false;
+    }
+    if (!et_can_intf_.set_filters(filters)) {
+        et_can_intf_.deinit();
+        release_sync_trigger();
+        return false;
+    }
+
+    // Tearing down the socket and this event on the loop thread leaves the
+    // loop without events, which ends run_until_empty().
+    if (!et_stop_evt_.init(&et_event_loop_, [this](uint32_t) {
+            et_can_intf_.deinit();
+            et_stop_evt_.deinit();
+        })) {
+        et_can_intf_.deinit();
+        release_sync_trigger();
+        return false;
+    }
+
+    et_thread_ = std::thread([this]() {
+        Tracer::set_thread_name("event_triggered");
+        et_event_loop_.run_until_empty();
+    });
+    if (sync_trigger_) {
+        RCLCPP_INFO(
+            rclcpp::get_logger("ODriveHardwareInterface"),
+            "Signaling cycles on %s once %zu of %zu axes reported",
+            sync_trigger_name_.c_str(),
+            sync_quorum_,
+            axes_.size()
+        );
+    } else {
+        RCLCPP_INFO(rclcpp::get_logger("ODriveHardwareInterface"), "Started event-triggered control for %zu axes", filters.size());
+    }
+    return true;
+}
+
+void ODriveHardwareInterface::stop_event_triggered_loop() {
+    if (!et_thread_.joinable()) {
+        return;
+    }
+    et_stop_evt_.set();
+    et_thread_.join();
+    release_sync_trigger();
+}
+
+void ODriveHardwareInterface::release_sync_trigger() {
+    if (sync_trigger_) {
+        sync_trigger_->remove_source(sync_source_);
+        sync_trigger_.reset();
+        sync_source_ = -1;
+    }
+}
+
+void ODriveHardwareInterface::on_event_triggered_msg(const can_frame& frame) {
+    // Runs on the event-triggered thread. Only touches the immutable parts of
+    // axes_, the wait-free ImpedanceController and the sync state.
+    for (size_t i = 0; i < axes_.size(); ++i) {
+        Axis& axis = axes_[i];
+        if ((frame.can_id >> 5) != axis.node_id_) {
+            continue;
+        }
+        if ((frame.can_id & 0x1f) != Get_Encoder_Estimates_msg_t::cmd_id
+            || frame.can_dlc < Get_Encoder_Estimates_msg_t::msg_length) {
+            return;
+        }
+
+        if (axis.impedance_) {
+            Get_Encoder_Estimates_msg_t estimates;
+            estimates.decode_buf(frame.data);
+
+            float torque;
+            if (axis.impedance_->update(estimates.Pos_Estimate, estimates.Vel_Estimate, &torque)) {
+                Set_Input_Torque_msg_t msg;
+                msg.Input_Torque = torque;
+                axis.send(msg, &et_can_intf_);
+            }
+        }
+
+        // The frame is in the shared socket's queue as well by now, so the
+        // read() of the triggered cycle sees it.
+        if (sync_trigger_) {
+            fresh_axes_ |= 1ull << i;
+            if (static_cast<size_t>(std::popcount(fresh_axes_)) >= sync_quorum_) {
+                fresh_axes_ = 0;
+                sync_trigger_->notify(sync_source_);
+            }
+        }
+        return;
+    }
+}
+
+void Axis::update_impedance_target(bool active) {
+    // Same joint => motor conversion as the Set_Input_Pos path in write().
+    // Converting the gains, the transmission ratio cancels out and only the
+    // rad => turn factor remains.
+    double direction = reverse_axis_ ? -1.0 : 1.0;
+
+    ImpedanceTarget target;
+    target.active = active;
+    target.pos = direction * pos_setpoint_ / (2 * M_PI * transmission_ratio_);
+    target.vel = vel_input_enabled_ ? direction * vel_setpoint_ / (2 * M_PI * transmission_ratio_) : 0.0f;
+    target.torque_ff = torque_input_enabled_ ? direction * torque_setpoint_ / transmission_ratio_ : 0.0f;
+    target.stiffness = 2 * M_PI * stiffness_;
+    target.damping = 2 * M_PI * damping_;
+    target.torque_limit = torque_limit_ / transmission_ratio_;
+    impedance_->set_target(target);
+}
+
+bool Axis::update_shm_state(const can_frame& frame) {
+    if (frame.can_dlc < 8) {
+        return false; // all cyclic messages are 8 bytes
+    }
+
+    switch (frame.can_id & 0x1f) {
+        case Heartbeat_msg_t::cmd_id: {
+            Heartbeat_msg_t msg;
+            msg.decode_buf(frame.data);
+            shm_state_.active_errors = msg.Axis_Error;
+            shm_state_.axis_state = msg.Axis_State;
+            shm_state_.procedure_result = msg.Procedure_Result;
+            shm_state_.trajectory_done_flag = msg.Trajectory_Done_Flag;
+        } break;
+        case Get_Error_msg_t::cmd_id: {
+            Get_Error_msg_t msg;
+            msg.decode_buf(frame.data);
+            shm_state_.active_errors = msg.Active_Errors;
+            shm_state_.disarm_reason = msg.Disarm_Reason;
+        } break;
+        case Get_Encoder_Estimates_msg_t::cmd_id: {
+            Get_Encoder_Estimates_msg_t msg;
+            msg.decode_buf(frame.data);
+            shm_state_.pos_estimate = msg.Pos_Estimate;
+            shm_state_.vel_estimate = msg.Vel_Estimate;
+        } break;
+        case Get_Iq_msg_t::cmd_id: {
+            Get_Iq_msg_t msg;
+            msg.decode_buf(frame.data);
+            shm_state_.iq_setpoint = msg.Iq_Setpoint;
+            shm_state_.iq_measured = msg.Iq_Measured;
+        } break;
+        case Get_Temperature_msg_t::cmd_id: {
+            Get_Temperature_msg_t msg;
+            msg.decode_buf(frame.data);
+            shm_state_.fet_temperature = msg.FET_Temperature;
+            shm_state_.motor_temperature = msg.Motor_Temperature;
+        } break;
+        case Get_Bus_Voltage_Current_msg_t::cmd_id: {
+            Get_Bus_Voltage_Current_msg_t msg;
+            msg.decode_buf(frame.data);
+            shm_state_.bus_voltage = msg.Bus_Voltage;
+            shm_state_.bus_current = msg.Bus_Current;
+        } break;
+        case Get_Torques_msg_t::cmd_id: {
+            Get_Torques_msg_t msg;
+            msg.decode_buf(frame.data);
+            shm_state_.torque_target = msg.Torque_Target;
+            shm_state_.torque_estimate = msg.Torque_Estimate;
+        } break;
+        default:
+            return false;
+    }
+
+    shm_state_.timestamp_ns = ShmChannel::now_ns();
+    return true;
 }
 
 void Axis::on_can_msg(const rclcpp::Time&, const can_frame& frame) {
@@ -421,6 +1217,27 @@ void Axis::on_can_msg(const rclcpp::Time&, const can_frame& frame) {
     };
 
     switch (cmd) {
+        case Get_Version_msg_t::cmd_id: {
+            if (frame.can_dlc >= Get_Version_msg_t::msg_length) {
+                on_reboot_event(reboot_monitor_.on_version(frame, ShmChannel::now_ns()));
+            }
+        } break;
+        case Heartbeat_msg_t::cmd_id: {
+            if (Heartbeat_msg_t msg; try_decode(msg)) {
+                on_reboot_event(reboot_monitor_.on_heartbeat(frame, ShmChannel::now_ns()));
+                if (reboot_monitor_.take_version_probe()) {
+                    bus_->queue(RebootMonitor::version_request(node_id_));
+                }
+                // While recovering from a reboot, the replayed rates stay until the axis is back
+                bool idle = msg.Axis_State == AXIS_STATE_IDLE;
+                if (rate_config_ && !reboot_monitor_.recovering() && rates_idle_ != static_cast<int>(idle)) {
+                    rates_idle_ = idle;
+                    apply_cyclic_rates(*rate_config_, plan_cyclic_rates(*rate_config_, idle), [this](const auto& sdo) {
+                        send(sdo);
+                    });
+                }
+            }
+        } break;
         case Get_Encoder_Estimates_msg_t::cmd_id: {
             if (Get_Encoder_Estimates_msg_t msg; try_decode(msg)) {
                 pos_estimate_ = msg.Pos_Estimate * (2 * M_PI);
@@ -437,4 +1254,135 @@ void Axis::on_can_msg(const rclcpp::Time&, const can_frame& frame) {
     }
 }
 
+void Axis::on_reboot_event(RebootMonitor::Event event) {
+    const RebootMonitor::Recovery& recovery = reboot_monitor_.recovery();
+    if (event == RebootMonitor::Event::kReboot) {
+        reboots_ = reboot_monitor_.reboots();
+        const std::vector<can_frame>& frames = reboot_monitor_.reprovision_frames();
+        RCLCPP_WARN(
+            rclcpp::get_logger("ODriveHardwareInterface"),
+            "ODrive %u rebooted (%s), replaying %zu frames%s",
+            node_id_,
+            RebootMonitor::cause_name(recovery.cause),
+            frames.size(),
+            recovery.rearm ? " and re-arming" : ""
+        );
+        // Flushed together with, and ahead of, the setpoints of this cycle
+        for (const can_frame& frame : frames) {
+            bus_->queue(frame);
+        }
+    } else if (event == RebootMonitor::Event::kRefresh) {
+        for (const can_frame& frame : reboot_monitor_.reprovision_frames()) {
+            bus_->queue(frame);
+        }
+    } else if (event == RebootMonitor::Event::kRecovered) {
+        recovery_time_ = recovery.time_to_recover_ns() * 1e-9;
+        if (recovery.success) {
+            RCLCPP_INFO(
+                rclcpp::get_logger("ODriveHardwareInterface"),
+                "ODrive %u recovered from reboot in %.1f ms (down for %.1f ms)",
+                node_id_,
+                recovery.time_to_recover_ns() / 1e6,
+                recovery.downtime_ns() / 1e6
+            );
+        } else if (recovery.rearm_refused) {
+            RCLCPP_ERROR(
+                rclcpp::get_logger("ODriveHardwareInterface"),
+                "ODrive %u not re-armed after reboot: the position set with Set_Absolute_Position or homing was lost",
+                node_id_
+            );
+        } else {
+            RCLCPP_ERROR(
+                rclcpp::get_logger("ODriveHardwareInterface"),
+                "ODrive %u did not re-enter closed loop control after reboot",
+                node_id_
+            );
+        }
+    }
+}
+
+ODriveSimSystem::~ODriveSimSystem() {
+    for (uint32_t node_id : sim_node_ids_) {
+        sim_bus_->remove_drive(node_id);
+    }
+}
+
+CallbackReturn ODriveSimSystem::on_init(const hardware_interface::HardwareInfo& info) {
+    // Joints that share a sim_bus (default: the component name) see each
+    // other's traffic, as on a shared CAN interface.
+    std::string bus_name = info.name;
+    if (info.hardware_parameters.find("sim_bus") != info.hardware_parameters.end()) {
+        bus_name = info.hardware_parameters.at("sim_bus");
+    }
+    sim_bus_ = SimCanBus::acquire(bus_name);
+
+    for (auto& joint : info.joints) {
+        // sim.<name> of the joint, falling back to sim.<name> of the component
+        auto param = [&](const std::string& name, auto* value) {
+            auto it = joint.parameters.find("sim." + name);
+            if (it == joint.parameters.end()) {
+                it = info.hardware_parameters.find("sim." + name);
+                if (it == info.hardware_parameters.end()) {
+                    return;
+                }
+            }
+            if constexpr (std::is_same_v<decltype(*value), bool&>) {
+                *value = it->second == "true" || it->second == "1";
+            } else {
+                *value = std::stod(it->second);
+            }
+        };
+
+        SimODriveConfig config;
+        param("inertia", &config.inertia);
+        param("viscous_friction", &config.viscous_friction);
+        param("coulomb_friction", &config.coulomb_friction);
+        param("torque_constant", &config.torque_constant);
+        param("phase_resistance", &config.phase_resistance);
+        param("bus_voltage", &config.bus_voltage);
+        param("position", &config.position);
+        param("current_limit", &config.current_limit);
+        param("vel_limit", &config.vel_limit);
+        param("vel_limit_tolerance", &config.vel_limit_tolerance);
+        param("pos_gain", &config.pos_gain);
+        param("vel_gain", &config.vel_gain);
+        param("vel_integrator_gain", &config.vel_integrator_gain);
+        param("vel_ramp_rate", &config.vel_ramp_rate);
+        param("torque_ramp_rate", &config.torque_ramp_rate);
+        param("input_filter_bandwidth", &config.input_filter_bandwidth);
+        param("traj_vel_limit", &config.traj_vel_limit);
+        param("traj_accel_limit", &config.traj_accel_limit);
+        param("traj_decel_limit", &config.traj_decel_limit);
+        param("traj_inertia", &config.traj_inertia);
+        param("procedure_s", &config.procedure_s);
+        param("calibrated", &config.calibrated);
+        param("boot_s", &config.boot_s);
+        for (size_t i = 0; i < kNumCyclicMessages; ++i) {
+            std::string name = kCyclicMessageNames[i];
+            param(name + "_msg_rate_ms", &config.msg_rate_ms[i]);
+            // Lets the rate planner's RxSdo writes reach the simulated drive
+            if (info.hardware_parameters.find("endpoint_id." + name) != info.hardware_parameters.end()) {
+                config.endpoint_ids[i] = std::stoi(info.hardware_parameters.at("endpoint_id." + name));
+            }
+        }
+
+        uint32_t node_id = std::stoi(joint.parameters.at("node_id"));
+        if (!sim_bus_->add_drive(node_id, config)) {
+            RCLCPP_ERROR(
+                rclcpp::get_logger("ODriveSimSystem"),
+                "node_id %u is already simulated on %s",
+                node_id,
+                bus_name.c_str()
+            );
+            return CallbackReturn::ERROR;
+        }
+        sim_node_ids_.push_back(node_id);
+    }
+
+    hardware_interface::HardwareInfo sim_info = info;
+    sim_info.hardware_parameters["can"] = "sim:" + bus_name;
+    return ODriveHardwareInterface::on_init(sim_info);
+}
+
 PLUGINLIB_EXPORT_CLASS(odrive_ros2_control::ODriveHardwareInterface, hardware_interface::SystemInterface)
+PLUGINLIB_EXPORT_CLASS(odrive_ros2_control::ODriveSimSystem, hardware_interface::SystemInterface)
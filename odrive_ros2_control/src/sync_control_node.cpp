@@ -0,0 +1,62 @@
+#include "controller_manager/controller_manager.hpp"
+#include "cycle_trigger.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "tracer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Drop-in replacement for ros2_control_node that runs the control cycle when
+// the ODrive hardware components report fresh encoder estimates (hardware
+// parameter sync_trigger) instead of on a free-running timer. The data a cycle
+// acts on is then always equally old, regardless of the phase between the
+// ODrives' cyclic messages and the host clock.
+//
+// If no cycle becomes ready within sync_timeout_ms (e.g. before the hardware
+// is configured or while the ODrives are off), the cycle runs anyway so that
+// controllers and services keep working.
+int main(int argc, char* argv[]) {
+    rclcpp::init(argc, argv);
+
+    std::shared_ptr<rclcpp::Executor> executor = std::make_shared<rclcpp::executors::MultiThreadedExecutor>();
+    auto cm = std::make_shared<controller_manager::ControllerManager>(executor, "controller_manager");
+
+    std::string trigger_name = cm->declare_parameter<std::string>("sync_trigger", "odrive");
+    unsigned int update_rate = cm->get_update_rate();
+    int64_t timeout_ms = cm->declare_parameter<int64_t>("sync_timeout_ms", 2 * 1000 / std::max(1u, update_rate));
+
+    RCLCPP_INFO(
+        cm->get_logger(),
+        "Running cycles on sync trigger %s (timeout %ld ms)",
+        trigger_name.c_str(),
+        static_cast<long>(timeout_ms)
+    );
+
+    std::thread cm_thread([cm, trigger_name, timeout_ms]() {
+        Tracer::set_thread_name("control_cycle");
+        std::shared_ptr<CycleTrigger> trigger = CycleTrigger::acquire(trigger_name);
+        uint64_t timeouts = 0;
+
+        rclcpp::Time previous_time = cm->now();
+        while (rclcpp::ok()) {
+            if (!trigger->wait_for(std::chrono::milliseconds(timeout_ms)) && (++timeouts % 1000) == 1) {
+                RCLCPP_WARN(cm->get_logger(), "No fresh estimates within %ld ms", static_cast<long>(timeout_ms));
+            }
+
+            ODRIVE_TRACE_SCOPE("control_cycle");
+            rclcpp::Time current_time = cm->now();
+            rclcpp::Duration period = current_time - previous_time;
+            previous_time = current_time;
+
+            cm->read(current_time, period);
+            cm->update(current_time, period);
+            cm->write(current_time, period);
+        }
+    });
+
+    executor->add_node(cm);
+    executor->spin();
+    cm_thread.join();
+    rclcpp::shutdown();
+    return 0;
+}